@@ -0,0 +1,67 @@
+#include "Async/Executor.hpp"
+
+Executor::Executor(unsigned ioThreads):
+m_io(ioThreads)
+{
+}
+
+void Executor::spawn(Task<void> task)
+{
+  auto detached = detach(*this,std::move(task));
+  {
+    std::lock_guard lock(m_mutex);
+    ++m_active;
+  }
+  post(detached.handle);
+}
+
+void Executor::run()
+{
+  for(;;)
+  {
+    std::coroutine_handle<> handle;
+    {
+      std::unique_lock lock(m_mutex);
+      // coroutines waiting for offloaded work are posted by the I/O threads
+      m_ready.wait(lock,[&](){ return !m_queue.empty() || m_active==0; });
+      if(m_queue.empty())
+      {
+        break;
+      }
+      handle = m_queue.front();
+      m_queue.pop_front();
+    }
+    handle.resume();
+  }
+  if(m_error)
+  {
+    std::rethrow_exception(std::exchange(m_error,nullptr));
+  }
+}
+
+void Executor::post(std::coroutine_handle<> handle)
+{
+  {
+    std::lock_guard lock(m_mutex);
+    m_queue.push_back(handle);
+  }
+  m_ready.notify_one();
+}
+
+Executor::Detached Executor::detach(Executor& executor, Task<void> task)
+{
+  try
+  {
+    co_await task;
+  }
+  catch(...)
+  {
+    std::lock_guard lock(executor.m_mutex);
+    if(!executor.m_error)
+    {
+      executor.m_error = std::current_exception();
+    }
+  }
+  std::lock_guard lock(executor.m_mutex);
+  --executor.m_active;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "Async/Task.hpp"
+#include "WorkStealingPool.hpp"
+
+// Single threaded event loop for coroutines
+// Coroutines run on the thread calling run(), blocking work is offloaded to a small pool of I/O threads
+// and the coroutine is resumed on the event loop once it finished, so one thread can keep
+// thousands of requests in flight
+class Executor
+{
+public:
+  static constexpr unsigned DEFAULT_IO_THREADS = 4;
+
+  explicit Executor(unsigned ioThreads = DEFAULT_IO_THREADS);
+  Executor(const Executor&) = delete;
+  Executor(Executor&&) = delete;
+  Executor& operator=(const Executor&) = delete;
+  Executor& operator=(Executor&&) = delete;
+  ~Executor() = default;
+
+  // Starts task on the event loop, the first exception of a spawned task is rethrown by run
+  void spawn(Task<void> task);
+
+  // Runs coroutines until all spawned tasks completed
+  void run();
+
+  // Runs task on the event loop until it completed and returns its result
+  template<typename T>
+  T blockOn(Task<T> task)
+  {
+    if constexpr(std::is_void_v<T>)
+    {
+      spawn(std::move(task));
+      run();
+    }
+    else
+    {
+      std::optional<T> result;
+      spawn(store(std::move(task),result));
+      run();
+      return std::move(*result);
+    }
+  }
+
+  // Queues handle to be resumed on the event loop, may be called from any thread
+  void post(std::coroutine_handle<> handle);
+
+  // co_await schedule() suspends the coroutine and resumes it after the coroutines that are already queued
+  auto schedule() noexcept
+  {
+    struct Awaiter
+    {
+      Executor& executor;
+
+      bool await_ready() noexcept
+      {
+        return false;
+      }
+
+      void await_suspend(std::coroutine_handle<> handle)
+      {
+        executor.post(handle);
+      }
+
+      void await_resume() noexcept {}
+    };
+    return Awaiter{*this};
+  }
+
+  // co_await offload(fn) calls fn on an I/O thread and resumes the coroutine on the event loop
+  // with the result of fn, exceptions of fn are rethrown by co_await
+  template<typename Fn>
+  auto offload(Fn fn)
+  {
+    using Result = std::invoke_result_t<Fn&>;
+    struct Awaiter
+    {
+      Executor& executor;
+      Fn fn;
+      std::conditional_t<std::is_void_v<Result>,bool,std::optional<Result>> result{};
+      std::exception_ptr error;
+
+      bool await_ready() noexcept
+      {
+        return false;
+      }
+
+      void await_suspend(std::coroutine_handle<> handle)
+      {
+        executor.m_io.submit([this, handle]()
+        {
+          try
+          {
+            if constexpr(std::is_void_v<Result>)
+            {
+              fn();
+            }
+            else
+            {
+              result.emplace(fn());
+            }
+          }
+          catch(...)
+          {
+            error = std::current_exception();
+          }
+          executor.post(handle);
+        });
+      }
+
+      Result await_resume()
+      {
+        if(error)
+        {
+          std::rethrow_exception(error);
+        }
+        if constexpr(!std::is_void_v<Result>)
+        {
+          return std::move(*result);
+        }
+      }
+    };
+    return Awaiter{*this,std::move(fn),{},nullptr};
+  }
+
+private:
+  // owns a spawned task, destroys itself when the task completed
+  struct Detached
+  {
+    struct promise_type
+    {
+      Detached get_return_object() noexcept
+      {
+        return Detached{std::coroutine_handle<promise_type>::from_promise(*this)};
+      }
+
+      std::suspend_always initial_suspend() noexcept
+      {
+        return {};
+      }
+
+      std::suspend_never final_suspend() noexcept
+      {
+        return {};
+      }
+
+      void return_void() noexcept {}
+
+      void unhandled_exception() noexcept
+      {
+        std::terminate();
+      }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+  };
+
+  static Detached detach(Executor& executor, Task<void> task);
+
+  template<typename T>
+  static Task<void> store(Task<T> task, std::optional<T>& result)
+  {
+    result.emplace(co_await task);
+  }
+
+  std::mutex m_mutex;
+  std::condition_variable m_ready;
+  std::deque<std::coroutine_handle<>> m_queue;
+  // spawned tasks that have not completed yet
+  size_t m_active = 0;
+  std::exception_ptr m_error;
+  WorkStealingPool m_io;
+};
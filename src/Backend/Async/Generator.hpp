@@ -0,0 +1,139 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// Coroutine producing a sequence of T, the producer may co_await between the values it yields
+// The consumer awaits next(), which returns std::nullopt once the producer returned
+template<typename T>
+class [[nodiscard]] AsyncGenerator
+{
+public:
+  struct promise_type
+  {
+    std::optional<T> current;
+    // coroutine awaiting next(), resumed on every value and on completion
+    std::coroutine_handle<> consumer = std::noop_coroutine();
+    std::exception_ptr error;
+
+    AsyncGenerator get_return_object() noexcept
+    {
+      return AsyncGenerator(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept
+    {
+      return {};
+    }
+
+    struct YieldAwaiter
+    {
+      bool await_ready() noexcept
+      {
+        return false;
+      }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+      {
+        return handle.promise().consumer;
+      }
+
+      void await_resume() noexcept {}
+    };
+
+    YieldAwaiter final_suspend() noexcept
+    {
+      return {};
+    }
+
+    YieldAwaiter yield_value(T value)
+    {
+      current.emplace(std::move(value));
+      return {};
+    }
+
+    void return_void() noexcept {}
+
+    void unhandled_exception() noexcept
+    {
+      error = std::current_exception();
+    }
+  };
+
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  explicit AsyncGenerator(handle_type handle) noexcept:
+  m_handle(handle)
+  {
+  }
+
+  AsyncGenerator(const AsyncGenerator&) = delete;
+  AsyncGenerator& operator=(const AsyncGenerator&) = delete;
+
+  AsyncGenerator(AsyncGenerator&& other) noexcept:
+  m_handle(std::exchange(other.m_handle,nullptr))
+  {
+  }
+
+  AsyncGenerator& operator=(AsyncGenerator&& other) noexcept
+  {
+    if(this!=&other)
+    {
+      if(m_handle)
+      {
+        m_handle.destroy();
+      }
+      m_handle = std::exchange(other.m_handle,nullptr);
+    }
+    return *this;
+  }
+
+  ~AsyncGenerator()
+  {
+    if(m_handle)
+    {
+      m_handle.destroy();
+    }
+  }
+
+  // resumes the producer until it yields the next value or returns
+  auto next() noexcept
+  {
+    struct Awaiter
+    {
+      handle_type handle;
+
+      bool await_ready() noexcept
+      {
+        return handle.done();
+      }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+      {
+        handle.promise().consumer = awaiting;
+        handle.promise().current.reset();
+        return handle;
+      }
+
+      std::optional<T> await_resume()
+      {
+        auto& promise = handle.promise();
+        if(promise.error)
+        {
+          std::rethrow_exception(std::exchange(promise.error,nullptr));
+        }
+        if(handle.done())
+        {
+          return std::nullopt;
+        }
+        return std::move(promise.current);
+      }
+    };
+    return Awaiter{m_handle};
+  }
+
+private:
+  handle_type m_handle;
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+template<typename T = void>
+class Task;
+
+namespace detail
+{
+struct TaskPromiseBase
+{
+  // resumed when the task completes, the coroutine awaiting the task
+  std::coroutine_handle<> continuation = std::noop_coroutine();
+  std::exception_ptr error;
+
+  // tasks are lazy, they start when they are awaited
+  std::suspend_always initial_suspend() noexcept
+  {
+    return {};
+  }
+
+  struct FinalAwaiter
+  {
+    bool await_ready() noexcept
+    {
+      return false;
+    }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+    {
+      return handle.promise().continuation;
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  FinalAwaiter final_suspend() noexcept
+  {
+    return {};
+  }
+
+  void unhandled_exception() noexcept
+  {
+    error = std::current_exception();
+  }
+};
+
+template<typename T>
+struct TaskPromise : TaskPromiseBase
+{
+  std::optional<T> value;
+
+  Task<T> get_return_object() noexcept;
+
+  template<typename U>
+  void return_value(U&& result)
+  {
+    value.emplace(std::forward<U>(result));
+  }
+
+  T result()
+  {
+    if(error)
+    {
+      std::rethrow_exception(error);
+    }
+    return std::move(*value);
+  }
+};
+
+template<>
+struct TaskPromise<void> : TaskPromiseBase
+{
+  Task<void> get_return_object() noexcept;
+
+  void return_void() noexcept {}
+
+  void result()
+  {
+    if(error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+};
+}
+
+// Lazily started coroutine returning T, co_await runs it and resumes the awaiting coroutine when it completes
+// Completion transfers control directly to the awaiting coroutine, so chains of tasks do not grow the stack
+template<typename T>
+class [[nodiscard]] Task
+{
+public:
+  using promise_type = detail::TaskPromise<T>;
+  using handle_type = std::coroutine_handle<promise_type>;
+
+  explicit Task(handle_type handle) noexcept:
+  m_handle(handle)
+  {
+  }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  Task(Task&& other) noexcept:
+  m_handle(std::exchange(other.m_handle,nullptr))
+  {
+  }
+
+  Task& operator=(Task&& other) noexcept
+  {
+    if(this!=&other)
+    {
+      if(m_handle)
+      {
+        m_handle.destroy();
+      }
+      m_handle = std::exchange(other.m_handle,nullptr);
+    }
+    return *this;
+  }
+
+  ~Task()
+  {
+    if(m_handle)
+    {
+      m_handle.destroy();
+    }
+  }
+
+  auto operator co_await() noexcept
+  {
+    struct Awaiter
+    {
+      handle_type handle;
+
+      bool await_ready() noexcept
+      {
+        return handle.done();
+      }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+      {
+        handle.promise().continuation = awaiting;
+        return handle;
+      }
+
+      T await_resume()
+      {
+        return handle.promise().result();
+      }
+    };
+    return Awaiter{m_handle};
+  }
+
+  [[nodiscard]] bool done() const noexcept
+  {
+    return m_handle.done();
+  }
+
+private:
+  handle_type m_handle;
+};
+
+namespace detail
+{
+template<typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept
+{
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept
+{
+  return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+}
@@ -4,55 +4,444 @@
 #include "BTreeBase.hpp"
 #include "LeafNode.hpp"
 #include "InternalNode.hpp"
+#include "Epoch.hpp"
+#include "WorkStealingPool.hpp"
 
 
 #include <memory>
 #include <variant>
 #include <type_traits>
+#include <iterator>
 
-#include <map>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+#include <thread>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
+// Comparators declaring is_transparent allow lookups with any type they can compare with the key
+template<typename Compare>
+concept TransparentCompare = requires { typename Compare::is_transparent; };
 
-template<typename KeyType, typename ValueType, size_t PageSize = PAGE_SIZE, typename Allocator = std::allocator<ValueType>>
+// Rows are ordered by Compare, a strict weak ordering of the keys
+// Leaves are PageSize bytes, internal nodes InnerPageSize bytes. Small internal nodes need fewer cache lines
+// per level of a lookup, large leaves fewer leaf hops per scan, see NodeSizes.hpp
+template<typename KeyType, typename ValueType, size_t PageSize = PAGE_SIZE, typename Allocator = std::allocator<ValueType>, typename Compare = std::less<KeyType>,
+         size_t InnerPageSize = PageSize>
 class BTree
 {
 private:
-    using nodeVariant = NodeVariant<KeyType,ValueType,PageSize,Allocator>;
+    using nodeVariant = NodeVariant<KeyType,ValueType,PageSize,Allocator,InnerPageSize>;
+    using descentPath = DescentPath<KeyType,ValueType,PageSize,Allocator,InnerPageSize>;
+    using LeafType = LeafNode<KeyType,ValueType,PageSize,Allocator,InnerPageSize>;
+    using indexType = typename LeafType::indexType;
     
 public:
+    using RowType = typename LeafType::RowType;
+    using key_compare = Compare;
+
+    // Forward iterator over all rows in key order
+    // Moving to the next leaf descends from the root with the last key of the current leaf,
+    // so iteration does not depend on sibling or parent pointers
+    // Invalidated by any insert into the BTree
+    class iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = RowType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = RowType*;
+        using reference = RowType&;
+
+        iterator() = default;
+
+        reference operator*() const
+        {
+            return m_leaf->values[m_index];
+        }
+
+        pointer operator->() const
+        {
+            return &(m_leaf->values[m_index]);
+        }
+
+        iterator& operator++()
+        {
+            if(++m_index >= m_leaf->m_size)
+            {
+                m_leaf = m_tree->nextLeaf(m_leaf->values[m_leaf->m_size-1].key);
+                m_index = 0;
+            }
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            auto ret = *this;
+            ++(*this);
+            return ret;
+        }
+
+        bool operator==(const iterator& other) const
+        {
+            return m_leaf == other.m_leaf && m_index == other.m_index;
+        }
+
+    private:
+        friend class BTree;
+        iterator(BTree* tree, LeafType* leaf, indexType index):
+        m_tree(tree),
+        m_leaf(leaf),
+        m_index(index)
+        {
+            // lowerBound may point one past the end of a leaf
+            if(m_leaf && m_index >= m_leaf->m_size)
+            {
+                m_leaf = (m_leaf->m_size==0) ? nullptr : m_tree->nextLeaf(m_leaf->values[m_leaf->m_size-1].key);
+                m_index = 0;
+            }
+        }
+
+        BTree* m_tree = nullptr;
+        LeafType* m_leaf = nullptr;
+        indexType m_index = 0;
+    };
+
     // TODO conform to allocatorAwareContainer constraints
     // https://en.cppreference.com/w/cpp/named_req/AllocatorAwareContainer
-    // TODO implement destroy
     // for now delete copy and move constructors
     // TODO replace by allocator traits construct
     BTree():
-    m_root( new LeafNode<KeyType, ValueType,PageSize,Allocator>())
+    BTree(Compare())
     {}
 
+    explicit BTree(const Compare& comp):
+    m_root( new LeafType()),
+    m_compare(comp)
+    {
+        publishRoot();
+    }
+
     BTree(const BTree&) = delete;
     BTree(BTree&&)=delete;
     BTree& operator=(const BTree&) = delete;
     BTree& operator=(BTree&&) = delete;
-    ~BTree() = default;
+    ~BTree()
+    {
+        destroy(m_root);
+    }
 
+    // throws std::out_of_range when key is already in the BTree
     ValueType& emplace(const KeyType& key, const ValueType& value)
     {
-        auto& ret =  std::visit([&](auto&& t_ptr) ->ValueType&
+        auto [it, inserted] = try_emplace(key,value);
+        if(!inserted)
         {
-            auto& leafnode = t_ptr->findLeaf(key);
-            return leafnode.emplace(key,value,m_root);
-        },m_root);
+            throw(std::out_of_range("Duplicate Key"));
+        }
+        return it->value;
+    }
+
+    // Inserts the row when key is not in the BTree yet
+    // Returns the row with key and whether it was inserted, with a single descent
+    std::pair<iterator,bool> try_emplace(const KeyType& key, const ValueType& value)
+    {
+        // appends go straight to the cached rightmost leaf without descending from the root
+        descentPath path;
+        const bool append = appends(key);
+        if(append)
+        {
+            path = m_rightmostPath;
+        }
+        auto& leafnode = append ? *m_rightmost : findLeaf(key,path);
+        const bool split = leafnode.m_size >= LeafType::maxValues;
+        // a split changes internal nodes, concurrent lookups retry until it is done
+        if(split)
+        {
+            beginWrite();
+        }
+        typename LeafType::InsertResult result;
+        try
+        {
+            result = leafnode.tryEmplace(key,value,m_root,m_compare,path);
+        }
+        catch(...)
+        {
+            if(split)
+            {
+                endWrite();
+            }
+            throw;
+        }
+        if(split)
+        {
+            endWrite();
+        }
+        if(!result.inserted)
+        {
+            return {iterator(this,result.leaf,result.index),false};
+        }
         ++ m_size;
+        if(split)
+        {
+            // the rightmost leaf may have changed, looked up again on the next insert
+            m_rightmost = nullptr;
+        }
+        return {iterator(this,result.leaf,result.index),true};
+    }
+
+    // Inserts the row or overwrites the value of the row with key, returns true when it was inserted
+    std::pair<iterator,bool> insert_or_assign(const KeyType& key, const ValueType& value)
+    {
+        auto ret = try_emplace(key,value);
+        if(!ret.second)
+        {
+            writeLeaf(*ret.first.m_leaf,[&]()
+            {
+                ret.first->value = value;
+            });
+        }
         return ret;
     }
 
+    // Calls fn with the value of the row with key, returns false when key is not in the BTree
+    template<typename Fn>
+    bool modify(const KeyType& key, Fn&& fn)
+    {
+        auto it = find(key);
+        if(it == end())
+        {
+            return false;
+        }
+        writeLeaf(*it.m_leaf,[&]()
+        {
+            std::invoke(std::forward<Fn>(fn),it->value);
+        });
+        return true;
+    }
+
+    // Lookup that may run concurrently with inserts of a single writer thread
+    // Takes no latches and writes no shared memory, the nodes it read are validated with the version
+    // of the tree and of the leaf and the lookup is retried when a concurrent insert modified them
+    // Nodes are kept alive by pinning the epoch, values changed through iterators are not protected
+    // The value is copied while a writer may change it, so it must be trivially copyable
+    std::optional<ValueType> lookup(const KeyType& key)
+    {
+        static_assert(std::is_trivially_copyable_v<ValueType>, "Optimistic lookups copy the bytes of the value");
+        auto guard = m_epochs.pin();
+        for(unsigned retries = 0; ; backoff(retries))
+        {
+            const uint32_t version = m_version.load(std::memory_order_acquire);
+            if(version & 1u)
+            {
+                continue;
+            }
+            // m_root may be assigned by the writer, readers use the copy published by endWrite
+            const nodeVariant root = decodeRoot(m_sharedRoot.load(std::memory_order_acquire));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(m_version.load(std::memory_order_relaxed)!=version)
+            {
+                continue;
+            }
+            LeafType* leaf = std::visit([&](auto&& t_ptr) ->LeafType*
+            {
+                return t_ptr->findLeafOptimistic(key,m_compare,m_version,version);
+            },root);
+            if(!leaf)
+            {
+                continue;
+            }
+            const uint32_t leafVersion = leaf->version();
+            if(leafVersion & 1u)
+            {
+                continue;
+            }
+            // the bytes are copied racing with the writer, the value is only built once the copy is validated
+            std::array<unsigned char,sizeof(ValueType)> bytes;
+            bool found = false;
+            if(!filtered || leaf->mayContain(key))
+            {
+                const auto index = leaf->lowerBound(key,m_compare);
+                if(index<leaf->m_size && !m_compare(key,leaf->values[index].key))
+                {
+                    copyOptimistic(bytes.data(),&leaf->values[index].value,sizeof(ValueType));
+                    found = true;
+                }
+            }
+            if(leaf->validate(leafVersion) && m_version.load(std::memory_order_relaxed)==version)
+            {
+                if(!found)
+                {
+                    return std::nullopt;
+                }
+                return std::bit_cast<ValueType>(bytes);
+            }
+        }
+    }
+
+    // Removes all rows, the nodes are freed when no concurrent lookup can read them anymore
+    void clear()
+    {
+        const nodeVariant oldRoot = m_root;
+        beginWrite();
+        m_root = new LeafType();
+        m_size = 0;
+        m_rightmost = nullptr;
+        endWrite();
+        m_epochs.retire([oldRoot]()
+        {
+            destroy(oldRoot);
+        });
+    }
+
+    // Removes all rows and frees the nodes right away instead of retiring them like clear
+    // Must not run concurrently with lookups
+    void reset()
+    {
+        const nodeVariant oldRoot = m_root;
+        auto root = new LeafType();
+        beginWrite();
+        m_root = root;
+        m_size = 0;
+        m_rightmost = nullptr;
+        endWrite();
+        destroy(oldRoot);
+    }
+
+    // keeps the value of the left BTree for keys in both BTrees of a merge
+    struct KeepFirst
+    {
+        const ValueType& operator()(const ValueType& lhs, [[maybe_unused]] const ValueType& rhs) const noexcept
+        {
+            return lhs;
+        }
+    };
+
+    // Moves the rows of other into this BTree, other is empty afterwards
+    // For keys in both BTrees the row of this BTree is kept
+    // Disjoint key ranges splice the root of the lower BTree into the edge of the taller one,
+    // overlapping ranges stream both BTrees into packed leaves built bottom up in O(n+m)
+    // Must not run concurrently with inserts into either BTree, lookups into both retry while the nodes are relinked
+    void merge(BTree&& other)
+    {
+        if(&other==this || other.m_size==0)
+        {
+            return;
+        }
+        if(m_size==0 || (m_compare(lastKey(),other.firstKey()) || m_compare(other.lastKey(),firstKey())))
+        {
+            if(splice(other))
+            {
+                return;
+            }
+        }
+        size_t count = 0;
+        const nodeVariant root = bulkLoad([&](auto&& emit)
+        {
+            mergeRows<true>(*this,other,emit,KeepFirst());
+        },count);
+        replaceRoot(root,count);
+        other.clear();
+    }
+
+    // BTree of the rows of lhs and rhs, for keys in both the value is resolve(lhs value, rhs value)
+    // Both BTrees are streamed in key order into packed leaves, so the union takes O(n+m)
+    template<typename Resolve = KeepFirst>
+    static BTree set_union(BTree& lhs, BTree& rhs, Resolve resolve = Resolve())
+    {
+        return BTree(lhs.m_compare,[&](auto&& emit)
+        {
+            mergeRows<true>(lhs,rhs,emit,resolve);
+        });
+    }
+
+    // BTree of the keys in both lhs and rhs with the value resolve(lhs value, rhs value)
+    template<typename Resolve = KeepFirst>
+    static BTree set_intersection(BTree& lhs, BTree& rhs, Resolve resolve = Resolve())
+    {
+        return BTree(lhs.m_compare,[&](auto&& emit)
+        {
+            mergeRows<false>(lhs,rhs,emit,resolve);
+        });
+    }
+
+    // Folds the rows on the threads of pool, the rows are split into the subtrees below the root,
+    // or below the second level when the root has too few children to keep every thread busy
+    // Every subtree starts from identity and folds its rows in key order with fn(T&, RowType&),
+    // the results of the subtrees are combined in key order with reduce(T&&, T&&) -> T
+    // Must not run concurrently with inserts
+    template<typename T, typename Fn, typename Reduce>
+    T parallel_reduce(const T& identity, Fn&& fn, Reduce&& reduce, WorkStealingPool& pool = WorkStealingPool::global())
+    {
+        return parallelReduce(nullptr,nullptr,identity,fn,reduce,pool);
+    }
+
+    // parallel_reduce over the rows with first <= key < last
+    template<typename T, typename Fn, typename Reduce>
+    T parallel_reduce(const KeyType& first, const KeyType& last, const T& identity, Fn&& fn, Reduce&& reduce,
+                      WorkStealingPool& pool = WorkStealingPool::global())
+    {
+        return parallelReduce(&first,&last,identity,fn,reduce,pool);
+    }
+
+    // Calls fn(RowType&) for every row on the threads of pool, concurrently and in no particular order
+    template<typename Fn>
+    void parallel_for_each(Fn&& fn, WorkStealingPool& pool = WorkStealingPool::global())
+    {
+        parallel_reduce(std::monostate(),[&](std::monostate&, RowType& row)
+        {
+            fn(row);
+        },[](std::monostate, std::monostate)
+        {
+            return std::monostate();
+        },pool);
+    }
+
+    // throws std::out_of_range when key is not in the BTree, misses are mostly answered by the filter of the leaf
     ValueType& at(const KeyType& key)
     {
-        return std::visit([&](auto&& t_ptr) ->ValueType&
+        auto& leafnode = findLeaf(key);
+        if(filtered && !leafnode.mayContain(key))
         {
-            auto& leafnode = t_ptr->findLeaf(key);
-            return leafnode.at(key);
-        },m_root);
+            throw(std::out_of_range("Key not in BTree"));
+        }
+        const auto index = leafnode.find(key,m_compare);
+        if(index == leafnode.m_size)
+        {
+            throw(std::out_of_range("Key not in BTree"));
+        }
+        return leafnode.values[index].value;
+    }
+
+    template<typename K> requires TransparentCompare<Compare>
+    ValueType& at(const K& key)
+    {
+        return atImpl(key);
+    }
+
+    // Existence check, the bloom filter of the leaf rejects most absent keys without searching the leaf
+    bool contains(const KeyType& key)
+    {
+        auto& leafnode = findLeaf(key);
+        if(filtered && !leafnode.mayContain(key))
+        {
+            return false;
+        }
+        return leafnode.find(key,m_compare) < leafnode.m_size;
+    }
+
+    // heterogeneous keys are not hashed like KeyType and skip the filter
+    template<typename K> requires TransparentCompare<Compare>
+    bool contains(const K& key)
+    {
+        return findImpl(key) != end();
     }
 
     std::size_t size()
@@ -60,6 +449,48 @@ public:
         return m_size;
     }
 
+    iterator begin()
+    {
+        auto& leafnode = std::visit([](auto&& t_ptr) ->LeafType&
+        {
+            return t_ptr->firstLeaf();
+        },m_root);
+        return iterator(this,&leafnode,0);
+    }
+
+    iterator end()
+    {
+        return iterator();
+    }
+
+    iterator find(const KeyType& key)
+    {
+        return findImpl(key);
+    }
+
+    template<typename K> requires TransparentCompare<Compare>
+    iterator find(const K& key)
+    {
+        return findImpl(key);
+    }
+
+    // first row with a key not ordered before key
+    iterator lower_bound(const KeyType& key)
+    {
+        return lowerBoundImpl(key);
+    }
+
+    template<typename K> requires TransparentCompare<Compare>
+    iterator lower_bound(const K& key)
+    {
+        return lowerBoundImpl(key);
+    }
+
+    [[nodiscard]] Compare key_comp() const
+    {
+        return m_compare;
+    }
+
     void print() const
     {
         std::visit([](auto&& t_ptr)->void
@@ -71,8 +502,554 @@ public:
     nodeVariant m_root;
     std::size_t m_size = 0;
 private:
-    // TODO fix for different page sizes
-    static_assert(sizeof(LeafNode<KeyType, ValueType,PageSize,Allocator>)==PageSize);
-    static_assert(sizeof(InternalNode<KeyType,ValueType,0,PageSize,Allocator>)==PageSize);
-    static_assert(sizeof(InternalNode<KeyType,ValueType,1,PageSize,Allocator>)==PageSize);
+    template<bool LowerBound = false, typename K>
+    LeafType& findLeaf(const K& key)
+    {
+        return std::visit([&](auto&& t_ptr) ->LeafType&
+        {
+            return t_ptr->template findLeaf<LowerBound>(key,m_compare);
+        },m_root);
+    }
+
+    // descent of an insert, path records the internal nodes above the leaf for its splits
+    LeafType& findLeaf(const KeyType& key, descentPath& path)
+    {
+        return std::visit([&](auto&& t_ptr) ->LeafType&
+        {
+            return t_ptr->findLeaf(key,m_compare,path);
+        },m_root);
+    }
+
+    LeafType* nextLeaf(const KeyType& key)
+    {
+        return std::visit([&](auto&& t_ptr) ->LeafType*
+        {
+            return t_ptr->nextLeaf(key,m_compare);
+        },m_root);
+    }
+
+    // first row equivalent to key
+    template<typename K>
+    iterator findImpl(const K& key)
+    {
+        auto it = lowerBoundImpl(key);
+        if(it == end() || m_compare(key,it->key))
+        {
+            return end();
+        }
+        return it;
+    }
+
+    template<typename K>
+    iterator lowerBoundImpl(const K& key)
+    {
+        auto& leafnode = findLeaf<true>(key);
+        return iterator(this,&leafnode,leafnode.lowerBound(key,m_compare));
+    }
+
+    template<typename K>
+    ValueType& atImpl(const K& key)
+    {
+        auto it = findImpl(key);
+        if(it == end())
+        {
+            throw(std::out_of_range("Key not in BTree"));
+        }
+        return it->value;
+    }
+
+    // marks a structural change for concurrent lookups, the version is odd until endWrite
+    void beginWrite() noexcept
+    {
+        m_version.store(m_version.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void endWrite() noexcept
+    {
+        publishRoot();
+        m_version.store(m_version.load(std::memory_order_relaxed)+1,std::memory_order_release);
+    }
+
+    // Root for concurrent lookups, the node pointer with the index of its variant alternative in the low bits
+    // Nodes are aligned to their page size, so the low bits of the pointer are zero
+    static constexpr uintptr_t rootIndexMask = 3;
+    static_assert(std::variant_size_v<nodeVariant> <= rootIndexMask+1);
+    static_assert(alignof(LeafType)>rootIndexMask && alignof(InternalNode<KeyType,ValueType,0,InnerPageSize,Allocator,PageSize>)>rootIndexMask);
+
+    void publishRoot() noexcept
+    {
+        const uintptr_t word = std::visit([](auto* t_ptr)
+        {
+            return reinterpret_cast<uintptr_t>(t_ptr);
+        },m_root) | m_root.index();
+        m_sharedRoot.store(word,std::memory_order_release);
+    }
+
+    template<size_t Index = 0>
+    static nodeVariant decodeRoot(uintptr_t word) noexcept
+    {
+        if constexpr(Index+1<std::variant_size_v<nodeVariant>)
+        {
+            if((word & rootIndexMask)!=Index)
+            {
+                return decodeRoot<Index+1>(word);
+            }
+        }
+        using Node = std::variant_alternative_t<Index,nodeVariant>;
+        return nodeVariant(std::in_place_index<Index>,reinterpret_cast<Node>(word & ~rootIndexMask));
+    }
+
+    // Wait of an optimistic reader that found a change in progress,
+    // spins briefly and then yields, the writer may have been descheduled in the middle of a split
+    static void backoff(unsigned& retries) noexcept
+    {
+        if(++retries<BACKOFF_SPINS)
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            _mm_pause();
+#endif
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+    static constexpr unsigned BACKOFF_SPINS = 16;
+
+    // Copies size bytes that a writer may modify concurrently with relaxed atomic loads,
+    // the caller validates the version of the node before it uses the copy
+    static void copyOptimistic(void* destination, const void* source, size_t size) noexcept
+    {
+        auto* out = static_cast<unsigned char*>(destination);
+        auto* in = static_cast<unsigned char*>(const_cast<void*>(source));
+        for(size_t i = 0; i<size; ++i)
+        {
+            out[i] = std::atomic_ref<unsigned char>(in[i]).load(std::memory_order_relaxed);
+        }
+    }
+
+    // in place update of a row, concurrent lookups retry until fn returns
+    template<typename Fn>
+    static void writeLeaf(LeafType& leaf, Fn&& fn)
+    {
+        leaf.beginWrite();
+        try
+        {
+            fn();
+        }
+        catch(...)
+        {
+            leaf.endWrite();
+            throw;
+        }
+        leaf.endWrite();
+    }
+
+    static void destroy(const nodeVariant& root)
+    {
+        std::visit([](auto&& t_ptr)
+        {
+            auto allocator = t_ptr->get_allocator();
+            using Traits = std::allocator_traits<std::remove_cvref_t<decltype(allocator)>>;
+            Traits::destroy(allocator,t_ptr);
+            Traits::deallocate(allocator,t_ptr,1);
+        },root);
+    }
+
+    // builds the BTree from the rows source passes to emit(key, value) in key order
+    template<typename Source>
+    BTree(const Compare& comp, Source&& source):
+    m_compare(comp)
+    {
+        m_root = bulkLoad(source,m_size);
+        publishRoot();
+    }
+
+    // levels of nodes below a node, 0 for a leaf
+    template<typename Node>
+    static constexpr size_t height() noexcept
+    {
+        if constexpr(std::is_same_v<Node,LeafType>)
+        {
+            return 0;
+        }
+        else
+        {
+            return traits<Node>::depth+1;
+        }
+    }
+
+    template<typename Node>
+    static Node* allocateNode()
+    {
+        typename std::allocator_traits<Allocator>::template rebind_alloc<Node> allocator;
+        using Traits = std::allocator_traits<decltype(allocator)>;
+        auto node = Traits::allocate(allocator,1);
+        Traits::construct(allocator,node);
+        return node;
+    }
+
+    const KeyType& firstKey()
+    {
+        return begin()->key;
+    }
+
+    const KeyType& lastKey()
+    {
+        auto& leaf = std::visit([](auto&& t_ptr) ->LeafType&
+        {
+            return t_ptr->lastLeaf();
+        },m_root);
+        return leaf.values[leaf.m_size-1].key;
+    }
+
+    // Streams the rows of lhs and rhs in key order to emit, rows with a key in only one of them only for a union
+    template<bool Union, typename Emit, typename Resolve>
+    static void mergeRows(BTree& lhs, BTree& rhs, Emit& emit, const Resolve& resolve)
+    {
+        const auto& comp = lhs.m_compare;
+        auto left = lhs.begin();
+        auto right = rhs.begin();
+        while(left!=lhs.end() && right!=rhs.end())
+        {
+            if(comp(left->key,right->key))
+            {
+                if constexpr(Union)
+                {
+                    emit(left->key,left->value);
+                }
+                ++left;
+            }
+            else if(comp(right->key,left->key))
+            {
+                if constexpr(Union)
+                {
+                    emit(right->key,right->value);
+                }
+                ++right;
+            }
+            else
+            {
+                emit(left->key,resolve(left->value,right->value));
+                ++left;
+                ++right;
+            }
+        }
+        if constexpr(Union)
+        {
+            for(; left!=lhs.end(); ++left)
+            {
+                emit(left->key,left->value);
+            }
+            for(; right!=rhs.end(); ++right)
+            {
+                emit(right->key,right->value);
+            }
+        }
+    }
+
+    // Fills full leaves with the rows source emits in key order and builds the internal nodes above them,
+    // count is incremented for every row
+    template<typename Source>
+    nodeVariant bulkLoad(Source&& source, size_t& count)
+    {
+        std::vector<std::pair<KeyType,LeafType*>> leaves;
+        LeafType* leaf = nullptr;
+        try
+        {
+            source([&](const KeyType& key, const ValueType& value)
+            {
+                if(!leaf || leaf->m_size==LeafType::maxValues)
+                {
+                    leaf = allocateNode<LeafType>();
+                    leaves.emplace_back(key,leaf);
+                }
+                leaf->values[leaf->m_size++] = RowType{key,value};
+                ++count;
+            });
+        }
+        catch(...)
+        {
+            for(auto& child: leaves)
+            {
+                destroy(child.second);
+            }
+            throw;
+        }
+        if(leaves.empty())
+        {
+            return allocateNode<LeafType>();
+        }
+        for(auto& child: leaves)
+        {
+            child.second->rebuildFilter();
+        }
+        return buildLevel<0>(leaves);
+    }
+
+    // Parents of children, the first key of every child is stored with it, until a single node is left as root
+    // The children are spread evenly over the parents, so every parent is at least half full
+    template<size_t Depth, typename Child>
+    static nodeVariant buildLevel(std::vector<std::pair<KeyType,Child*>>& children)
+    {
+        if(children.size()==1)
+        {
+            return children.front().second;
+        }
+        if constexpr(Depth<MaxDepth)
+        {
+            using Node = InternalNode<KeyType,ValueType,Depth,InnerPageSize,Allocator,PageSize>;
+            const size_t count = (children.size()+Node::maxValues-1)/Node::maxValues;
+            std::vector<std::pair<KeyType,Node*>> parents;
+            parents.reserve(count);
+            size_t begin = 0;
+            for(size_t i = 0; i<count; ++i)
+            {
+                const size_t end = children.size()*(i+1)/count;
+                auto node = allocateNode<Node>();
+                for(size_t child = begin; child<end; ++child)
+                {
+                    if(child>begin)
+                    {
+                        node->keys[child-begin-1] = children[child].first;
+                    }
+                    node->values[child-begin] = children[child].second;
+                }
+                node->m_size = static_cast<indexType>(end-begin);
+                parents.emplace_back(children[begin].first,node);
+                begin = end;
+            }
+            return buildLevel<Depth+1>(parents);
+        }
+        else
+        {
+            for(auto& child: children)
+            {
+                destroy(child.second);
+            }
+            throw(std::out_of_range("Maximum Tree depth exeeded"));
+        }
+    }
+
+    // Merge of BTrees with disjoint key ranges, the root of the lower BTree becomes a child of the node
+    // on the facing edge of the taller one, or both roots become the children of a new root
+    // Returns false when the taller BTree may have to grow beyond MaxDepth
+    bool splice(BTree& other)
+    {
+        if(m_size==0)
+        {
+            // other keeps the empty leaf of this BTree
+            beginWrite();
+            other.beginWrite();
+            std::swap(m_root,other.m_root);
+            other.endWrite();
+            endWrite();
+        }
+        else
+        {
+            const bool thisLeft = m_compare(lastKey(),other.firstKey());
+            BTree& left = thisLeft ? *this : other;
+            BTree& right = thisLeft ? other : *this;
+            const KeyType rightKey = right.firstKey();
+            // the nodes of other belong to this BTree afterwards, other gets an empty leaf
+            const nodeVariant emptyRoot = allocateNode<LeafType>();
+            // the edge nodes of both BTrees change, concurrent lookups into either retry until the roots are published
+            beginWrite();
+            other.beginWrite();
+            std::optional<nodeVariant> result;
+            try
+            {
+                result = std::visit([&](auto* leftRoot, auto* rightRoot) ->std::optional<nodeVariant>
+                {
+                    using Left = std::remove_pointer_t<decltype(leftRoot)>;
+                    using Right = std::remove_pointer_t<decltype(rightRoot)>;
+                    constexpr size_t leftHeight = height<Left>();
+                    constexpr size_t rightHeight = height<Right>();
+                    if constexpr(leftHeight==rightHeight && leftHeight<MaxDepth)
+                    {
+                        auto root = allocateNode<InternalNode<KeyType,ValueType,leftHeight,InnerPageSize,Allocator,PageSize>>();
+                        root->keys[0] = rightKey;
+                        root->values[0] = leftRoot;
+                        root->values[1] = rightRoot;
+                        root->m_size = 2;
+                        return nodeVariant(root);
+                    }
+                    else if constexpr(leftHeight>rightHeight && leftHeight<MaxDepth)
+                    {
+                        // appended to the node above the height of rightRoot on the right edge
+                        descentPath path;
+                        static_cast<void>(leftRoot->lastLeaf(path));
+                        using Parent = typename traits<Right>::ParentType;
+                        std::get<Parent*>(path)->emplace(rightKey,std::move(rightRoot),left.m_root,m_compare,path);
+                        return left.m_root;
+                    }
+                    else if constexpr(leftHeight<rightHeight && rightHeight<MaxDepth)
+                    {
+                        // leftRoot takes the place of the first child on the left edge, which is inserted again after it
+                        descentPath path;
+                        static_cast<void>(rightRoot->findLeaf(rightKey,m_compare,path));
+                        using Parent = typename traits<Left>::ParentType;
+                        auto parent = std::get<Parent*>(path);
+                        auto first = parent->values[0];
+                        const KeyType childKey = first->firstLeaf().values[0].key;
+                        parent->values[0] = leftRoot;
+                        parent->emplace(childKey,std::move(first),right.m_root,m_compare,path);
+                        return right.m_root;
+                    }
+                    else
+                    {
+                        return std::nullopt;
+                    }
+                },left.m_root,right.m_root);
+            }
+            catch(...)
+            {
+                other.endWrite();
+                endWrite();
+                destroy(emptyRoot);
+                throw;
+            }
+            if(!result)
+            {
+                other.endWrite();
+                endWrite();
+                destroy(emptyRoot);
+                return false;
+            }
+            m_root = *result;
+            other.m_root = emptyRoot;
+            other.endWrite();
+            endWrite();
+        }
+        m_size += other.m_size;
+        m_rightmost = nullptr;
+        other.m_size = 0;
+        other.m_rightmost = nullptr;
+        return true;
+    }
+
+    // replaces all rows, the old nodes are freed when no concurrent lookup can read them anymore
+    void replaceRoot(const nodeVariant& root, size_t size)
+    {
+        const nodeVariant oldRoot = m_root;
+        beginWrite();
+        m_root = root;
+        m_size = size;
+        m_rightmost = nullptr;
+        endWrite();
+        m_epochs.retire([oldRoot]()
+        {
+            destroy(oldRoot);
+        });
+    }
+
+    // Subtrees holding the rows with first <= key < last, split until there are at least target subtrees
+    // or the subtrees are two levels below the root
+    std::vector<nodeVariant> scanPartitions(size_t target, const KeyType* first, const KeyType* last)
+    {
+        std::vector<nodeVariant> partitions{m_root};
+        for(int level = 0; level<2 && partitions.size()<target; ++level)
+        {
+            std::vector<nodeVariant> children;
+            for(const auto& partition: partitions)
+            {
+                std::visit([&](auto&& t_ptr)
+                {
+                    using NodeType = std::remove_pointer_t<std::remove_cvref_t<decltype(t_ptr)>>;
+                    if constexpr(std::is_same_v<NodeType,LeafType>)
+                    {
+                        children.push_back(t_ptr);
+                    }
+                    else
+                    {
+                        const auto [begin, end] = t_ptr->range(first,last,m_compare);
+                        for(auto i = begin; i<end; ++i)
+                        {
+                            children.push_back(t_ptr->values[i]);
+                        }
+                    }
+                },partition);
+            }
+            partitions = std::move(children);
+        }
+        return partitions;
+    }
+
+    template<typename NodeType, typename Visit>
+    void scanNode(NodeType* node, const KeyType* first, const KeyType* last, Visit& visit)
+    {
+        const auto [begin, end] = node->range(first,last,m_compare);
+        for(auto i = begin; i<end; ++i)
+        {
+            if constexpr(std::is_same_v<NodeType,LeafType>)
+            {
+                visit(node->values[i]);
+            }
+            else
+            {
+                scanNode(&*(node->values[i]),first,last,visit);
+            }
+        }
+    }
+
+    template<typename T, typename Fn, typename Reduce>
+    T parallelReduce(const KeyType* first, const KeyType* last, const T& identity, Fn& fn, Reduce& reduce, WorkStealingPool& pool)
+    {
+        // a few subtrees per thread, so threads that finish early steal the remaining ones
+        const auto partitions = scanPartitions(4*pool.size(),first,last);
+        std::vector<std::optional<T>> results(partitions.size());
+        pool.parallelFor(partitions.size(),[&](size_t index)
+        {
+            // folded into a local, results of different subtrees may share a cache line
+            T result = identity;
+            auto visit = [&](RowType& row)
+            {
+                fn(result,row);
+            };
+            std::visit([&](auto&& t_ptr)
+            {
+                scanNode(t_ptr,first,last,visit);
+            },partitions[index]);
+            results[index] = std::move(result);
+        });
+        T ret = identity;
+        for(auto& result: results)
+        {
+            ret = reduce(std::move(ret),std::move(*result));
+        }
+        return ret;
+    }
+
+    // true when key is larger than all keys in the BTree
+    bool appends(const KeyType& key)
+    {
+        if(!m_rightmost)
+        {
+            m_rightmostPath = descentPath();
+            m_rightmost = &std::visit([&](auto&& t_ptr) ->LeafType&
+            {
+                return t_ptr->lastLeaf(m_rightmostPath);
+            },m_root);
+        }
+        return m_rightmost->m_size>0 && m_compare(m_rightmost->values[m_rightmost->m_size-1].key,key);
+    }
+
+    // The leaf filters hash keys with std::hash, which only agrees with comparators ordering by the values of the keys
+    static constexpr bool filtered = LeafType::filtered
+        && (std::is_same_v<Compare,std::less<KeyType>> || std::is_same_v<Compare,std::greater<KeyType>>
+            || std::is_same_v<Compare,std::less<>> || std::is_same_v<Compare,std::greater<>>);
+
+    LeafType* m_rightmost = nullptr;
+    descentPath m_rightmostPath;
+    [[no_unique_address]] Compare m_compare;
+    // incremented before and after changes of the internal nodes, odd while a change is in progress
+    std::atomic<uint32_t> m_version{0};
+    // m_root as of the last endWrite, see publishRoot
+    std::atomic<uintptr_t> m_sharedRoot{0};
+    EpochManager& m_epochs = EpochManager::global();
+
+    static_assert(sizeof(LeafType)==PageSize);
+    static_assert(sizeof(InternalNode<KeyType,ValueType,0,InnerPageSize,Allocator,PageSize>)==InnerPageSize);
+    static_assert(sizeof(InternalNode<KeyType,ValueType,1,InnerPageSize,Allocator,PageSize>)==InnerPageSize);
 };
\ No newline at end of file
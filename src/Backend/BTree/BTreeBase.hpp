@@ -1,28 +1,17 @@
 #pragma once
 #include <cstddef>
 #include <inttypes.h>
+#include <algorithm>
 #include <array>
+#include <cstring>
 #include <string>
+#include <type_traits>
 #include <variant>
 #include <fmt/core.h>
 #include <memory>
 
 #include "BTreeForwardDeclares.hpp"
-
-class DBException : public std::exception 
-{
-public:
-  DBException(const std::string& msg) : message(fmt::format("DB Exception {}",msg)) {}
-  virtual ~DBException() noexcept = default;
-
-  [[nodiscard]] const char* what() const noexcept override
-  {
-    return message.c_str();
-  }
-
-private:
-  std::string message;
-};
+#include "DBException.hpp"
 
 class BTreeException : public DBException 
 {
@@ -50,16 +39,17 @@ protected:
     using ParentAllocator = typename traits<Node>::ParentAllocator;
     using ParentAllocatorTraits = typename traits<Node>::ParentAllocatorTraits;
 
-  
-    using ParentPtrType = typename traits<Node>::ParentPtrType;
 
     static constexpr size_t pageSize = traits<Node>::pageSize;
+    static constexpr size_t leafPageSize = traits<Node>::leafPageSize;
+    static constexpr size_t innerPageSize = traits<Node>::innerPageSize;
     static constexpr size_t maxValues = traits<Node>::maxValues;
 
-    using LeafType = LeafNode<KeyType,ValueType,pageSize,Allocator>;
+    using LeafType = LeafNode<KeyType,ValueType,leafPageSize,Allocator,innerPageSize>;
 
 
-    using nodeVariant = NodeVariant<KeyType,ValueType,pageSize,Allocator>;
+    using nodeVariant = NodeVariant<KeyType,ValueType,leafPageSize,Allocator,innerPageSize>;
+    using descentPath = DescentPath<KeyType,ValueType,leafPageSize,Allocator,innerPageSize>;
 
     Node* derived()
     {
@@ -78,6 +68,32 @@ public:
         }
     }
 
+    // parent recorded by the descent to this node, nullptr for the root
+    [[nodiscard]] static ParentType* parent(const descentPath& path) noexcept
+    {
+        if constexpr(ParentType::value)
+        {
+            return std::get<ParentType*>(path);
+        }
+        return nullptr;
+    }
+
+    // true when the node is the last child of all its ancestors on path
+    [[nodiscard]] bool rightEdge(const descentPath& path)
+    {
+        if constexpr(ParentType::value)
+        {
+            auto parent = this->parent(path);
+            return !parent || (parent->values[parent->m_size-1]==derived() && parent->rightEdge(path));
+        }
+        return true;
+    }
+
+    [[nodiscard]] NodeAllocator& get_allocator() noexcept
+    {
+        return m_nodeAllocator;
+    }
+
 protected:
     // Page should only be inherited, and not be directly addressable
     BTreeBase() = default;
@@ -97,14 +113,29 @@ protected:
         return (maxValues+1) - rightSplitCount();
     }
 
-    [[nodiscard]] NodeAllocator& get_allocator() noexcept
+    // Split point for a node that overflows by an append at the right edge of the tree
+    // Monotonically increasing keys leave the left node full instead of half empty,
+    // an internal node keeps two children in the right node
+    [[nodiscard]] static constexpr indexType appendSplitCount() noexcept
     {
-        return m_nodeAllocator;
+        if constexpr(std::is_same_v<NodeType,LeafType>)
+        {
+            return maxValues;
+        }
+        else
+        {
+            return std::max<indexType>(maxValues-1, leftSplitCount());
+        }
     }
 
-    [[nodiscard]] uint32_t findIndex(KeyType key) 
+    // Binary search with comp, key may be of any type comp can compare with KeyType
+    // Leaves return the index of the first key not ordered before key,
+    // internal nodes the index of the child that holds key
+    // With LowerBound internal nodes return the first child that may hold keys equivalent to key,
+    // so a heterogeneous key matching a range of keys finds the start of the range
+    template<bool LowerBound = false, typename K, typename Compare>
+    [[nodiscard]] uint32_t findIndex(const K& key, const Compare& comp) 
     {
-        // Binary search
         uint32_t min_index = 0;
         uint32_t one_past_max_index = [&]()
         {
@@ -119,42 +150,88 @@ protected:
         }();
         while (one_past_max_index != min_index) {
             const uint32_t index = (min_index + one_past_max_index) / 2;
-            const KeyType key_at_index = [&]()
+            const bool right = [&]()
             {
                 if constexpr(std::is_same_v<NodeType,LeafType>)
                 {
-                    return derived()->values[index].key;
+                    return comp(derived()->values[index].key, key);
                 }
                 else
                 {
-                    return derived()->keys[index];
+                    // separator keys are the first key of the right child
+                    if constexpr(LowerBound)
+                    {
+                        return comp(derived()->keys[index], key);
+                    }
+                    else
+                    {
+                        return !comp(key, derived()->keys[index]);
+                    }
                 }
             }();
-            if (key == key_at_index) {
-                if constexpr(std::is_same_v<NodeType,LeafType>)
-                {
-                    return index;
-                }
-                else
-                {
-                    return index + 1;
-                }
-            }
-            if (key < key_at_index) {
-                one_past_max_index = index;
-            } else {
+            if (right) {
                 min_index = index + 1;
+            } else {
+                one_past_max_index = index;
             }
         }
         return min_index;
     }         
 
-    // TODO Test
-    void updateParent(const KeyType& key,PtrType rightChild,nodeVariant& root)
+    // Moves count elements to destination, ranges may not overlap
+    template<typename T>
+    static void moveElements(T* source, size_t count, T* destination)
+    {
+        if constexpr(std::is_trivially_copyable_v<T>)
+        {
+            std::memcpy(destination, source, count*sizeof(T));
+        }
+        else
+        {
+            std::move(source, source+count, destination);
+        }
+    }
+
+    // Makes room at position by shifting [position,size) one element to the right
+    template<typename T>
+    static void shiftRight(T* data, size_t position, size_t size)
+    {
+        if constexpr(std::is_trivially_copyable_v<T>)
+        {
+            std::memmove(data+position+1, data+position, (size-position)*sizeof(T));
+        }
+        else
+        {
+            std::move_backward(data+position, data+size, data+size+1);
+        }
+    }
+
+    // Inserts value at position of the full array data and splits the combined sequence,
+    // the first splitIndex elements stay in data, the remainder is moved to the start of right
+    // Returns the element holding value
+    template<typename T>
+    static T& splitInsert(T* data, size_t size, size_t position, T&& value, size_t splitIndex, T* right)
+    {
+        if(position<splitIndex)
+        {
+            moveElements(data+splitIndex-1, size-(splitIndex-1), right);
+            shiftRight(data, position, splitIndex-1);
+            data[position] = std::move(value);
+            return data[position];
+        }
+        moveElements(data+splitIndex, position-splitIndex, right);
+        right[position-splitIndex] = std::move(value);
+        moveElements(data+position, size-position, right+(position-splitIndex)+1);
+        return right[position-splitIndex];
+    }
+
+    // Inserts the new right sibling of this node into the parent on path
+    template<typename Compare>
+    void updateParent(const KeyType& key,PtrType rightChild,nodeVariant& root, const Compare& comp, const descentPath& path)
     {
         if constexpr(ParentType::value)
         {
-            rightChild->m_parent->emplace(key,std::move(rightChild),root);
+            parent(path)->emplace(key,std::move(rightChild),root,comp,path);
         }
         else
         {
@@ -171,8 +248,6 @@ protected:
 
             auto newRoot = ParentAllocatorTraits::allocate(m_parentAllocator,1);
             ParentAllocatorTraits::construct(m_parentAllocator,newRoot);
-            oldRoot->m_parent = newRoot;
-            rightChild->m_parent = newRoot;
             if constexpr(std::is_same_v<NodeType,LeafType>)
             {
                 newRoot->keys[0] = rightChild->values[0].key;
@@ -2,6 +2,7 @@
 #include <inttypes.h>
 #include <variant>
 #include <memory>
+#include <tuple>
 #include <type_traits>
 
 
@@ -10,24 +11,35 @@ inline constexpr size_t PAGE_SIZE = 4096;
 inline constexpr size_t MaxDepth = 3;
 
 //Forward declares
-template<typename KeyType, typename ValueType, size_t PageSize= PAGE_SIZE, typename Allocator = std::allocator<ValueType>>
+// PageSize is the size of the node itself, leaves and internal nodes know the size of the other kind of node
+template<typename KeyType, typename ValueType, size_t PageSize= PAGE_SIZE, typename Allocator = std::allocator<ValueType>, size_t InnerPageSize = PageSize>
 class LeafNode;
-template<typename KeyType, typename ValueType, size_t Depth, size_t PageSize= PAGE_SIZE, typename Allocator = std::allocator<ValueType>>
+template<typename KeyType, typename ValueType, size_t Depth, size_t PageSize= PAGE_SIZE, typename Allocator = std::allocator<ValueType>, size_t LeafPageSize = PageSize>
 class InternalNode ;
 template<typename T> class traits;
 
 // template specialization to indicate max depth
-template<typename KeyType,typename ValueType, size_t PageSize, typename Allocator>
-class InternalNode< KeyType,ValueType,MaxDepth,PageSize,Allocator> : public std::false_type {};
+template<typename KeyType,typename ValueType, size_t PageSize, typename Allocator, size_t LeafPageSize>
+class InternalNode< KeyType,ValueType,MaxDepth,PageSize,Allocator,LeafPageSize> : public std::false_type {};
 
 // TODO Variadic Template depending on max depth
-template<typename KeyType, typename ValueType, size_t PageSize, typename Allocator>
+template<typename KeyType, typename ValueType, size_t LeafPageSize, typename Allocator, size_t InnerPageSize = LeafPageSize>
 using NodeVariant = std::variant
 <
-LeafNode<     KeyType,ValueType,PageSize,Allocator>*,
-InternalNode< KeyType,ValueType,0,PageSize,Allocator>*,
-InternalNode< KeyType,ValueType,1,PageSize,Allocator>*,
-InternalNode< KeyType,ValueType,2,PageSize,Allocator>*
+LeafNode<     KeyType,ValueType,LeafPageSize,Allocator,InnerPageSize>*,
+InternalNode< KeyType,ValueType,0,InnerPageSize,Allocator,LeafPageSize>*,
+InternalNode< KeyType,ValueType,1,InnerPageSize,Allocator,LeafPageSize>*,
+InternalNode< KeyType,ValueType,2,InnerPageSize,Allocator,LeafPageSize>*
+>;
+
+// Internal nodes an insert descended through, indexed by depth, nullptr above the root
+// Nodes store no parent pointer, a split inserts into the parent recorded by the descent
+template<typename KeyType, typename ValueType, size_t LeafPageSize, typename Allocator, size_t InnerPageSize = LeafPageSize>
+using DescentPath = std::tuple
+<
+InternalNode< KeyType,ValueType,0,InnerPageSize,Allocator,LeafPageSize>*,
+InternalNode< KeyType,ValueType,1,InnerPageSize,Allocator,LeafPageSize>*,
+InternalNode< KeyType,ValueType,2,InnerPageSize,Allocator,LeafPageSize>*
 >;
 
 struct Empty
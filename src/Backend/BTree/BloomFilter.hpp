@@ -0,0 +1,105 @@
+#pragma once
+#include <cstddef>
+#include <inttypes.h>
+#include <array>
+#include <concepts>
+#include <cstring>
+#include <functional>
+
+template<typename KeyType>
+concept Hashable = requires(const KeyType& key)
+{
+    { std::hash<KeyType>{}(key) } -> std::convertible_to<size_t>;
+};
+
+// Register blocked Bloom filter of Words 64 bit words
+// A key sets 3 bits in a single word, so adding and testing a key touch one word only
+// Keys can not be removed, the filter is rebuilt from the remaining keys instead
+// The filter lives in packed nodes, so the words are stored as bytes and may be unaligned
+template<size_t Words>
+class BlockedBloomFilter
+{
+public:
+    static constexpr bool enabled = true;
+
+    template<typename KeyType>
+    void add(const KeyType& key) noexcept
+    {
+        const uint64_t hash = mix(std::hash<KeyType>{}(key));
+        const size_t index = word(hash);
+        store(index,load(index) | mask(hash));
+    }
+
+    // false when key was never added, true may be a false positive
+    template<typename KeyType>
+    [[nodiscard]] bool mayContain(const KeyType& key) const noexcept
+    {
+        const uint64_t hash = mix(std::hash<KeyType>{}(key));
+        const uint64_t bits = mask(hash);
+        return (load(word(hash)) & bits) == bits;
+    }
+
+    void clear() noexcept
+    {
+        m_words = {};
+    }
+
+private:
+    [[nodiscard]] uint64_t load(size_t index) const noexcept
+    {
+        uint64_t ret;
+        std::memcpy(&ret,m_words.data()+index*sizeof(uint64_t),sizeof(ret));
+        return ret;
+    }
+
+    void store(size_t index, uint64_t value) noexcept
+    {
+        std::memcpy(m_words.data()+index*sizeof(uint64_t),&value,sizeof(value));
+    }
+
+    // finalizer of murmur3, std::hash of integers is the identity
+    static constexpr uint64_t mix(uint64_t hash) noexcept
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static constexpr size_t word(uint64_t hash) noexcept
+    {
+        return static_cast<size_t>(((hash >> 32) * Words) >> 32);
+    }
+
+    static constexpr uint64_t mask(uint64_t hash) noexcept
+    {
+        return (uint64_t{1} << (hash & 63)) | (uint64_t{1} << ((hash >> 6) & 63)) | (uint64_t{1} << ((hash >> 12) & 63));
+    }
+
+    std::array<uint8_t,Words*sizeof(uint64_t)> m_words{};
+};
+
+// no room for a filter, every key may be contained
+template<>
+class BlockedBloomFilter<0>
+{
+public:
+    static constexpr bool enabled = false;
+
+    template<typename KeyType>
+    void add([[maybe_unused]] const KeyType& key) noexcept
+    {
+    }
+
+    template<typename KeyType>
+    [[nodiscard]] bool mayContain([[maybe_unused]] const KeyType& key) const noexcept
+    {
+        return true;
+    }
+
+    void clear() noexcept
+    {
+    }
+};
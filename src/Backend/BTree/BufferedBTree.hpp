@@ -0,0 +1,281 @@
+#pragma once
+
+#include "BTree.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+
+// Rows buffered in front of the main BTree by default, the buffer stays cache resident
+inline constexpr size_t DEFAULT_WRITE_BUFFER_BYTES = 1 << 20;
+
+// BTree with a write buffer in front of it, like the memtable of an LSM tree
+// Inserts go to a small BTree that fits into the cache, so random keys shift and split small nodes only.
+// When the buffer is full it is swapped with a second, empty buffer and its rows are moved into the main BTree
+// in key order, a few rows with every later insert, so consecutive rows land in the same or neighbouring leaves
+// and no insert stalls for the whole buffer. Inserts do not read the main BTree, try_emplace only rejects keys
+// that are buffered, a row of try_emplace whose key is in the main BTree is dropped when it is moved.
+// Lookups, contains and size read the buffers and the main BTree without moving rows, iteration moves all rows first
+// Not thread safe, a single thread inserts and reads like with BTree::emplace
+template<typename KeyType, typename ValueType, size_t PageSize = PAGE_SIZE, typename Allocator = std::allocator<ValueType>,
+         typename Compare = std::less<KeyType>, size_t BufferPageSize = std::min<size_t>(PageSize,4096)>
+class BufferedBTree
+{
+    struct Entry
+    {
+        ValueType value;
+        // rows of assign replace the row of the main BTree, rows of try_emplace give way to it
+        bool overwrite;
+    };
+
+public:
+    using TreeType = BTree<KeyType,ValueType,PageSize,Allocator,Compare>;
+    // small nodes, a random insert into the buffer moves few rows
+    using BufferType = BTree<KeyType,Entry,BufferPageSize,typename std::allocator_traits<Allocator>::template rebind_alloc<Entry>,Compare>;
+    using RowType = typename TreeType::RowType;
+    using iterator = typename TreeType::iterator;
+    using key_compare = Compare;
+    // rows moved from the full buffer into the main BTree per insert, the buffer is empty before the next one is full
+    static constexpr size_t DRAIN_ROWS = 2;
+
+    explicit BufferedBTree(size_t bufferRows = std::max<size_t>(1,DEFAULT_WRITE_BUFFER_BYTES/sizeof(RowType)),
+                           const Compare& comp = Compare()):
+    m_tree(comp),
+    m_first(comp),
+    m_second(comp),
+    m_compare(comp),
+    m_bufferRows(bufferRows)
+    {
+        if(bufferRows == 0)
+        {
+            throw std::invalid_argument("BufferedBTree needs a buffer of at least one row");
+        }
+    }
+
+    // delete copy and move constructors, like BTree
+    BufferedBTree(const BufferedBTree&) = delete;
+    BufferedBTree(BufferedBTree&&) = delete;
+    BufferedBTree& operator=(const BufferedBTree&) = delete;
+    BufferedBTree& operator=(BufferedBTree&&) = delete;
+    ~BufferedBTree() = default;
+
+    // throws std::out_of_range when key is already buffered
+    void emplace(const KeyType& key, const ValueType& value)
+    {
+        if(!try_emplace(key,value))
+        {
+            throw(std::out_of_range("Duplicate Key"));
+        }
+    }
+
+    // Buffers the row when key is not buffered yet, returns whether it was buffered
+    // The main BTree is not read, when it has a row with key the buffered row is dropped as it is moved
+    // and counted by duplicates. Until then lookups return the row of the main BTree
+    bool try_emplace(const KeyType& key, const ValueType& value)
+    {
+        if(m_active->contains(key) || pending(key))
+        {
+            return false;
+        }
+        insert(key,Entry{value,false});
+        return true;
+    }
+
+    // Inserts the row or overwrites the value of the row with key without reading the main BTree,
+    // the buffered row replaces the row of the main BTree when it is moved
+    void assign(const KeyType& key, const ValueType& value)
+    {
+        insert(key,Entry{value,true});
+    }
+
+    [[nodiscard]] std::optional<ValueType> lookup(const KeyType& key)
+    {
+        if(const auto* value = find(key))
+        {
+            return *value;
+        }
+        return std::nullopt;
+    }
+
+    [[nodiscard]] bool contains(const KeyType& key)
+    {
+        return find(key)!=nullptr;
+    }
+
+    // throws std::out_of_range when key is not in the BTree
+    ValueType& at(const KeyType& key)
+    {
+        auto* value = find(key);
+        if(!value)
+        {
+            throw(std::out_of_range("Key not in BTree"));
+        }
+        return *value;
+    }
+
+    // Value of the row with key or nullptr, valid until the next insert
+    // The buffers are read newest first, a row of try_emplace gives way to an older row with the same key
+    ValueType* find(const KeyType& key)
+    {
+        ValueType* inserted = nullptr;
+        for(BufferType* buffer: {m_active,m_draining})
+        {
+            if(buffer==m_draining && moved(key))
+            {
+                continue;
+            }
+            auto it = buffer->find(key);
+            if(it!=buffer->end())
+            {
+                if(it->value.overwrite)
+                {
+                    return &it->value.value;
+                }
+                inserted = &it->value.value;
+            }
+        }
+        auto it = m_tree.find(key);
+        return it!=m_tree.end() ? &it->value : inserted;
+    }
+
+    // Moves all buffered rows into the main BTree
+    void mergeBuffer()
+    {
+        if(m_active->size()!=0)
+        {
+            swapBuffers();
+        }
+        drain(std::numeric_limits<size_t>::max());
+    }
+
+    // rows of the main BTree and the buffers, every buffered row probes the main BTree once
+    [[nodiscard]] std::size_t size()
+    {
+        size_t ret = m_tree.size();
+        for(auto& row: *m_active)
+        {
+            ret += !pending(row.key) && !m_tree.contains(row.key);
+        }
+        for(auto it = m_drain; it!=m_draining->end(); ++it)
+        {
+            ret += !m_tree.contains(it->key);
+        }
+        return ret;
+    }
+
+    // rows waiting in the buffers
+    [[nodiscard]] std::size_t buffered()
+    {
+        return m_active->size()+m_draining->size()-m_moved;
+    }
+
+    // buffers that were filled and moved into the main BTree
+    [[nodiscard]] std::size_t merges() const noexcept
+    {
+        return m_merges;
+    }
+
+    // rows of try_emplace dropped because the main BTree had their key
+    [[nodiscard]] std::size_t duplicates() const noexcept
+    {
+        return m_duplicates;
+    }
+
+    iterator begin()
+    {
+        mergeBuffer();
+        return m_tree.begin();
+    }
+
+    iterator end()
+    {
+        return m_tree.end();
+    }
+
+    iterator lower_bound(const KeyType& key)
+    {
+        mergeBuffer();
+        return m_tree.lower_bound(key);
+    }
+
+    // the main BTree, buffered rows are not in it before mergeBuffer
+    [[nodiscard]] TreeType& tree() noexcept
+    {
+        return m_tree;
+    }
+
+private:
+    using BufferIterator = typename BufferType::iterator;
+
+    void insert(const KeyType& key, const Entry& entry)
+    {
+        m_active->insert_or_assign(key,entry);
+        drain(DRAIN_ROWS);
+        if(m_active->size()>=m_bufferRows)
+        {
+            swapBuffers();
+        }
+    }
+
+    // the full buffer starts draining, the previous one is empty unless inserts were outpaced by overwrites
+    void swapBuffers()
+    {
+        drain(std::numeric_limits<size_t>::max());
+        std::swap(m_active,m_draining);
+        m_drain = m_draining->begin();
+        m_moved = 0;
+        ++m_merges;
+    }
+
+    // moves up to rows rows of the draining buffer into the main BTree in key order
+    void drain(size_t rows)
+    {
+        for(size_t i = 0; i<rows && m_drain!=m_draining->end(); ++i, ++m_drain, ++m_moved)
+        {
+            const auto& row = *m_drain;
+            if(row.value.overwrite)
+            {
+                m_tree.insert_or_assign(row.key,row.value.value);
+            }
+            else if(!m_tree.try_emplace(row.key,row.value.value).second)
+            {
+                ++m_duplicates;
+            }
+        }
+        if(m_drain==m_draining->end() && m_draining->size()!=0)
+        {
+            // no lookup reads the buffer concurrently, its nodes are freed without retiring them
+            m_draining->reset();
+            m_drain = m_draining->end();
+            m_moved = 0;
+        }
+    }
+
+    // the row with key of the draining buffer is in the main BTree already, or there is none
+    [[nodiscard]] bool moved(const KeyType& key)
+    {
+        return m_drain==m_draining->end() || m_compare(key,m_drain->key);
+    }
+
+    // key is in the draining buffer and not moved yet
+    [[nodiscard]] bool pending(const KeyType& key)
+    {
+        return !moved(key) && m_draining->contains(key);
+    }
+
+    TreeType m_tree;
+    BufferType m_first;
+    BufferType m_second;
+    // inserts go to the active buffer, the draining one is moved into m_tree from m_drain on
+    BufferType* m_active = &m_first;
+    BufferType* m_draining = &m_second;
+    BufferIterator m_drain;
+    Compare m_compare;
+    size_t m_bufferRows;
+    // rows of the draining buffer before m_drain
+    size_t m_moved = 0;
+    size_t m_merges = 0;
+    size_t m_duplicates = 0;
+};
@@ -6,7 +6,9 @@
 #include <bit>
 #include <variant>
 #include <span>
+#include <atomic>
 #include <memory>
+#include <utility>
 
 #include "Row.hpp"
 #include "BTreeBase.hpp"
@@ -14,8 +16,8 @@
 
 
 
-template<typename KeyType, typename ValueType, size_t Depth,size_t PageSize, typename Allocator>
-class traits<InternalNode<KeyType,ValueType,Depth,PageSize,Allocator>>
+template<typename KeyType, typename ValueType, size_t Depth,size_t PageSize, typename Allocator, size_t LeafPageSize>
+class traits<InternalNode<KeyType,ValueType,Depth,PageSize,Allocator,LeafPageSize>>
 {
 public:
     using indexType = uint32_t;
@@ -24,8 +26,8 @@ public:
     using valueType = ValueType;
     using allocator = Allocator;
 
-    using type = InternalNode<KeyType,ValueType,Depth,PageSize,Allocator>;
-    using ParentType = InternalNode<KeyType,ValueType,Depth+1,PageSize,Allocator>;
+    using type = InternalNode<KeyType,ValueType,Depth,PageSize,Allocator,LeafPageSize>;
+    using ParentType = InternalNode<KeyType,ValueType,Depth+1,PageSize,Allocator,LeafPageSize>;
     
 
     using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<type>;
@@ -33,38 +35,36 @@ public:
 
     using PtrType = typename NodeAllocatorTraits::pointer;
 
-    using ParentAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<InternalNode<KeyType,ValueType,Depth+1,PageSize,Allocator>>;
-    using ParentAllocatorTraits = typename std::allocator_traits<Allocator>::template rebind_traits<InternalNode<KeyType,ValueType,Depth+1,PageSize,Allocator>>;
-
-    using ParentPtrType = typename ParentAllocatorTraits::pointer;
+    using ParentAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<InternalNode<KeyType,ValueType,Depth+1,PageSize,Allocator,LeafPageSize>>;
+    using ParentAllocatorTraits = typename std::allocator_traits<Allocator>::template rebind_traits<InternalNode<KeyType,ValueType,Depth+1,PageSize,Allocator,LeafPageSize>>;
 
     
     static constexpr size_t depth = Depth;
     static constexpr size_t pageSize = PageSize;
+    static constexpr size_t leafPageSize = LeafPageSize;
+    static constexpr size_t innerPageSize = PageSize;
     static constexpr size_t maxValues = type::maxValues;
 };
 
 
 #pragma pack(1)
-template<typename KeyType, typename ValueType, size_t Depth, size_t PageSize, typename Allocator>
-class alignas(PageSize) InternalNode: public BTreeBase<InternalNode<KeyType,ValueType,Depth,PageSize,Allocator>>, public std::true_type
+template<typename KeyType, typename ValueType, size_t Depth, size_t PageSize, typename Allocator, size_t LeafPageSize>
+class alignas(PageSize) InternalNode: public BTreeBase<InternalNode<KeyType,ValueType,Depth,PageSize,Allocator,LeafPageSize>>, public std::true_type
 {
 public:
     using indexType = uint32_t;
 
-    using type = InternalNode<KeyType,ValueType,Depth,PageSize,Allocator>;
-    using LeafType = LeafNode<KeyType,ValueType,PageSize,Allocator>;
-    using ChildType = std::conditional_t<(Depth<1),LeafType,InternalNode<KeyType,ValueType,Depth-1,PageSize,Allocator>>;
+    using type = InternalNode<KeyType,ValueType,Depth,PageSize,Allocator,LeafPageSize>;
+    using LeafType = LeafNode<KeyType,ValueType,LeafPageSize,Allocator,PageSize>;
+    using ChildType = std::conditional_t<(Depth<1),LeafType,InternalNode<KeyType,ValueType,Depth-1,PageSize,Allocator,LeafPageSize>>;
 
     using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<type>;
     using NodeAllocatorTraits = typename std::allocator_traits<Allocator>::template rebind_traits<type>;
 
     using PtrType = typename NodeAllocatorTraits::pointer;
 
-    using ParentAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<InternalNode<KeyType,ValueType,Depth+1,PageSize,Allocator>>;
-    using ParentAllocatorTraits = typename std::allocator_traits<Allocator>::template rebind_traits<InternalNode<KeyType,ValueType,Depth+1,PageSize,Allocator>>;
-
-    using ParentPtrType = typename ParentAllocatorTraits::pointer;
+    using ParentAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<InternalNode<KeyType,ValueType,Depth+1,PageSize,Allocator,LeafPageSize>>;
+    using ParentAllocatorTraits = typename std::allocator_traits<Allocator>::template rebind_traits<InternalNode<KeyType,ValueType,Depth+1,PageSize,Allocator,LeafPageSize>>;
 
     using ChildAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<ChildType>;
     using ChildAllocatorTraits = typename std::allocator_traits<Allocator>::template rebind_traits<ChildType>;
@@ -72,7 +72,7 @@ public:
     using ChildPtrType = typename ChildAllocatorTraits::pointer;
     
 
-    using Base = BTreeBase<InternalNode<KeyType,ValueType,Depth,PageSize,Allocator>>;
+    using Base = BTreeBase<InternalNode<KeyType,ValueType,Depth,PageSize,Allocator,LeafPageSize>>;
 
     struct ChildNode
     {
@@ -81,10 +81,10 @@ public:
     };
 
     static constexpr size_t pageSize = PageSize;
-    static_assert(pageSize>(sizeof(indexType)+ sizeof(ParentPtrType)), "PageSize too small");
-    static constexpr size_t maxValues = (pageSize- sizeof(indexType)- sizeof(ParentPtrType))/(sizeof(KeyType)+sizeof(ChildPtrType));
+    static_assert(pageSize>sizeof(indexType), "PageSize too small");
+    static constexpr size_t maxValues = (pageSize- sizeof(indexType))/(sizeof(KeyType)+sizeof(ChildPtrType));
     static constexpr size_t maxKeys = maxValues-1;
-    static constexpr size_t filler   = pageSize- sizeof(indexType) -sizeof(ParentPtrType) - sizeof(std::array<KeyType,maxKeys>) - sizeof(std::array<ChildPtrType,maxValues>);
+    static constexpr size_t filler   = pageSize- sizeof(indexType) - sizeof(std::array<KeyType,maxKeys>) - sizeof(std::array<ChildPtrType,maxValues>);
 
 public:
     InternalNode() = default;
@@ -105,34 +105,22 @@ public:
     }
 
 
-    ChildType& emplace(const KeyType& key, ChildPtrType&& child,typename Base::nodeVariant& root)
+    template<typename Compare>
+    ChildType& emplace(const KeyType& key, ChildPtrType&& child,typename Base::nodeVariant& root, const Compare& comp,
+                       const typename Base::descentPath& path)
     {
       const indexType num_cells = m_size;
       const indexType num_keys = num_cells-1;
-      auto keyIndex = this->findIndex(key);
+      auto keyIndex = this->findIndex(key,comp);
       auto valueIndex = keyIndex+1;
       if (num_cells >= maxValues) 
       {
           // Node full
-          return internal_node_split_and_insert(key, std::move(child),valueIndex,root);
-      }
-      // findIndex cell
-      if (valueIndex < num_cells) 
-      {
-        // Make room for new cell
-        for (indexType i = num_cells; i > valueIndex; i--) 
-        {
-            values[i] = std::move(values[i-1]);
-        }
-      }
-      if (keyIndex < num_keys) 
-      {
-        // Make room for new cell
-        for (indexType i = num_keys; i > keyIndex; i--) 
-        {
-            keys[i] = std::move(keys[i-1]);
-        }
+          return internal_node_split_and_insert(key, std::move(child),valueIndex,root,comp,path);
       }
+      // Make room for new cell
+      Base::shiftRight(values.data(), valueIndex, num_cells);
+      Base::shiftRight(keys.data(), keyIndex, num_keys);
       m_size +=1;
       keys[keyIndex] = key;
       values[valueIndex] = std::move(child);
@@ -140,11 +128,13 @@ public:
       
     }
 
-    ChildType& internal_node_split_and_insert(const KeyType& key,  ChildPtrType&& value,indexType cellnum, typename Base::nodeVariant& root) 
+    template<typename Compare>
+    ChildType& internal_node_split_and_insert(const KeyType& key,  ChildPtrType&& child,indexType cellnum, typename Base::nodeVariant& root, const Compare& comp,
+                                              const typename Base::descentPath& path) 
     {
         /*
         Create a new node and move half the cells over.
-        Update children
+        The moved children are not written, they do not point back to their parent.
         Insert the new value in one of the two nodes.
         Update parent or create a new parent.
         */
@@ -155,83 +145,120 @@ public:
         /*
         All existing keys plus new key should be divided
         evenly between old (left) and new (right) nodes.
-        Starting from the right, move each key to correct position.
+        Key i of the combined node separates value i and i+1,
+        key splitCount-1 is the separator that moves up and is kept at the end of the left node
         */
-        ChildType* ret;
-        // TODO split loop in two for keys and values for better data locality?
-        for (int32_t i = maxValues; i >= 0; i--) {
-            PtrType destination_node = [&]()
-            {
-            if (static_cast<indexType>(i) >= Base::leftSplitCount()) 
-            {
-                return newInternalNode;
-            } 
-            else 
-            {
-                return this;
-            }
-            }();
-            
-            indexType index_within_node = static_cast<indexType>(i) % Base::leftSplitCount();
-            ChildPtrType& destinationValue = destination_node->values[index_within_node];
-            KeyType& destinationKey = destination_node->keys[index_within_node];
-            //auto& destinationValueParent = ;
-
-            if (static_cast<indexType>(i) == cellnum) 
-            {
-                destinationValue = std::move(value);
-                destination_node->keys[index_within_node-1] = std::move(key);
-                ret=destinationValue;
-            } 
-            else if (static_cast<indexType>(i) > cellnum) 
-            {
-                destinationValue = std::move(values[static_cast<indexType>(i-1)]);
-                destinationKey = std::move(keys[static_cast<indexType>(i-1)]);
-            } 
-            else 
-            {
-                destinationValue = std::move(values[static_cast<indexType>(i)]);
-                // TODO for i==maxValue index falls out of range of keys
-                if(i<maxKeys)
-                {
-                    destinationKey = std::move(keys[static_cast<indexType>(i)]);
-                }
-            }
-
-            if (static_cast<indexType>(i) >= Base::leftSplitCount()) 
-            {
-                destinationValue->m_parent = newInternalNode;
-            }
-        }
-        /* Update cell count on both leaf nodes */
-        m_size = Base::leftSplitCount();
-        newInternalNode->m_size = Base::rightSplitCount();
+        const indexType splitCount = (cellnum==maxValues && this->rightEdge(path)) ? Base::appendSplitCount() : Base::leftSplitCount();
+        Base::splitInsert(keys.data(), maxKeys, cellnum-1, KeyType{key}, splitCount, newInternalNode->keys.data());
+        ChildType* ret = Base::splitInsert(values.data(), maxValues, cellnum, std::move(child), splitCount, newInternalNode->values.data());
+        /* Update cell count on both nodes */
+        m_size = splitCount;
+        newInternalNode->m_size = maxValues+1-splitCount;
         
-        if(m_parent)
+        if(Base::parent(path))
         {
-            newInternalNode->m_parent = m_parent;
-            this->updateParent(keys[--m_size],std::move(newInternalNode),root);
+            this->updateParent(keys[m_size-1],std::move(newInternalNode),root,comp,path);
         }
         else
         {
-            // current node is root since parent == nullptr
+            // current node is root since the descent started here
             this->makeNewRoot(root, std::move(newInternalNode));
         }
 
         return *ret;
     }
 
-    LeafType& findLeaf(const KeyType& key)
+    template<bool LowerBound = false, typename K, typename Compare>
+    LeafType& findLeaf(const K& key, const Compare& comp)
     {
-      auto index = this->findIndex(key);
+      auto index = this->template findIndex<LowerBound>(key,comp);
       
       if constexpr(std::is_same_v<LeafType, ChildType>)
       {
         return *(values[static_cast<indexType>(index)]);
       }
-      return values[static_cast<indexType>(index)]->findLeaf(key);
+      return values[static_cast<indexType>(index)]->template findLeaf<LowerBound>(key,comp);
     } 
 
+    // findLeaf recording the nodes it passes in path
+    template<typename Compare>
+    LeafType& findLeaf(const KeyType& key, const Compare& comp, typename Base::descentPath& path)
+    {
+      std::get<type*>(path) = this;
+      return values[static_cast<indexType>(this->findIndex(key,comp))]->findLeaf(key,comp,path);
+    }
+
+    // Descent of a reader that does not hold any latch, the child pointer is only followed
+    // when the tree version is still the one the reader started with, nullptr otherwise
+    template<typename K, typename Compare>
+    LeafType* findLeafOptimistic(const K& key, const Compare& comp, const std::atomic<uint32_t>& treeVersion, uint32_t version)
+    {
+      auto child = values[static_cast<indexType>(this->findIndex(key,comp))];
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(treeVersion.load(std::memory_order_relaxed)!=version)
+      {
+        return nullptr;
+      }
+      if constexpr(std::is_same_v<LeafType, ChildType>)
+      {
+        return child;
+      }
+      else
+      {
+        return child->findLeafOptimistic(key,comp,treeVersion,version);
+      }
+    }
+
+    LeafType& firstLeaf()
+    {
+      if constexpr(std::is_same_v<LeafType, ChildType>)
+      {
+        return *(values[0]);
+      }
+      return values[0]->firstLeaf();
+    }
+
+    LeafType& lastLeaf()
+    {
+      if constexpr(std::is_same_v<LeafType, ChildType>)
+      {
+        return *(values[m_size-1]);
+      }
+      return values[m_size-1]->lastLeaf();
+    }
+
+    LeafType& lastLeaf(typename Base::descentPath& path)
+    {
+      std::get<type*>(path) = this;
+      return values[m_size-1]->lastLeaf(path);
+    }
+
+    // Leaf following the leaf that holds key, nullptr if that leaf is the rightmost one of this subtree
+    template<typename K, typename Compare>
+    LeafType* nextLeaf(const K& key, const Compare& comp)
+    {
+      auto index = this->findIndex(key,comp);
+      LeafType* next = nullptr;
+      if constexpr(!std::is_same_v<LeafType, ChildType>)
+      {
+        next = values[static_cast<indexType>(index)]->nextLeaf(key,comp);
+      }
+      if(!next && index+1<m_size)
+      {
+        next = &(values[static_cast<indexType>(index+1)]->firstLeaf());
+      }
+      return next;
+    }
+
+    // Indices [begin,end) of the children that may hold keys with first <= key < last, a null bound is unbounded
+    template<typename Compare>
+    [[nodiscard]] std::pair<indexType,indexType> range(const KeyType* first, const KeyType* last, const Compare& comp)
+    {
+      const indexType begin = first ? static_cast<indexType>(this->findIndex(*first,comp)) : 0;
+      const indexType end = last ? static_cast<indexType>(this->findIndex(*last,comp)+1) : m_size;
+      return {begin,std::max(begin,end)};
+    }
+
 
     void print(uint32_t indentation_level = 0) const
     {
@@ -249,7 +276,6 @@ public:
     }
 
     indexType m_size = 0;
-    ParentPtrType m_parent = nullptr;
     std::array<KeyType,maxKeys> keys;
     std::array<ChildPtrType,maxValues> values;
 
@@ -5,14 +5,17 @@
 #include <bit>
 #include <variant>
 #include <span>
+#include <atomic>
 #include <memory>
+#include <utility>
 #include <fmt/ranges.h>
 
 #include "Row.hpp"
 #include "BTreeBase.hpp"
+#include "BloomFilter.hpp"
 
-template<typename KeyType, typename ValueType,size_t PageSize,typename Allocator>
-class traits<LeafNode<KeyType, ValueType, PageSize,Allocator>>
+template<typename KeyType, typename ValueType,size_t PageSize,typename Allocator, size_t InnerPageSize>
+class traits<LeafNode<KeyType,ValueType,PageSize,Allocator,InnerPageSize>>
 {
 public:
     using indexType = uint32_t;
@@ -21,8 +24,8 @@ public:
     using valueType = ValueType;
     using allocator = Allocator;
 
-    using type = LeafNode<KeyType, ValueType, PageSize,Allocator>;
-    using ParentType = InternalNode<KeyType,ValueType,0,PageSize,Allocator>;
+    using type = LeafNode<KeyType,ValueType,PageSize,Allocator,InnerPageSize>;
+    using ParentType = InternalNode<KeyType,ValueType,0,InnerPageSize,Allocator,PageSize>;
 
 
     using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<type>;
@@ -32,16 +35,17 @@ public:
     using ParentAllocatorTraits = typename std::allocator_traits<Allocator>::template rebind_traits<ParentType>;
 
     using PtrType = typename NodeAllocatorTraits::pointer;
-    using ParentPtrType = typename ParentAllocatorTraits::pointer;
 
     static constexpr size_t pageSize = PageSize;
+    static constexpr size_t leafPageSize = PageSize;
+    static constexpr size_t innerPageSize = InnerPageSize;
     static constexpr size_t maxValues = type::maxValues;
 };
 
 //TODO instead of pack(1) calculate alignment between header and array
 #pragma pack(1)
-template<typename KeyType, typename ValueType, size_t PageSize,typename Allocator>
-class alignas(PageSize) LeafNode: public BTreeBase<LeafNode<KeyType, ValueType,PageSize, Allocator>>
+template<typename KeyType, typename ValueType, size_t PageSize,typename Allocator, size_t InnerPageSize>
+class alignas(PageSize) LeafNode: public BTreeBase<LeafNode<KeyType,ValueType,PageSize,Allocator,InnerPageSize>>
 {
 public:
     
@@ -49,10 +53,10 @@ public:
     using indexType = uint32_t;
     using RowType = Row<KeyType,ValueType>; 
 
-    using type = LeafNode<KeyType, ValueType,PageSize, Allocator>;
-    using Base = BTreeBase<LeafNode<KeyType, ValueType, PageSize,Allocator>>;
-    using LeafType = LeafNode<KeyType,ValueType,PageSize,Allocator>;
-    using ParentType = InternalNode<KeyType,ValueType,0,PageSize,Allocator>;
+    using type = LeafNode<KeyType,ValueType,PageSize,Allocator,InnerPageSize>;
+    using Base = BTreeBase<LeafNode<KeyType,ValueType,PageSize,Allocator,InnerPageSize>>;
+    using LeafType = LeafNode<KeyType,ValueType,PageSize,Allocator,InnerPageSize>;
+    using ParentType = InternalNode<KeyType,ValueType,0,InnerPageSize,Allocator,PageSize>;
     
 
     using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<type>;
@@ -63,13 +67,15 @@ public:
     using ParentAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<ParentType>;
     using ParentAllocatorTraits = typename std::allocator_traits<Allocator>::template rebind_traits<ParentType>;
 
-    using ParentPtrType = typename ParentAllocatorTraits::pointer;
-
-
     static constexpr size_t pageSize = PageSize;
-    static_assert(pageSize>(sizeof(indexType)+ sizeof(ParentPtrType)), "PageSize too small");
-    static constexpr size_t maxValues = (pageSize- sizeof(indexType)- sizeof(ParentPtrType))/sizeof(RowType);
-    static constexpr size_t filler   = pageSize- sizeof(indexType)- sizeof(ParentPtrType) - sizeof(std::array<RowType,maxValues>);
+    static constexpr size_t headerSize = sizeof(uint32_t)+sizeof(indexType);
+    static_assert(pageSize>headerSize, "PageSize too small");
+    static constexpr size_t maxValues = (pageSize- headerSize)/sizeof(RowType);
+    static constexpr size_t filler   = pageSize- headerSize - sizeof(std::array<RowType,maxValues>);
+    // the filler at the end of the page holds a bloom filter of the keys of the leaf
+    static constexpr size_t filterWords = Hashable<KeyType> ? filler/sizeof(uint64_t) : 0;
+    static constexpr size_t padding = filler - filterWords*sizeof(uint64_t);
+    static constexpr bool filtered = BlockedBloomFilter<filterWords>::enabled;
 public:
     LeafNode()=default;
     LeafNode(const LeafNode&) = delete;
@@ -88,52 +94,133 @@ public:
     //     return maxCells;
     // }
 
-    ValueType& at(const KeyType& key)
+    template<bool LowerBound = false, typename K, typename Compare>
+    LeafType& findLeaf([[maybe_unused]] const K& key, [[maybe_unused]] const Compare& comp)
+    {
+        return *this;
+    }
+
+    template<typename Compare>
+    LeafType& findLeaf([[maybe_unused]] const KeyType& key, [[maybe_unused]] const Compare& comp, [[maybe_unused]] typename Base::descentPath& path)
+    {
+        return *this;
+    }
+
+    template<typename K, typename Compare>
+    LeafType* findLeafOptimistic([[maybe_unused]] const K& key, [[maybe_unused]] const Compare& comp,
+        [[maybe_unused]] const std::atomic<uint32_t>& treeVersion, [[maybe_unused]] uint32_t version)
+    {
+        return this;
+    }
+
+    LeafType& firstLeaf()
+    {
+        return *this;
+    }
+
+    LeafType& lastLeaf()
+    {
+        return *this;
+    }
+
+    LeafType& lastLeaf([[maybe_unused]] typename Base::descentPath& path)
     {
-        auto& row = values[this->findIndex(key)];
-        if(row.key!=key)
+        return *this;
+    }
+
+    // the leaf following the one holding key, resolved by the parent
+    template<typename K, typename Compare>
+    LeafType* nextLeaf([[maybe_unused]] const K& key, [[maybe_unused]] const Compare& comp)
+    {
+        return nullptr;
+    }
+
+    // index of the first row with a key not smaller than key, m_size if there is none
+    template<typename K, typename Compare>
+    [[nodiscard]] indexType lowerBound(const K& key, const Compare& comp)
+    {
+        return this->findIndex(key,comp);
+    }
+
+    // Indices [begin,end) of the rows with first <= key < last, a null bound is unbounded
+    template<typename Compare>
+    [[nodiscard]] std::pair<indexType,indexType> range(const KeyType* first, const KeyType* last, const Compare& comp)
+    {
+        const indexType begin = first ? lowerBound(*first,comp) : 0;
+        const indexType end = last ? lowerBound(*last,comp) : m_size;
+        return {begin,std::max(begin,end)};
+    }
+
+    // index of the row with key, m_size if the key is not in this leaf
+    template<typename K, typename Compare>
+    [[nodiscard]] indexType find(const K& key, const Compare& comp)
+    {
+        auto index = lowerBound(key,comp);
+        if(index<m_size && !comp(key,values[index].key))
         {
-            throw(std::out_of_range("Key not in BTree"));
+            return index;
         }
-        return row.value;
+        return m_size;
     }
 
-    LeafType& findLeaf([[maybe_unused]] const KeyType& key)
+    // false when key is not in this leaf, true when it may be, always true for leaves without filter
+    template<typename K>
+    [[nodiscard]] bool mayContain(const K& key) const noexcept
     {
-        return *this;
+        return m_filter.mayContain(key);
     }
 
-    ValueType& emplace(const KeyType& key, const ValueType& value, typename Base::nodeVariant& root)
+    // Position of the row with key, either the row that was inserted or the row that was already there
+    struct InsertResult
+    {
+        LeafType* leaf;
+        indexType index;
+        bool inserted;
+    };
+
+    template<typename Compare>
+    InsertResult tryEmplace(const KeyType& key, const ValueType& value, typename Base::nodeVariant& root, const Compare& comp,
+                            const typename Base::descentPath& path)
     {
         const indexType num_cells = m_size;
 
-        auto cellnum = this->findIndex(key);
+        auto cellnum = this->findIndex(key,comp);
+        if(cellnum<num_cells && !comp(key,values[cellnum].key))
+        {
+            return {this, cellnum, false};
+        }
         if (num_cells >= maxValues) {
             // Node full
-            return leaf_node_split_and_insert(key, value,cellnum,root);
+            return leaf_node_split_and_insert(key, value,cellnum,root,comp,path);
         }
 
-        auto& row = values[cellnum];
-        if(row.key==key && cellnum<m_size)
-        {
-            throw(std::out_of_range("Duplicate Key"));
-        }
-        
-        if (cellnum < num_cells) {
         // Make room for new cell
-        for (uint32_t i = num_cells; i > cellnum; i--) {
-            values[i] = values[i-1];
-        }
-        }
+        beginWrite();
+        Base::shiftRight(values.data(), cellnum, num_cells);
         m_size +=1;
-        row = values[cellnum];
+        auto& row = values[cellnum];
         row.key = key;
         row.value = value;
-        return row.value;
-        
+        m_filter.add(key);
+        endWrite();
+        return {this, cellnum, true};
     }
 
-    ValueType& leaf_node_split_and_insert(const KeyType& key, const ValueType& value,indexType cellnum, typename Base::nodeVariant& root) 
+    template<typename Compare>
+    ValueType& emplace(const KeyType& key, const ValueType& value, typename Base::nodeVariant& root, const Compare& comp,
+                       const typename Base::descentPath& path)
+    {
+        auto result = tryEmplace(key,value,root,comp,path);
+        if(!result.inserted)
+        {
+            throw(std::out_of_range("Duplicate Key"));
+        }
+        return result.leaf->values[result.index].value;
+    }
+
+    template<typename Compare>
+    InsertResult leaf_node_split_and_insert(const KeyType& key, const ValueType& value,indexType cellnum, typename Base::nodeVariant& root, const Compare& comp,
+                                            const typename Base::descentPath& path) 
     {
         /*
         Create a new node and move half the cells over.
@@ -149,59 +236,56 @@ public:
         /*
         All existing keys plus new key should be divided
         evenly between old (left) and new (right) nodes.
-        Starting from the right, move each key to correct position.
+        An append to the rightmost leaf starts a new leaf with only the new key.
         */
-        ValueType* ret;
-        for (int32_t i = maxValues; i >= 0; i--) {
-            PtrType destination_node = [&]()
-            {
-            if (static_cast<indexType>(i) >= Base::leftSplitCount()) 
-            {
-                return newLeaf;
-            } 
-            else 
-            {
-                return this;
-            }
-            }();
-            
-            indexType index_within_node = static_cast<indexType>(i) % Base::leftSplitCount();
-            RowType& destination = destination_node->values[index_within_node];
-
-            if (static_cast<indexType>(i) == cellnum) 
-            {
-                destination.value = value;
-                destination.key = key;
-                ret=&(destination.value);
-            } 
-            else if (static_cast<indexType>(i) > cellnum) 
-            {
-                destination = values[static_cast<indexType>(i-1)];
-            } 
-            else 
-            {
-                destination = values[static_cast<indexType>(i)];
-            }
-        }
+        const indexType splitCount = (cellnum==maxValues && this->rightEdge(path)) ? Base::appendSplitCount() : Base::leftSplitCount();
+        Base::splitInsert(values.data(), maxValues, cellnum, RowType{key,value}, splitCount, newLeaf->values.data());
+        const InsertResult ret = (cellnum<splitCount) ? InsertResult{this, cellnum, true} : InsertResult{newLeaf, cellnum-splitCount, true};
         /* Update cell count on both leaf nodes */
-        m_size = Base::leftSplitCount();
-        newLeaf->m_size = Base::rightSplitCount();
+        m_size = splitCount;
+        newLeaf->m_size = maxValues+1-splitCount;
+        rebuildFilter();
+        newLeaf->rebuildFilter();
         
-        if(m_parent)
+        if(Base::parent(path))
         {
-            newLeaf->m_parent = m_parent;
-            this->updateParent(newLeaf->values[0].key,std::move(newLeaf),root);
+            this->updateParent(newLeaf->values[0].key,std::move(newLeaf),root,comp,path);
         }
         else
         {
             this->makeNewRoot(root, std::move(newLeaf));
         }
 
-        return *ret;
+        return ret;
     }
 
     
 
+    // Version of the leaf for optimistic readers, odd while the leaf is modified
+    // Readers validate that the version did not change while they read the leaf
+    [[nodiscard]] uint32_t version() noexcept
+    {
+        return std::atomic_ref<uint32_t>(m_version).load(std::memory_order_acquire);
+    }
+
+    // Rereads the version after the rows were read
+    [[nodiscard]] bool validate(uint32_t version) noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return std::atomic_ref<uint32_t>(m_version).load(std::memory_order_relaxed)==version;
+    }
+
+    void beginWrite() noexcept
+    {
+        std::atomic_ref<uint32_t>(m_version).store(m_version+1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void endWrite() noexcept
+    {
+        std::atomic_ref<uint32_t>(m_version).store(m_version+1, std::memory_order_release);
+    }
+
     void print(uint32_t indentation_level = 0) const
     {
         const indexType num_keys = m_size;
@@ -214,12 +298,26 @@ public:
         }
     }
 
+    void rebuildFilter() noexcept
+    {
+        if constexpr(filtered)
+        {
+            m_filter.clear();
+            for(indexType i = 0; i<m_size; ++i)
+            {
+                m_filter.add(values[i].key);
+            }
+        }
+    }
+
+    // first member so it is aligned for atomic access
+    uint32_t m_version = 0;
     indexType m_size = 0;
-    ParentPtrType m_parent = nullptr;
     std::array<RowType,maxValues> values = {};
 private:
+    [[no_unique_address]] BlockedBloomFilter<filterWords> m_filter;
     // empty filler for writing complete page to disk
-    [[no_unique_address]] typename std::conditional<(filler != 0) ,std::array<uint8_t,filler>, Empty>::type m_filler;
+    [[no_unique_address]] typename std::conditional<(padding != 0) ,std::array<uint8_t,padding>, Empty>::type m_filler;
 };
 #pragma pack()
 
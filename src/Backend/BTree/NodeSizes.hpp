@@ -0,0 +1,137 @@
+#pragma once
+#include <cstddef>
+#include <inttypes.h>
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "BTree.hpp"
+
+// Node size combination measured by recommendNodeSizes
+struct NodeSizes
+{
+    size_t leafPageSize = 0;
+    size_t innerPageSize = 0;
+    double lookupNs = 0;
+    // per row of a full scan
+    double scanNs = 0;
+};
+
+// Rows a BTree with these node sizes holds at least, with every node only half full
+// Small internal nodes have a small fanout, so they limit the rows a tree of MaxDepth levels can hold
+template<typename KeyType, typename ValueType, size_t LeafPageSize, size_t InnerPageSize>
+constexpr size_t nodeSizeCapacity()
+{
+    size_t rows = LeafNode<KeyType,ValueType,LeafPageSize,std::allocator<ValueType>,InnerPageSize>::maxValues/2;
+    for(size_t depth = 0; depth<MaxDepth; ++depth)
+    {
+        rows *= InternalNode<KeyType,ValueType,0,InnerPageSize,std::allocator<ValueType>,LeafPageSize>::maxValues/2;
+    }
+    return rows;
+}
+
+namespace detail
+{
+template<typename KeyType, typename ValueType, size_t LeafPageSize, size_t InnerPageSize, typename MakeKey>
+void measureNodeSizes(size_t rows, MakeKey& makeKey, std::vector<NodeSizes>& results)
+{
+    using LeafType = LeafNode<KeyType,ValueType,LeafPageSize,std::allocator<ValueType>,InnerPageSize>;
+    using InnerType = InternalNode<KeyType,ValueType,0,InnerPageSize,std::allocator<ValueType>,LeafPageSize>;
+    // skips combinations that can not hold two rows per leaf and three children per internal node
+    if constexpr(LeafType::maxValues>=2 && InnerType::maxValues>=3)
+    {
+        if(nodeSizeCapacity<KeyType,ValueType,LeafPageSize,InnerPageSize>()<rows)
+        {
+            return;
+        }
+        std::vector<size_t> order(rows);
+        std::iota(order.begin(),order.end(),size_t{0});
+        std::shuffle(order.begin(),order.end(),std::mt19937(42));
+
+        BTree<KeyType,ValueType,LeafPageSize,std::allocator<ValueType>,std::less<KeyType>,InnerPageSize> tree;
+        for(auto i: order)
+        {
+            tree.try_emplace(makeKey(i),ValueType{});
+        }
+
+        using Clock = std::chrono::steady_clock;
+        size_t found = 0;
+        const auto lookupStart = Clock::now();
+        for(auto i: order)
+        {
+            found += tree.find(makeKey(i))!=tree.end();
+        }
+        const std::chrono::duration<double,std::nano> lookup = Clock::now()-lookupStart;
+
+        size_t scanned = 0;
+        const auto scanStart = Clock::now();
+        for(auto& row: tree)
+        {
+            scanned += reinterpret_cast<const volatile char&>(row.value)!=0;
+        }
+        const std::chrono::duration<double,std::nano> scan = Clock::now()-scanStart;
+        // keep the loops from being optimized away
+        if(found+scanned==SIZE_MAX)
+        {
+            return;
+        }
+        results.push_back(NodeSizes{LeafPageSize,InnerPageSize,lookup.count()/static_cast<double>(rows),
+                                    scan.count()/static_cast<double>(rows)});
+    }
+}
+}
+
+// Measures point lookups and full scans of rows keys makeKey(0..rows-1) for leaves of 4 KB to 16 KB
+// and internal nodes of 256 B to 4 KB, the results are sorted with the recommendation first.
+// A combination is scored by its lookup and scan time relative to the fastest combination,
+// weighted by scanWeight, the share of the work done by scans
+template<typename KeyType, typename ValueType, typename MakeKey>
+std::vector<NodeSizes> measureNodeSizes(size_t rows, MakeKey&& makeKey, double scanWeight = 0.5)
+{
+    std::vector<NodeSizes> results;
+    [&]<size_t... Leaf>(std::index_sequence<Leaf...>)
+    {
+        ([&]()
+        {
+            constexpr size_t leaf = size_t{4096}<<Leaf;
+            detail::measureNodeSizes<KeyType,ValueType,leaf,256>(rows,makeKey,results);
+            detail::measureNodeSizes<KeyType,ValueType,leaf,512>(rows,makeKey,results);
+            detail::measureNodeSizes<KeyType,ValueType,leaf,1024>(rows,makeKey,results);
+            detail::measureNodeSizes<KeyType,ValueType,leaf,4096>(rows,makeKey,results);
+        }(),...);
+    }(std::make_index_sequence<3>{});
+    if(results.empty())
+    {
+        throw BTreeException("No node sizes hold the rows");
+    }
+
+    const auto bestLookup = std::min_element(results.begin(),results.end(),[](const auto& lhs, const auto& rhs)
+    {
+        return lhs.lookupNs<rhs.lookupNs;
+    })->lookupNs;
+    const auto bestScan = std::min_element(results.begin(),results.end(),[](const auto& lhs, const auto& rhs)
+    {
+        return lhs.scanNs<rhs.scanNs;
+    })->scanNs;
+    const auto score = [&](const NodeSizes& sizes)
+    {
+        return (1-scanWeight)*sizes.lookupNs/bestLookup+scanWeight*sizes.scanNs/bestScan;
+    };
+    std::stable_sort(results.begin(),results.end(),[&](const auto& lhs, const auto& rhs)
+    {
+        return score(lhs)<score(rhs);
+    });
+    return results;
+}
+
+// recommended sizes for integral keys
+template<typename KeyType, typename ValueType>
+NodeSizes recommendNodeSizes(size_t rows, double scanWeight = 0.5)
+{
+    return measureNodeSizes<KeyType,ValueType>(rows,[](size_t i)
+    {
+        return static_cast<KeyType>(i);
+    },scanWeight).front();
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include "BTree.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Spreads keys evenly over the shards, increasing keys go to different shards
+template<typename KeyType>
+struct HashPartitioner
+{
+    [[nodiscard]] size_t operator()(const KeyType& key, size_t shards) const noexcept
+    {
+        // fibonacci hashing, std::hash of integers is the identity
+        const uint64_t hash = static_cast<uint64_t>(std::hash<KeyType>{}(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(((hash >> 32) * shards) >> 32);
+    }
+};
+
+// Shard i holds the keys from bounds[i-1] up to but not including bounds[i],
+// a scan of a key range only touches the shards overlapping the range
+template<typename KeyType, typename Compare = std::less<KeyType>>
+struct RangePartitioner
+{
+    std::vector<KeyType> bounds;
+    [[no_unique_address]] Compare comp;
+
+    [[nodiscard]] size_t operator()(const KeyType& key, size_t shards) const
+    {
+        const auto index = static_cast<size_t>(std::upper_bound(bounds.begin(),bounds.end(),key,comp)-bounds.begin());
+        return std::min(index,shards-1);
+    }
+};
+
+// Partitions the rows over independent BTrees so threads inserting at the same time do not share a hotspot,
+// each shard has its own writer lock and allocates its nodes through its own allocator
+// Inserts and lookups may run concurrently from any thread, lookups take no lock
+// Iteration merges the shards in key order and must not run concurrently with inserts
+template<typename KeyType, typename ValueType, size_t PageSize = PAGE_SIZE, typename Allocator = std::allocator<ValueType>,
+         typename Compare = std::less<KeyType>, typename Partitioner = HashPartitioner<KeyType>>
+class PartitionedBTree
+{
+public:
+    using TreeType = BTree<KeyType,ValueType,PageSize,Allocator,Compare>;
+    using RowType = typename TreeType::RowType;
+    using key_compare = Compare;
+
+    // Forward iterator over the rows of all shards in key order,
+    // a heap of the current row of every shard picks the next row
+    class iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = RowType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = RowType*;
+        using reference = RowType&;
+
+        iterator() = default;
+
+        reference operator*() const
+        {
+            return *m_heads.front();
+        }
+
+        pointer operator->() const
+        {
+            return &(*m_heads.front());
+        }
+
+        iterator& operator++()
+        {
+            std::pop_heap(m_heads.begin(),m_heads.end(),HeadOrder{m_comp});
+            if(++m_heads.back() == typename TreeType::iterator())
+            {
+                m_heads.pop_back();
+            }
+            else
+            {
+                std::push_heap(m_heads.begin(),m_heads.end(),HeadOrder{m_comp});
+            }
+            return *this;
+        }
+
+        iterator operator++(int)
+        {
+            auto ret = *this;
+            ++(*this);
+            return ret;
+        }
+
+        bool operator==(const iterator& other) const
+        {
+            if(m_heads.empty() || other.m_heads.empty())
+            {
+                return m_heads.empty() && other.m_heads.empty();
+            }
+            return m_heads.size() == other.m_heads.size() && m_heads.front() == other.m_heads.front();
+        }
+
+    private:
+        friend class PartitionedBTree;
+
+        // orders the heap so the smallest key is at the front
+        struct HeadOrder
+        {
+            const Compare* comp;
+            bool operator()(const typename TreeType::iterator& lhs, const typename TreeType::iterator& rhs) const
+            {
+                return (*comp)(rhs->key,lhs->key);
+            }
+        };
+
+        iterator(std::vector<typename TreeType::iterator> heads, const Compare* comp):
+        m_heads(std::move(heads)),
+        m_comp(comp)
+        {
+            std::erase(m_heads,typename TreeType::iterator());
+            std::make_heap(m_heads.begin(),m_heads.end(),HeadOrder{m_comp});
+        }
+
+        std::vector<typename TreeType::iterator> m_heads;
+        const Compare* m_comp = nullptr;
+    };
+
+    explicit PartitionedBTree(size_t shardCount = std::max(1u,std::thread::hardware_concurrency()),
+                              const Partitioner& partitioner = Partitioner(), const Compare& comp = Compare()):
+    m_partitioner(partitioner),
+    m_compare(comp)
+    {
+        if(shardCount == 0)
+        {
+            throw std::invalid_argument("PartitionedBTree needs at least one shard");
+        }
+        m_shards.reserve(shardCount);
+        for(size_t i = 0; i<shardCount; ++i)
+        {
+            m_shards.push_back(std::make_unique<Shard>(comp));
+        }
+    }
+
+    // delete copy and move constructors, like the BTrees of the shards
+    PartitionedBTree(const PartitionedBTree&) = delete;
+    PartitionedBTree(PartitionedBTree&&) = delete;
+    PartitionedBTree& operator=(const PartitionedBTree&) = delete;
+    PartitionedBTree& operator=(PartitionedBTree&&) = delete;
+    ~PartitionedBTree() = default;
+
+    // throws std::out_of_range when key is already in the BTree
+    void emplace(const KeyType& key, const ValueType& value)
+    {
+        if(!try_emplace(key,value))
+        {
+            throw(std::out_of_range("Duplicate Key"));
+        }
+    }
+
+    // Inserts the row when key is not in the BTree yet, returns whether it was inserted
+    bool try_emplace(const KeyType& key, const ValueType& value)
+    {
+        auto& shard = shardOf(key);
+        std::lock_guard lock(shard.mutex);
+        return shard.tree.try_emplace(key,value).second;
+    }
+
+    // Inserts the row or overwrites the value of the row with key, returns true when it was inserted
+    bool insert_or_assign(const KeyType& key, const ValueType& value)
+    {
+        auto& shard = shardOf(key);
+        std::lock_guard lock(shard.mutex);
+        return shard.tree.insert_or_assign(key,value).second;
+    }
+
+    // Calls fn with the value of the row with key under the lock of its shard,
+    // returns false when key is not in the BTree
+    template<typename Fn>
+    bool modify(const KeyType& key, Fn&& fn)
+    {
+        auto& shard = shardOf(key);
+        std::lock_guard lock(shard.mutex);
+        return shard.tree.modify(key,std::forward<Fn>(fn));
+    }
+
+    // Latch-free lookup, see BTree::lookup
+    [[nodiscard]] std::optional<ValueType> lookup(const KeyType& key)
+    {
+        return shardOf(key).tree.lookup(key);
+    }
+
+    // Sum of the rows of all shards, only exact when no insert is running
+    [[nodiscard]] std::size_t size()
+    {
+        std::size_t ret = 0;
+        for(auto& shard: m_shards)
+        {
+            ret += shard->tree.size();
+        }
+        return ret;
+    }
+
+    iterator begin()
+    {
+        std::vector<typename TreeType::iterator> heads;
+        heads.reserve(m_shards.size());
+        for(auto& shard: m_shards)
+        {
+            heads.push_back(shard->tree.begin());
+        }
+        return iterator(std::move(heads),&m_compare);
+    }
+
+    iterator end()
+    {
+        return iterator();
+    }
+
+    // iterator to the first row with a key not ordered before key
+    iterator lower_bound(const KeyType& key)
+    {
+        std::vector<typename TreeType::iterator> heads;
+        heads.reserve(m_shards.size());
+        for(auto& shard: m_shards)
+        {
+            heads.push_back(shard->tree.lower_bound(key));
+        }
+        return iterator(std::move(heads),&m_compare);
+    }
+
+    [[nodiscard]] size_t shardCount() const noexcept
+    {
+        return m_shards.size();
+    }
+
+    [[nodiscard]] size_t shardIndex(const KeyType& key) const
+    {
+        return m_partitioner(key,m_shards.size());
+    }
+
+    // BTree of a single shard, not synchronized with inserts into the shard
+    [[nodiscard]] TreeType& shard(size_t index)
+    {
+        return m_shards.at(index)->tree;
+    }
+
+private:
+    // aligned so the locks of different shards do not share a cache line
+    struct alignas(64) Shard
+    {
+        explicit Shard(const Compare& comp):
+        tree(comp)
+        {}
+
+        std::mutex mutex;
+        TreeType tree;
+    };
+
+    Shard& shardOf(const KeyType& key)
+    {
+        return *m_shards[shardIndex(key)];
+    }
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    [[no_unique_address]] Partitioner m_partitioner;
+    [[no_unique_address]] Compare m_compare;
+};
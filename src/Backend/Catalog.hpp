@@ -0,0 +1,165 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "BTree.hpp"
+#include "PageChain.hpp"
+#include "Pager.hpp"
+#include "PaxPage.hpp"
+#include "Schema.hpp"
+
+class CatalogException : public DBException
+{
+public:
+  CatalogException(const std::string& msg) : DBException(fmt::format("<Catalog>: \"{}\"", msg)) {}
+  virtual ~CatalogException() noexcept = default;
+};
+
+inline constexpr size_t TABLE_NAME_SIZE = 32;
+
+// Fixed size zero padded table name, so it can be used as a BTree key
+using TableName = std::array<char,TABLE_NAME_SIZE>;
+
+inline TableName makeTableName(std::string_view name)
+{
+  if(name.empty() || name.size()>=TABLE_NAME_SIZE)
+  {
+    throw CatalogException(fmt::format("Invalid table name '{}'",name));
+  }
+  TableName ret{};
+  std::memcpy(ret.data(),name.data(),name.size());
+  return ret;
+}
+
+inline std::string_view tableNameView(const TableName& name)
+{
+  return std::string_view(name.data(),::strnlen(name.data(),name.size()));
+}
+
+// Orders table names by their name, so tables can be looked up by a string_view
+struct TableNameLess
+{
+  using is_transparent = void;
+
+  template<typename L, typename R>
+  bool operator()(const L& lhs, const R& rhs) const
+  {
+    return view(lhs)<view(rhs);
+  }
+
+private:
+  static std::string_view view(const TableName& name)
+  {
+    return tableNameView(name);
+  }
+
+  static std::string_view view(std::string_view name)
+  {
+    return name;
+  }
+};
+
+struct CatalogEntry
+{
+  TableSchema schema;
+  // first page of the rows of the table
+  PageNum rootPage = INVALID_PAGE;
+  uint64_t rowCount = 0;
+  // first page of the hash index of the table, INVALID_PAGE when the table has none
+  PageNum indexRoot = INVALID_PAGE;
+  TableLayout layout = TableLayout::ROW;
+};
+
+// System table of the database file, maps table names to their schema and root page
+// The catalog is a BTree itself and is stored in the page chain starting at Pager::catalogRoot
+class Catalog
+{
+public:
+  using TreeType = BTree<TableName,CatalogEntry,PAGE_SIZE,std::allocator<CatalogEntry>,TableNameLess>;
+
+  explicit Catalog(Pager& pager):
+  m_pager(pager)
+  {
+    if(m_pager.catalogRoot()==INVALID_PAGE)
+    {
+      return;
+    }
+    readPageChain(m_pager,m_pager.catalogRoot(),sizeof(TreeType::RowType),[&](std::span<const char> record)
+    {
+      TreeType::RowType row;
+      std::memcpy(&row,record.data(),sizeof(row));
+      m_tables.emplace(row.key,row.value);
+    });
+  }
+
+  Catalog(const Catalog&) = delete;
+  Catalog(Catalog&&) = delete;
+  Catalog& operator=(const Catalog&) = delete;
+  Catalog& operator=(Catalog&&) = delete;
+  ~Catalog() = default;
+
+  CatalogEntry& create(std::string_view name, const TableSchema& schema, TableLayout layout = TableLayout::ROW)
+  {
+    CatalogEntry entry;
+    entry.schema = schema;
+    entry.layout = layout;
+    auto [it, inserted] = m_tables.try_emplace(makeTableName(name),entry);
+    if(!inserted)
+    {
+      throw CatalogException(fmt::format("Table {} already exists",name));
+    }
+    it->value.rootPage = m_pager.allocate();
+    return it->value;
+  }
+
+  [[nodiscard]] CatalogEntry& at(std::string_view name)
+  {
+    auto it = m_tables.find(name);
+    if(it==m_tables.end())
+    {
+      throw CatalogException(fmt::format("No such table {}",name));
+    }
+    return it->value;
+  }
+
+  [[nodiscard]] bool contains(std::string_view name)
+  {
+    return m_tables.find(name)!=m_tables.end();
+  }
+
+  [[nodiscard]] std::size_t size()
+  {
+    return m_tables.size();
+  }
+
+  TreeType::iterator begin()
+  {
+    return m_tables.begin();
+  }
+
+  TreeType::iterator end()
+  {
+    return m_tables.end();
+  }
+
+  void flush()
+  {
+    if(m_pager.catalogRoot()==INVALID_PAGE)
+    {
+      m_pager.setCatalogRoot(m_pager.allocate());
+    }
+    PageChainWriter writer(m_pager,m_pager.catalogRoot(),PageType::CATALOG,sizeof(TreeType::RowType));
+    for(auto& row: m_tables)
+    {
+      writer.append(std::span<const char>(reinterpret_cast<const char*>(&row),sizeof(row)));
+    }
+    writer.finish();
+  }
+
+private:
+  Pager& m_pager;
+  TreeType m_tables;
+};
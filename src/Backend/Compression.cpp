@@ -0,0 +1,193 @@
+#include "Compression.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace
+{
+// last bytes of a block are always literals, and the last match has to start before MATCH_LIMIT
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t LAST_LITERALS = 5;
+constexpr size_t MATCH_LIMIT = 12;
+constexpr size_t MAX_OFFSET = 65535;
+constexpr unsigned HASH_BITS = 12;
+
+uint32_t read32(const unsigned char* data) noexcept
+{
+  uint32_t ret;
+  std::memcpy(&ret,data,sizeof(ret));
+  return ret;
+}
+
+uint32_t hash(uint32_t sequence) noexcept
+{
+  return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// writes the remainder of a length that did not fit in the 4 bits of the token
+unsigned char* writeLength(unsigned char* op, size_t length) noexcept
+{
+  for(; length>=255; length-=255)
+  {
+    *op++ = 255;
+  }
+  *op++ = static_cast<unsigned char>(length);
+  return op;
+}
+
+bool readLength(const unsigned char*& ip, const unsigned char* end, size_t& length) noexcept
+{
+  unsigned char byte;
+  do
+  {
+    if(ip>=end)
+    {
+      return false;
+    }
+    byte = *ip++;
+    length += byte;
+  } while(byte==255);
+  return true;
+}
+}
+
+size_t lz4Compress(std::span<const char> source, std::span<char> destination) noexcept
+{
+  const auto* base = reinterpret_cast<const unsigned char*>(source.data());
+  const auto* ip = base;
+  const auto* anchor = base;
+  const auto* end = base + source.size();
+  auto* op = reinterpret_cast<unsigned char*>(destination.data());
+  auto* const opStart = op;
+  auto* const opEnd = op + destination.size();
+
+  // positions are stored +1 so 0 marks an empty slot
+  std::array<uint32_t,1u<<HASH_BITS> table{};
+
+  auto emit = [&](size_t literals, size_t offset, size_t matchLength) -> bool
+  {
+    // token, literal length bytes, literals, offset and match length bytes
+    const size_t needed = 1 + literals/255 + 1 + literals + 2 + matchLength/255 + 1;
+    if(static_cast<size_t>(opEnd-op)<needed)
+    {
+      return false;
+    }
+    auto* token = op++;
+    *token = static_cast<unsigned char>(std::min<size_t>(literals,15) << 4);
+    if(literals>=15)
+    {
+      op = writeLength(op,literals-15);
+    }
+    std::memcpy(op,anchor,literals);
+    op += literals;
+    if(matchLength==0)
+    {
+      return true;
+    }
+    *op++ = static_cast<unsigned char>(offset & 0xFF);
+    *op++ = static_cast<unsigned char>(offset >> 8);
+    const size_t length = matchLength - MIN_MATCH;
+    *token = static_cast<unsigned char>(*token | std::min<size_t>(length,15));
+    if(length>=15)
+    {
+      op = writeLength(op,length-15);
+    }
+    return true;
+  };
+
+  if(source.size()>MATCH_LIMIT)
+  {
+    const auto* matchLimit = end - MATCH_LIMIT;
+    while(ip<matchLimit)
+    {
+      const uint32_t sequence = read32(ip);
+      auto& slot = table[hash(sequence)];
+      // an empty slot has no position, base-1 is not formed
+      const auto* ref = slot!=0 ? base + slot - 1 : nullptr;
+      const bool found = ref && static_cast<size_t>(ip-ref)<=MAX_OFFSET && read32(ref)==sequence;
+      slot = static_cast<uint32_t>(ip-base) + 1;
+      if(!found)
+      {
+        ++ip;
+        continue;
+      }
+      size_t matchLength = MIN_MATCH;
+      while(ip+matchLength < end-LAST_LITERALS && ref[matchLength]==ip[matchLength])
+      {
+        ++matchLength;
+      }
+      if(!emit(static_cast<size_t>(ip-anchor),static_cast<size_t>(ip-ref),matchLength))
+      {
+        return 0;
+      }
+      ip += matchLength;
+      anchor = ip;
+    }
+  }
+  if(!emit(static_cast<size_t>(end-anchor),0,0))
+  {
+    return 0;
+  }
+  return static_cast<size_t>(op-opStart);
+}
+
+std::optional<size_t> lz4Decompress(std::span<const char> source, std::span<char> destination) noexcept
+{
+  const auto* ip = reinterpret_cast<const unsigned char*>(source.data());
+  const auto* const end = ip + source.size();
+  auto* op = reinterpret_cast<unsigned char*>(destination.data());
+  auto* const opStart = op;
+  auto* const opEnd = op + destination.size();
+
+  while(ip<end)
+  {
+    const unsigned char token = *ip++;
+    size_t literals = token >> 4;
+    if(literals==15 && !readLength(ip,end,literals))
+    {
+      return std::nullopt;
+    }
+    if(static_cast<size_t>(end-ip)<literals || static_cast<size_t>(opEnd-op)<literals)
+    {
+      return std::nullopt;
+    }
+    std::memcpy(op,ip,literals);
+    ip += literals;
+    op += literals;
+    if(ip==end)
+    {
+      // last sequence has no match
+      break;
+    }
+
+    if(end-ip<2)
+    {
+      return std::nullopt;
+    }
+    const size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+    ip += 2;
+    if(offset==0 || offset>static_cast<size_t>(op-opStart))
+    {
+      return std::nullopt;
+    }
+    size_t matchLength = token & 15;
+    if(matchLength==15 && !readLength(ip,end,matchLength))
+    {
+      return std::nullopt;
+    }
+    matchLength += MIN_MATCH;
+    if(static_cast<size_t>(opEnd-op)<matchLength)
+    {
+      return std::nullopt;
+    }
+    // matches may overlap with the output they are copied to
+    const auto* match = op - offset;
+    for(size_t i=0; i<matchLength; ++i)
+    {
+      op[i] = match[i];
+    }
+    op += matchLength;
+  }
+  return static_cast<size_t>(op-opStart);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cinttypes>
+#include <optional>
+#include <span>
+
+// LZ4 block format codec used for page compression
+// Implemented in tree so the pager does not depend on an external compression library
+
+// worst case size of the compressed output for size bytes of input
+[[nodiscard]] constexpr size_t lz4CompressBound(size_t size) noexcept
+{
+  return size + size/255 + 16;
+}
+
+// Returns the compressed size, 0 when the output does not fit in destination
+[[nodiscard]] size_t lz4Compress(std::span<const char> source, std::span<char> destination) noexcept;
+
+// Returns the decompressed size, std::nullopt when the input is malformed or does not fit in destination
+[[nodiscard]] std::optional<size_t> lz4Decompress(std::span<const char> source, std::span<char> destination) noexcept;
@@ -0,0 +1,91 @@
+#include "Crc32c.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#endif
+
+namespace
+{
+constexpr uint32_t CRC32C_POLY = 0x82F63B78;
+
+constexpr std::array<uint32_t,256> makeTable()
+{
+  std::array<uint32_t,256> table{};
+  for(uint32_t i=0; i<256; ++i)
+  {
+    uint32_t crc = i;
+    for(int bit=0; bit<8; ++bit)
+    {
+      crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    }
+    table[i] = crc;
+  }
+  return table;
+}
+
+constexpr std::array<uint32_t,256> CRC32C_TABLE = makeTable();
+
+uint32_t crc32cSoftware(const unsigned char* data, size_t size, uint32_t crc) noexcept
+{
+  for(size_t i=0; i<size; ++i)
+  {
+    crc = CRC32C_TABLE[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#ifdef CRC32C_X86
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(const unsigned char* data, size_t size, uint32_t crc) noexcept
+{
+#if defined(__x86_64__)
+  uint64_t crc64 = crc;
+  for(; size>=sizeof(uint64_t); size-=sizeof(uint64_t), data+=sizeof(uint64_t))
+  {
+    uint64_t word;
+    std::memcpy(&word,data,sizeof(word));
+    crc64 = _mm_crc32_u64(crc64,word);
+  }
+  crc = static_cast<uint32_t>(crc64);
+#endif
+  for(; size>=sizeof(uint32_t); size-=sizeof(uint32_t), data+=sizeof(uint32_t))
+  {
+    uint32_t word;
+    std::memcpy(&word,data,sizeof(word));
+    crc = _mm_crc32_u32(crc,word);
+  }
+  for(; size>0; --size, ++data)
+  {
+    crc = _mm_crc32_u8(crc,*data);
+  }
+  return crc;
+}
+#endif
+}
+
+bool crc32cHardwareAccelerated() noexcept
+{
+#ifdef CRC32C_X86
+  static const bool supported = __builtin_cpu_supports("sse4.2");
+  return supported;
+#else
+  return false;
+#endif
+}
+
+uint32_t crc32c(std::span<const char> data, uint32_t crc) noexcept
+{
+  const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+  crc = ~crc;
+#ifdef CRC32C_X86
+  if(crc32cHardwareAccelerated())
+  {
+    return ~crc32cHardware(bytes,data.size(),crc);
+  }
+#endif
+  return ~crc32cSoftware(bytes,data.size(),crc);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cinttypes>
+#include <span>
+
+// CRC32C (Castagnoli) as used for page checksums
+// Uses the SSE4.2 crc32 instruction when the cpu supports it, a table based implementation otherwise
+[[nodiscard]] uint32_t crc32c(std::span<const char> data, uint32_t crc = 0) noexcept;
+
+// true when crc32c runs on the SSE4.2 implementation
+[[nodiscard]] bool crc32cHardwareAccelerated() noexcept;
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Table.hpp"
+
+// Position in a table, wraps the iterator of the table BTree
+class Cursor
+{
+public:
+  Cursor(Table& table, Table::TreeType::iterator it):
+  m_endOfTable(it==table.m_btree.end()),
+  m_table(table),
+  m_it(it)
+  {
+  }
+
+  [[nodiscard]] Table::KeyType key() const
+  {
+    return m_it->key;
+  }
+
+  // rows are written through the table only
+  [[nodiscard]] const Table::ValueType& value() const
+  {
+    return m_it->value;
+  }
+
+  // the row in the leaf, see Table::view
+  [[nodiscard]] RowView view() const noexcept
+  {
+    return m_table.view(m_it->value);
+  }
+
+  void advance()
+  {
+    ++m_it;
+    m_endOfTable = (m_it==m_table.m_btree.end());
+  }
+
+  bool m_endOfTable;
+private:
+  Table& m_table;
+  Table::TreeType::iterator m_it;
+};
+
+inline Cursor table_start(Table& table)
+{
+  return Cursor(table,table.m_btree.begin());
+}
+
+// Cursor at key, or at the position where key would be inserted
+inline Cursor table_find(Table& table, Table::KeyType key)
+{
+  return Cursor(table,table.m_btree.lower_bound(key));
+}
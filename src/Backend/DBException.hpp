@@ -0,0 +1,19 @@
+#pragma once
+#include <exception>
+#include <string>
+#include <fmt/core.h>
+
+class DBException : public std::exception 
+{
+public:
+  DBException(const std::string& msg) : message(fmt::format("DB Exception {}",msg)) {}
+  virtual ~DBException() noexcept = default;
+
+  [[nodiscard]] const char* what() const noexcept override
+  {
+    return message.c_str();
+  }
+
+private:
+  std::string message;
+};
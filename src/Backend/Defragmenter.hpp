@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "Catalog.hpp"
+#include "Pager.hpp"
+
+struct DefragmentOptions
+{
+  // pages moved by one step at most
+  size_t pagesPerStep = 32;
+  // steps called sooner after the previous step do nothing
+  std::chrono::milliseconds interval{10};
+};
+
+// Online defragmentation of the page chains of the tables and their hash indexes
+// Flushes reuse the pages of a chain and take additional pages from the free list, so after a while
+// the pages of a chain are scattered over the file and a scan of the chain reads them in random order.
+// Every step moves a few pages until each chain visits its pages in ascending page order,
+// so scans read forward through the file and the pager detects them and reads ahead.
+// Pages are only exchanged between positions of the same chain, and the links and the root in the catalog
+// are updated with every exchange, so the chains are valid between steps.
+// Page numbers of chains held elsewhere, like the page lists of open tables, are stale after pages were moved
+class Defragmenter
+{
+public:
+  Defragmenter(Pager& pager, Catalog& catalog, const DefragmentOptions& options = DefragmentOptions()):
+  m_pager(pager),
+  m_catalog(catalog),
+  m_options(options)
+  {
+  }
+
+  Defragmenter(const Defragmenter&) = delete;
+  Defragmenter(Defragmenter&&) = delete;
+  Defragmenter& operator=(const Defragmenter&) = delete;
+  Defragmenter& operator=(Defragmenter&&) = delete;
+  ~Defragmenter() = default;
+
+  void setOptions(const DefragmentOptions& options) noexcept
+  {
+    m_options = options;
+  }
+
+  // Moves up to pagesPerStep pages of the chains, continuing with the chain the previous step stopped at
+  // Returns the number of pages moved
+  size_t step()
+  {
+    const auto now = Clock::now();
+    if(m_ordered || now-m_lastStep<m_options.interval)
+    {
+      return 0;
+    }
+    m_lastStep = now;
+
+    // root pages in the catalog entries, the catalog does not change during a step
+    std::vector<PageNum*> roots;
+    for(auto& row: m_catalog)
+    {
+      roots.push_back(&row.value.rootPage);
+      if(row.value.indexRoot!=INVALID_PAGE)
+      {
+        roots.push_back(&row.value.indexRoot);
+      }
+    }
+    size_t moved = 0;
+    for(size_t visited = 0; visited<roots.size() && moved<m_options.pagesPerStep; ++visited)
+    {
+      m_chain %= roots.size();
+      const size_t chainMoved = order(*roots[m_chain],m_options.pagesPerStep-moved);
+      moved += chainMoved;
+      m_inOrder = chainMoved==0 ? m_inOrder+1 : 0;
+      if(moved<m_options.pagesPerStep)
+      {
+        // the chain is in order now
+        ++m_chain;
+      }
+    }
+    m_ordered = m_inOrder>=roots.size();
+    return moved;
+  }
+
+  // true once a step found every chain in order, steps do nothing until restart
+  [[nodiscard]] bool ordered() const noexcept
+  {
+    return m_ordered;
+  }
+
+  // the chains were written and may be out of order again
+  void restart() noexcept
+  {
+    m_ordered = false;
+    m_inOrder = 0;
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // Moves up to budget pages of the chain starting at root, position i of the chain ends up
+  // on the i-th smallest page number of the chain. Returns the number of pages moved
+  size_t order(PageNum& root, size_t budget)
+  {
+    std::vector<PageNum> pages;
+    for(PageNum pageNum = root; pageNum!=INVALID_PAGE; pageNum = m_pager.get(pageNum).header.next)
+    {
+      pages.push_back(pageNum);
+    }
+    std::vector<PageNum> sorted(pages);
+    std::sort(sorted.begin(),sorted.end());
+
+    size_t moved = 0;
+    for(size_t i=0; i<pages.size() && moved<budget; ++i)
+    {
+      if(pages[i]==sorted[i])
+      {
+        continue;
+      }
+      // the positions before i are in place already
+      const size_t j = static_cast<size_t>(std::find(pages.begin()+static_cast<std::ptrdiff_t>(i)+1,pages.end(),sorted[i])-pages.begin());
+      m_pager.swap(pages[i],pages[j]);
+      std::swap(pages[i],pages[j]);
+      // the pages keep the links to the positions after them, except for the page before j when j follows i
+      link(root,pages,i);
+      link(root,pages,j);
+      moved += 2;
+    }
+    return moved;
+  }
+
+  // points the position before index to the page of index
+  void link(PageNum& root, const std::vector<PageNum>& pages, size_t index)
+  {
+    if(index==0)
+    {
+      root = pages[0];
+      return;
+    }
+    m_pager.get(pages[index-1]).header.next = pages[index];
+    m_pager.markDirty(pages[index-1]);
+  }
+
+  Pager& m_pager;
+  Catalog& m_catalog;
+  DefragmentOptions m_options;
+  Clock::time_point m_lastStep{};
+  // chain the next step starts with
+  size_t m_chain = 0;
+  // consecutive chains found in order
+  size_t m_inOrder = 0;
+  bool m_ordered = false;
+};
@@ -0,0 +1,149 @@
+#include "Epoch.hpp"
+
+#include <algorithm>
+
+namespace
+{
+// process wide thread index, so every manager can use an array of slots
+std::array<std::atomic<bool>,EpochManager::MAX_THREADS> usedThreadIds{};
+
+struct ThreadId
+{
+  ThreadId()
+  {
+    for(size_t i=0; i<usedThreadIds.size(); ++i)
+    {
+      if(!usedThreadIds[i].exchange(true,std::memory_order_acq_rel))
+      {
+        id = i;
+        return;
+      }
+    }
+    throw EpochException(fmt::format("More than {} threads use epoch based reclamation",EpochManager::MAX_THREADS));
+  }
+
+  ThreadId(const ThreadId&) = delete;
+  ThreadId(ThreadId&&) = delete;
+  ThreadId& operator=(const ThreadId&) = delete;
+  ThreadId& operator=(ThreadId&&) = delete;
+
+  ~ThreadId()
+  {
+    usedThreadIds[id].store(false,std::memory_order_release);
+  }
+
+  size_t id = 0;
+};
+
+size_t threadId()
+{
+  thread_local ThreadId id;
+  return id.id;
+}
+}
+
+EpochManager::Guard::Guard(EpochManager& manager):
+m_manager(manager),
+m_slot(manager.enter())
+{
+}
+
+EpochManager::Guard::~Guard()
+{
+  m_manager.leave(m_slot);
+}
+
+EpochManager::~EpochManager()
+{
+  for(auto& retired: m_retired)
+  {
+    retired.deleter();
+  }
+}
+
+size_t EpochManager::enter()
+{
+  const size_t index = threadId();
+  auto& slot = m_slots[index];
+  if(slot.depth++==0)
+  {
+    slot.epoch.store(m_epoch.load(std::memory_order_acquire),std::memory_order_seq_cst);
+    // the pin has to be visible before the first shared node is read
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+  return index;
+}
+
+void EpochManager::leave(size_t index)
+{
+  auto& slot = m_slots[index];
+  if(--slot.depth==0)
+  {
+    slot.epoch.store(IDLE,std::memory_order_release);
+  }
+}
+
+void EpochManager::retire(std::function<void()> deleter)
+{
+  size_t count = 0;
+  {
+    std::lock_guard lock(m_mutex);
+    m_retired.push_back(Retired{m_epoch.load(std::memory_order_acquire),std::move(deleter)});
+    count = m_retired.size();
+  }
+  if(count>=RECLAIM_THRESHOLD)
+  {
+    reclaim();
+  }
+}
+
+size_t EpochManager::reclaim()
+{
+  // unlinking the retired objects has to be visible before the pinned epochs are read
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint64_t current = m_epoch.load(std::memory_order_acquire);
+  uint64_t minimum = current;
+  bool advance = true;
+  for(const auto& slot: m_slots)
+  {
+    const uint64_t pinned = slot.epoch.load(std::memory_order_acquire);
+    if(pinned!=IDLE)
+    {
+      minimum = std::min(minimum,pinned);
+      advance = advance && pinned==current;
+    }
+  }
+  if(advance)
+  {
+    m_epoch.compare_exchange_strong(current,current+1,std::memory_order_acq_rel);
+  }
+
+  // objects retired before the oldest pinned epoch can not be referenced anymore
+  std::vector<Retired> freed;
+  {
+    std::lock_guard lock(m_mutex);
+    auto it = std::stable_partition(m_retired.begin(),m_retired.end(),[&](const Retired& retired)
+    {
+      return retired.epoch>=minimum;
+    });
+    freed.assign(std::make_move_iterator(it),std::make_move_iterator(m_retired.end()));
+    m_retired.erase(it,m_retired.end());
+  }
+  for(auto& retired: freed)
+  {
+    retired.deleter();
+  }
+  return freed.size();
+}
+
+size_t EpochManager::pending() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_retired.size();
+}
+
+EpochManager& EpochManager::global()
+{
+  static EpochManager manager;
+  return manager;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "DBException.hpp"
+
+class EpochException : public DBException
+{
+public:
+  EpochException(const std::string& msg) : DBException(fmt::format("<Epoch>: \"{}\"", msg)) {}
+  virtual ~EpochException() noexcept = default;
+};
+
+// Epoch based memory reclamation
+// Readers pin the current epoch while they access shared nodes without latches,
+// writers retire nodes after unlinking them instead of freeing them.
+// A retired node is freed once no thread that was pinned when it was retired is still pinned.
+class EpochManager
+{
+public:
+  static constexpr size_t MAX_THREADS = 256;
+
+  // Pins the epoch of the calling thread for its lifetime, guards of one thread may be nested
+  class Guard
+  {
+  public:
+    explicit Guard(EpochManager& manager);
+    Guard(const Guard&) = delete;
+    Guard(Guard&&) = delete;
+    Guard& operator=(const Guard&) = delete;
+    Guard& operator=(Guard&&) = delete;
+    ~Guard();
+
+  private:
+    EpochManager& m_manager;
+    size_t m_slot;
+  };
+
+  EpochManager() = default;
+  EpochManager(const EpochManager&) = delete;
+  EpochManager(EpochManager&&) = delete;
+  EpochManager& operator=(const EpochManager&) = delete;
+  EpochManager& operator=(EpochManager&&) = delete;
+  // frees all retired objects, no thread may be pinned anymore
+  ~EpochManager();
+
+  [[nodiscard]] Guard pin()
+  {
+    return Guard(*this);
+  }
+
+  // deleter is called once no reader can reference the unlinked object anymore
+  void retire(std::function<void()> deleter);
+
+  // Advances the epoch when all pinned threads have seen the current one and frees the retired objects
+  // that are no longer reachable, returns the number of freed objects
+  size_t reclaim();
+
+  [[nodiscard]] uint64_t epoch() const noexcept
+  {
+    return m_epoch.load(std::memory_order_acquire);
+  }
+
+  // number of retired objects that have not been freed yet
+  [[nodiscard]] size_t pending() const;
+
+  // manager shared by all BTrees
+  static EpochManager& global();
+
+private:
+  static constexpr uint64_t IDLE = std::numeric_limits<uint64_t>::max();
+  // retired objects after which retire tries to reclaim
+  static constexpr size_t RECLAIM_THRESHOLD = 64;
+
+  // one cache line per thread, so pinning does not write memory shared with other threads
+  struct alignas(64) Slot
+  {
+    std::atomic<uint64_t> epoch{IDLE};
+    // nesting depth of guards, only accessed by the owning thread
+    uint32_t depth = 0;
+  };
+
+  struct Retired
+  {
+    uint64_t epoch;
+    std::function<void()> deleter;
+  };
+
+  size_t enter();
+  void leave(size_t slot);
+
+  std::array<Slot,MAX_THREADS> m_slots{};
+  alignas(64) std::atomic<uint64_t> m_epoch{1};
+  mutable std::mutex m_mutex;
+  std::vector<Retired> m_retired;
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cinttypes>
+#include <map>
+#include <vector>
+
+#include "DBException.hpp"
+
+inline constexpr uint32_t EXTENT_COMPRESSED = 1;
+// extents are allocated in multiples of the granule
+inline constexpr uint64_t EXTENT_GRANULE = 256;
+
+#pragma pack(1)
+struct Extent
+{
+  uint64_t offset = 0;
+  // stored bytes, 0 when the page was never written
+  uint32_t length = 0;
+  uint32_t flags = 0;
+
+  [[nodiscard]] uint64_t capacity() const noexcept
+  {
+    return (length+EXTENT_GRANULE-1)/EXTENT_GRANULE*EXTENT_GRANULE;
+  }
+};
+#pragma pack()
+
+// Page table of a compressed database file
+// Maps every page number to the variable size extent it is stored in, and keeps track of the free space in the file
+class ExtentMap
+{
+public:
+  explicit ExtentMap(uint64_t dataStart):
+  m_dataStart(dataStart),
+  m_end(dataStart)
+  {
+  }
+
+  [[nodiscard]] Extent& operator[](size_t pageNum)
+  {
+    if(pageNum>=m_extents.size())
+    {
+      m_extents.resize(pageNum+1);
+    }
+    return m_extents[pageNum];
+  }
+
+  [[nodiscard]] const std::vector<Extent>& extents() const noexcept
+  {
+    return m_extents;
+  }
+
+  // replaces the map and derives the free space from the gaps between the extents, reserved is kept in use
+  void assign(std::vector<Extent> extents, const Extent& reserved)
+  {
+    m_extents = std::move(extents);
+    m_free.clear();
+    m_retired.clear();
+    std::map<uint64_t,uint64_t> used;
+    for(const auto& extent: m_extents)
+    {
+      if(extent.length!=0)
+      {
+        used.emplace(extent.offset,extent.capacity());
+      }
+    }
+    if(reserved.length!=0)
+    {
+      used.emplace(reserved.offset,reserved.capacity());
+    }
+    m_end = m_dataStart;
+    for(auto [offset,capacity]: used)
+    {
+      if(offset<m_end)
+      {
+        throw DBException(fmt::format("Overlapping extents at offset {}",offset));
+      }
+      if(offset>m_end)
+      {
+        m_free.emplace(m_end,offset-m_end);
+      }
+      m_end = offset+capacity;
+    }
+  }
+
+  // offset of free space for length bytes, first fit or the end of the file
+  [[nodiscard]] uint64_t allocate(uint64_t length)
+  {
+    const uint64_t capacity = (length+EXTENT_GRANULE-1)/EXTENT_GRANULE*EXTENT_GRANULE;
+    for(auto it = m_free.begin(); it!=m_free.end(); ++it)
+    {
+      if(it->second>=capacity)
+      {
+        const uint64_t offset = it->first;
+        const uint64_t remaining = it->second-capacity;
+        m_free.erase(it);
+        if(remaining!=0)
+        {
+          m_free.emplace(offset+capacity,remaining);
+        }
+        return offset;
+      }
+    }
+    const uint64_t offset = m_end;
+    m_end += capacity;
+    return offset;
+  }
+
+  void release(const Extent& extent)
+  {
+    if(extent.length==0)
+    {
+      return;
+    }
+    auto [it,inserted] = m_free.emplace(extent.offset,extent.capacity());
+    // merge with the neighbouring free ranges
+    if(auto next = std::next(it); next!=m_free.end() && it->first+it->second==next->first)
+    {
+      it->second += next->second;
+      m_free.erase(next);
+    }
+    if(it!=m_free.begin())
+    {
+      if(auto prev = std::prev(it); prev->first+prev->second==it->first)
+      {
+        prev->second += it->second;
+        m_free.erase(it);
+        it = prev;
+      }
+    }
+    if(it->first+it->second==m_end)
+    {
+      m_end = it->first;
+      m_free.erase(it);
+    }
+  }
+
+  // Frees extent once commit is called, for extents the map on disk still refers to
+  void retire(const Extent& extent)
+  {
+    if(extent.length!=0)
+    {
+      m_retired.push_back(extent);
+    }
+  }
+
+  // the map on disk no longer refers to the retired extents, their space can be reused
+  void commit()
+  {
+    for(const auto& extent: m_retired)
+    {
+      release(extent);
+    }
+    m_retired.clear();
+  }
+
+  [[nodiscard]] uint64_t end() const noexcept
+  {
+    return m_end;
+  }
+
+  [[nodiscard]] uint64_t freeBytes() const noexcept
+  {
+    uint64_t ret = 0;
+    for(auto [offset,length]: m_free)
+    {
+      ret += length;
+    }
+    return ret;
+  }
+
+private:
+  uint64_t m_dataStart;
+  uint64_t m_end;
+  std::vector<Extent> m_extents;
+  // offset -> length of unused ranges before m_end
+  std::map<uint64_t,uint64_t> m_free;
+  // replaced extents that are freed on the next commit
+  std::vector<Extent> m_retired;
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <cstring>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include "PageChain.hpp"
+#include "Pager.hpp"
+
+// Open addressing hash set with linear probing of the keys of a table
+// Slots are stored back to back as a control byte and the key, the rows stay in the BTree of the table,
+// so the index costs a few bytes per row and rows changed in place do not make it stale.
+// A lookup of an absent key is answered by probing a single cache line instead of descending the BTree
+// The slot array is persisted verbatim as the records of a page chain, loading it does not rehash,
+// and a write rewrites only the pages of the chain whose slots changed
+template<typename KeyType>
+class HashIndex
+{
+public:
+  explicit HashIndex(size_t capacity = MIN_CAPACITY)
+  {
+    resize(std::bit_ceil(std::max(capacity,MIN_CAPACITY)));
+  }
+
+  [[nodiscard]] bool contains(const KeyType& key) const noexcept
+  {
+    for(size_t slot = home(key);; slot = (slot+1)&m_mask)
+    {
+      const char* data = this->slot(slot);
+      if(*data==EMPTY)
+      {
+        return false;
+      }
+      if(keyOf(data)==key)
+      {
+        return true;
+      }
+    }
+  }
+
+  // adds key, a key that is already in the index is kept
+  void insert(const KeyType& key)
+  {
+    if((m_size+1)*MAX_LOAD_DENOMINATOR>capacity()*MAX_LOAD_NUMERATOR)
+    {
+      resize(capacity()*2);
+    }
+    char* data = probe(key);
+    if(*data==EMPTY)
+    {
+      *data = FULL;
+      std::memcpy(data+1,&key,sizeof(KeyType));
+      ++m_size;
+      m_dirty[static_cast<size_t>(data-m_slots.data())/STRIDE/SLOTS_PER_PAGE] = true;
+    }
+  }
+
+  // removes all keys and keeps the capacity
+  void clear() noexcept
+  {
+    std::fill(m_slots.begin(),m_slots.end(),EMPTY);
+    m_size = 0;
+    std::fill(m_dirty.begin(),m_dirty.end(),true);
+  }
+
+  [[nodiscard]] size_t size() const noexcept
+  {
+    return m_size;
+  }
+
+  [[nodiscard]] size_t capacity() const noexcept
+  {
+    return m_mask+1;
+  }
+
+  // Writes the pages of the slot array that changed to the chain starting at head
+  // The whole chain is rewritten when the index was resized
+  void write(Pager& pager, PageNum head)
+  {
+    if(m_pages.empty())
+    {
+      for(PageNum pageNum = head; pageNum!=INVALID_PAGE; pageNum = pager.get(pageNum).header.next)
+      {
+        m_pages.push_back(pageNum);
+      }
+    }
+    if(m_pages.size()!=m_dirty.size())
+    {
+      PageChainWriter writer(pager,head,PageType::HASH_INDEX,STRIDE);
+      for(size_t i=0; i<capacity(); ++i)
+      {
+        writer.append(std::span<const char>(slot(i),STRIDE));
+      }
+      writer.finish();
+      m_pages.clear();
+      std::fill(m_dirty.begin(),m_dirty.end(),false);
+      return;
+    }
+    for(size_t index=0; index<m_pages.size(); ++index)
+    {
+      if(!m_dirty[index])
+      {
+        continue;
+      }
+      const size_t first = index*SLOTS_PER_PAGE;
+      const size_t count = std::min(SLOTS_PER_PAGE,capacity()-first);
+      auto& page = pager.get(m_pages[index]);
+      const PageNum next = page.header.next;
+      page.header = PageHeader{};
+      page.header.type = PageType::HASH_INDEX;
+      page.header.next = next;
+      page.header.count = static_cast<uint32_t>(count);
+      std::memcpy(page.payload.data(),slot(first),count*STRIDE);
+      pager.markDirty(m_pages[index]);
+      m_dirty[index] = false;
+    }
+  }
+
+  // the defragmenter moved pages of the chain, they are looked up again by the next write
+  void pagesMoved() noexcept
+  {
+    m_pages.clear();
+  }
+
+  // reads an index written by write, the capacity is the number of records in the chain
+  static HashIndex read(Pager& pager, PageNum head)
+  {
+    HashIndex ret;
+    std::vector<char> slots;
+    std::vector<PageNum> pages;
+    for(PageNum pageNum = head; pageNum!=INVALID_PAGE;)
+    {
+      const auto& page = pager.get(pageNum);
+      pages.push_back(pageNum);
+      slots.insert(slots.end(),page.payload.data(),page.payload.data()+page.header.count*STRIDE);
+      pageNum = page.header.next;
+    }
+    const size_t capacity = slots.size()/STRIDE;
+    if(capacity<MIN_CAPACITY || !std::has_single_bit(capacity))
+    {
+      throw PagerException(fmt::format("Hash index at page {} has invalid capacity {}",head,capacity));
+    }
+    size_t size = 0;
+    for(size_t offset = 0; offset<slots.size(); offset += STRIDE)
+    {
+      size += slots[offset]==FULL;
+    }
+    ret.m_slots = std::move(slots);
+    ret.m_mask = capacity-1;
+    ret.m_size = size;
+    ret.m_dirty.assign((capacity+SLOTS_PER_PAGE-1)/SLOTS_PER_PAGE,false);
+    ret.m_pages = std::move(pages);
+    return ret;
+  }
+
+private:
+  static constexpr char EMPTY = 0;
+  static constexpr char FULL = 1;
+  static constexpr size_t MIN_CAPACITY = 16;
+  // resize when more than 7/10 of the slots are used, linear probing degrades quickly above that
+  static constexpr size_t MAX_LOAD_NUMERATOR = 7;
+  static constexpr size_t MAX_LOAD_DENOMINATOR = 10;
+  // control byte and key
+  static constexpr size_t STRIDE = 1+sizeof(KeyType);
+  // slots per page of the chain
+  static constexpr size_t SLOTS_PER_PAGE = PAGE_PAYLOAD_SIZE/STRIDE;
+
+  [[nodiscard]] size_t home(const KeyType& key) const noexcept
+  {
+    // fibonacci hashing spreads sequential keys over the table
+    const uint64_t hash = static_cast<uint64_t>(std::hash<KeyType>{}(key))*0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(hash>>32)&m_mask;
+  }
+
+  [[nodiscard]] const char* slot(size_t index) const noexcept
+  {
+    return m_slots.data()+index*STRIDE;
+  }
+
+  [[nodiscard]] char* slot(size_t index) noexcept
+  {
+    return m_slots.data()+index*STRIDE;
+  }
+
+  [[nodiscard]] static KeyType keyOf(const char* data) noexcept
+  {
+    KeyType key;
+    std::memcpy(&key,data+1,sizeof(KeyType));
+    return key;
+  }
+
+  // slot holding key or the empty slot where key belongs
+  char* probe(const KeyType& key) noexcept
+  {
+    for(size_t index = home(key);; index = (index+1)&m_mask)
+    {
+      char* data = slot(index);
+      if(*data==EMPTY || keyOf(data)==key)
+      {
+        return data;
+      }
+    }
+  }
+
+  void resize(size_t capacity)
+  {
+    std::vector<char> old(capacity*STRIDE,EMPTY);
+    std::swap(old,m_slots);
+    m_mask = capacity-1;
+    m_dirty.assign((capacity+SLOTS_PER_PAGE-1)/SLOTS_PER_PAGE,true);
+    for(size_t offset = 0; offset<old.size(); offset += STRIDE)
+    {
+      if(old[offset]==FULL)
+      {
+        std::memcpy(probe(keyOf(&old[offset])),&old[offset],STRIDE);
+      }
+    }
+  }
+
+  size_t m_mask = 0;
+  size_t m_size = 0;
+  std::vector<char> m_slots;
+  // pages of the slot array changed since the last write
+  std::vector<bool> m_dirty;
+  // pages of the chain in chain order, empty when they are not known
+  std::vector<PageNum> m_pages;
+};
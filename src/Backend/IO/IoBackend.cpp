@@ -0,0 +1,57 @@
+#include "IoBackend.hpp"
+#include "IoUringBackend.hpp"
+#include "ThreadPoolBackend.hpp"
+
+#include <algorithm>
+
+std::vector<ssize_t> IoBackend::execute(std::span<IoRequest> requests)
+{
+  std::vector<ssize_t> results(requests.size());
+  std::vector<IoCompletion> completions;
+  for(size_t i=0; i<requests.size(); ++i)
+  {
+    requests[i].userData = i;
+  }
+  size_t submitted = 0;
+  size_t completed = 0;
+  while(completed<requests.size())
+  {
+    const size_t inFlight = submitted-completed;
+    const size_t count = std::min<size_t>(requests.size()-submitted,queueDepth()-inFlight);
+    if(count!=0)
+    {
+      submit(requests.subspan(submitted,count));
+      submitted += count;
+    }
+    completions.clear();
+    wait(completions,1);
+    for(const auto& completion: completions)
+    {
+      results[completion.userData] = completion.result;
+    }
+    completed += completions.size();
+  }
+  return results;
+}
+
+std::unique_ptr<IoBackend> makeIoBackend(IoBackendType type, unsigned queueDepth)
+{
+  switch (type)
+  {
+    case IoBackendType::IO_URING:
+      return std::make_unique<IoUringBackend>(queueDepth);
+    case IoBackendType::THREAD_POOL:
+      return std::make_unique<ThreadPoolBackend>(queueDepth);
+    case IoBackendType::AUTO:
+      try
+      {
+        return std::make_unique<IoUringBackend>(queueDepth);
+      }
+      catch(const IoException&)
+      {
+        // io_uring disabled, not supported by the kernel or without read and write operations (before Linux 5.6)
+        return std::make_unique<ThreadPoolBackend>(queueDepth);
+      }
+  }
+  throw IoException("Unknown I/O backend");
+}
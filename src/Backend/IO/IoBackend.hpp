@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cinttypes>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+#include "DBException.hpp"
+
+class IoException : public DBException
+{
+public:
+  IoException(const std::string& msg) : DBException(fmt::format("<IO>: \"{}\"", msg)) {}
+  virtual ~IoException() noexcept = default;
+};
+
+enum class IoOp : uint8_t
+{
+  READ,
+  WRITE
+};
+
+struct IoRequest
+{
+  IoOp op = IoOp::READ;
+  int fd = -1;
+  char* buffer = nullptr;
+  size_t size = 0;
+  off_t offset = 0;
+  uint64_t userData = 0;
+};
+
+struct IoCompletion
+{
+  uint64_t userData = 0;
+  // transferred bytes, or -errno on failure
+  ssize_t result = 0;
+};
+
+enum class IoBackendType : uint8_t
+{
+  // io_uring when the kernel allows it, thread pool otherwise
+  AUTO,
+  IO_URING,
+  THREAD_POOL
+};
+
+inline constexpr unsigned DEFAULT_QUEUE_DEPTH = 64;
+
+// Asynchronous block I/O used by the pager for batched reads and writes
+// At most queueDepth requests may be in flight at any time
+class IoBackend
+{
+public:
+  IoBackend() = default;
+  IoBackend(const IoBackend&) = delete;
+  IoBackend(IoBackend&&) = delete;
+  IoBackend& operator=(const IoBackend&) = delete;
+  IoBackend& operator=(IoBackend&&) = delete;
+  virtual ~IoBackend() = default;
+
+  virtual void submit(std::span<const IoRequest> requests) = 0;
+  // appends at least minCompletions completions, blocks until they are available
+  virtual void wait(std::vector<IoCompletion>& completions, size_t minCompletions) = 0;
+
+  [[nodiscard]] virtual unsigned queueDepth() const noexcept = 0;
+  [[nodiscard]] virtual std::string_view name() const noexcept = 0;
+
+  // Runs all requests keeping up to queueDepth of them in flight
+  // Returns the result of every request in the order of requests, userData is overwritten
+  std::vector<ssize_t> execute(std::span<IoRequest> requests);
+};
+
+// throws IoException when the requested backend is not available
+[[nodiscard]] std::unique_ptr<IoBackend> makeIoBackend(IoBackendType type, unsigned queueDepth = DEFAULT_QUEUE_DEPTH);
@@ -0,0 +1,211 @@
+#include "IoUringBackend.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+int io_uring_setup(unsigned entries, io_uring_params* params)
+{
+  return static_cast<int>(::syscall(__NR_io_uring_setup,entries,params));
+}
+
+int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+  return static_cast<int>(::syscall(__NR_io_uring_enter,fd,toSubmit,minComplete,flags,nullptr,0));
+}
+
+int io_uring_register(int fd, unsigned opcode, void* arg, unsigned args)
+{
+  return static_cast<int>(::syscall(__NR_io_uring_register,fd,opcode,arg,args));
+}
+
+// IORING_OP_READ and IORING_OP_WRITE came with Linux 5.6 like the probe, on older kernels
+// io_uring_setup succeeds but every read or write fails with EINVAL
+bool supportsReadWrite(int fd)
+{
+  constexpr unsigned ops = 256;
+  std::vector<char> buffer(sizeof(io_uring_probe)+ops*sizeof(io_uring_probe_op),0);
+  auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+  if(io_uring_register(fd,IORING_REGISTER_PROBE,probe,ops)<0)
+  {
+    return false;
+  }
+  const auto supported = [&](unsigned op)
+  {
+    return op<=probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+  };
+  return supported(IORING_OP_READ) && supported(IORING_OP_WRITE);
+}
+
+template<typename T>
+T* ringPointer(void* ring, uint32_t offset)
+{
+  return reinterpret_cast<T*>(static_cast<char*>(ring)+offset);
+}
+
+void* mapRing(int fd, size_t size, off_t offset)
+{
+  void* ret = ::mmap(nullptr,size,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,fd,offset);
+  if(ret==MAP_FAILED)
+  {
+    throw IoException(fmt::format("Unable to map io_uring: {}",std::strerror(errno)));
+  }
+  return ret;
+}
+}
+
+IoUringBackend::IoUringBackend(unsigned queueDepth)
+{
+  io_uring_params params{};
+  m_fd = io_uring_setup(queueDepth,&params);
+  if(m_fd<0)
+  {
+    throw IoException(fmt::format("Unable to set up io_uring: {}",std::strerror(errno)));
+  }
+  if(!supportsReadWrite(m_fd))
+  {
+    ::close(m_fd);
+    m_fd = -1;
+    throw IoException("io_uring of this kernel does not support IORING_OP_READ and IORING_OP_WRITE");
+  }
+  m_entries = params.sq_entries;
+
+  try
+  {
+    m_sqRingSize = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      m_sqRingSize = std::max(m_sqRingSize,m_cqRingSize);
+      m_sqRing = mapRing(m_fd,m_sqRingSize,IORING_OFF_SQ_RING);
+      m_cqRing = m_sqRing;
+    }
+    else
+    {
+      m_sqRing = mapRing(m_fd,m_sqRingSize,IORING_OFF_SQ_RING);
+      m_cqRing = mapRing(m_fd,m_cqRingSize,IORING_OFF_CQ_RING);
+    }
+    m_sqesSize = params.sq_entries*sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe*>(mapRing(m_fd,m_sqesSize,IORING_OFF_SQES));
+  }
+  catch(const IoException&)
+  {
+    unmap();
+    throw;
+  }
+
+  m_sqHead = ringPointer<unsigned>(m_sqRing,params.sq_off.head);
+  m_sqTail = ringPointer<unsigned>(m_sqRing,params.sq_off.tail);
+  m_sqMask = *ringPointer<unsigned>(m_sqRing,params.sq_off.ring_mask);
+  m_sqArray = ringPointer<unsigned>(m_sqRing,params.sq_off.array);
+  m_cqHead = ringPointer<unsigned>(m_cqRing,params.cq_off.head);
+  m_cqTail = ringPointer<unsigned>(m_cqRing,params.cq_off.tail);
+  m_cqMask = *ringPointer<unsigned>(m_cqRing,params.cq_off.ring_mask);
+  m_cqes = ringPointer<io_uring_cqe>(m_cqRing,params.cq_off.cqes);
+}
+
+IoUringBackend::~IoUringBackend()
+{
+  unmap();
+}
+
+void IoUringBackend::unmap() noexcept
+{
+  if(m_sqes)
+  {
+    ::munmap(m_sqes,m_sqesSize);
+  }
+  if(m_cqRing && m_cqRing!=m_sqRing)
+  {
+    ::munmap(m_cqRing,m_cqRingSize);
+  }
+  if(m_sqRing)
+  {
+    ::munmap(m_sqRing,m_sqRingSize);
+  }
+  if(m_fd>=0)
+  {
+    ::close(m_fd);
+  }
+  m_sqes = nullptr;
+  m_cqRing = nullptr;
+  m_sqRing = nullptr;
+  m_fd = -1;
+}
+
+void IoUringBackend::submit(std::span<const IoRequest> requests)
+{
+  // the submission queue tail is only written by this thread, the kernel advances the head
+  unsigned tail = *m_sqTail;
+  const unsigned head = std::atomic_ref<unsigned>(*m_sqHead).load(std::memory_order_acquire);
+  if(tail-head+requests.size()>m_entries)
+  {
+    throw IoException("io_uring submission queue full");
+  }
+  for(const auto& request: requests)
+  {
+    const unsigned index = tail & m_sqMask;
+    auto& sqe = m_sqes[index];
+    std::memset(&sqe,0,sizeof(sqe));
+    sqe.opcode = (request.op==IoOp::READ) ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe.fd = request.fd;
+    sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+    sqe.len = static_cast<uint32_t>(request.size);
+    sqe.off = static_cast<uint64_t>(request.offset);
+    sqe.user_data = request.userData;
+    m_sqArray[index] = index;
+    ++tail;
+  }
+  std::atomic_ref<unsigned>(*m_sqTail).store(tail,std::memory_order_release);
+
+  auto toSubmit = static_cast<unsigned>(requests.size());
+  while(toSubmit!=0)
+  {
+    const int ret = io_uring_enter(m_fd,toSubmit,0,0);
+    if(ret<0)
+    {
+      if(errno==EINTR)
+      {
+        continue;
+      }
+      throw IoException(fmt::format("io_uring_enter failed: {}",std::strerror(errno)));
+    }
+    toSubmit -= static_cast<unsigned>(ret);
+  }
+}
+
+size_t IoUringBackend::reap(std::vector<IoCompletion>& completions)
+{
+  unsigned head = *m_cqHead;
+  const unsigned tail = std::atomic_ref<unsigned>(*m_cqTail).load(std::memory_order_acquire);
+  size_t reaped = 0;
+  for(; head!=tail; ++head, ++reaped)
+  {
+    const auto& cqe = m_cqes[head & m_cqMask];
+    completions.push_back(IoCompletion{.userData = cqe.user_data,.result = cqe.res});
+  }
+  std::atomic_ref<unsigned>(*m_cqHead).store(head,std::memory_order_release);
+  return reaped;
+}
+
+void IoUringBackend::wait(std::vector<IoCompletion>& completions, size_t minCompletions)
+{
+  size_t reaped = reap(completions);
+  while(reaped<minCompletions)
+  {
+    const int ret = io_uring_enter(m_fd,0,static_cast<unsigned>(minCompletions-reaped),IORING_ENTER_GETEVENTS);
+    if(ret<0 && errno!=EINTR)
+    {
+      throw IoException(fmt::format("io_uring_enter failed: {}",std::strerror(errno)));
+    }
+    reaped += reap(completions);
+  }
+}
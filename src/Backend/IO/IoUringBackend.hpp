@@ -0,0 +1,50 @@
+#pragma once
+
+#include "IoBackend.hpp"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// io_uring through the raw system calls, so no liburing is needed
+class IoUringBackend : public IoBackend
+{
+public:
+  explicit IoUringBackend(unsigned queueDepth);
+  ~IoUringBackend() override;
+
+  void submit(std::span<const IoRequest> requests) override;
+  void wait(std::vector<IoCompletion>& completions, size_t minCompletions) override;
+
+  [[nodiscard]] unsigned queueDepth() const noexcept override
+  {
+    return m_entries;
+  }
+
+  [[nodiscard]] std::string_view name() const noexcept override
+  {
+    return "io_uring";
+  }
+
+private:
+  void unmap() noexcept;
+  size_t reap(std::vector<IoCompletion>& completions);
+
+  int m_fd = -1;
+  unsigned m_entries = 0;
+
+  void* m_sqRing = nullptr;
+  size_t m_sqRingSize = 0;
+  void* m_cqRing = nullptr;
+  size_t m_cqRingSize = 0;
+  io_uring_sqe* m_sqes = nullptr;
+  size_t m_sqesSize = 0;
+
+  unsigned* m_sqHead = nullptr;
+  unsigned* m_sqTail = nullptr;
+  unsigned m_sqMask = 0;
+  unsigned* m_sqArray = nullptr;
+  unsigned* m_cqHead = nullptr;
+  unsigned* m_cqTail = nullptr;
+  unsigned m_cqMask = 0;
+  io_uring_cqe* m_cqes = nullptr;
+};
@@ -0,0 +1,97 @@
+#include "ThreadPoolBackend.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+
+namespace
+{
+constexpr unsigned MAX_WORKERS = 16;
+
+ssize_t transfer(const IoRequest& request)
+{
+  size_t done = 0;
+  while(done<request.size)
+  {
+    const auto offset = request.offset+static_cast<off_t>(done);
+    const ssize_t ret = (request.op==IoOp::READ)
+      ? ::pread(request.fd,request.buffer+done,request.size-done,offset)
+      : ::pwrite(request.fd,request.buffer+done,request.size-done,offset);
+    if(ret<0)
+    {
+      if(errno==EINTR)
+      {
+        continue;
+      }
+      return -errno;
+    }
+    if(ret==0)
+    {
+      break;
+    }
+    done += static_cast<size_t>(ret);
+  }
+  return static_cast<ssize_t>(done);
+}
+}
+
+ThreadPoolBackend::ThreadPoolBackend(unsigned queueDepth):
+m_queueDepth(std::max(1u,queueDepth))
+{
+  const unsigned workers = std::min(m_queueDepth,MAX_WORKERS);
+  m_workers.reserve(workers);
+  for(unsigned i=0; i<workers; ++i)
+  {
+    m_workers.emplace_back([this](){ work(); });
+  }
+}
+
+ThreadPoolBackend::~ThreadPoolBackend()
+{
+  {
+    std::lock_guard lock(m_mutex);
+    m_stop = true;
+  }
+  m_requestAvailable.notify_all();
+  for(auto& worker: m_workers)
+  {
+    worker.join();
+  }
+}
+
+void ThreadPoolBackend::submit(std::span<const IoRequest> requests)
+{
+  {
+    std::lock_guard lock(m_mutex);
+    m_requests.insert(m_requests.end(),requests.begin(),requests.end());
+  }
+  m_requestAvailable.notify_all();
+}
+
+void ThreadPoolBackend::wait(std::vector<IoCompletion>& completions, size_t minCompletions)
+{
+  std::unique_lock lock(m_mutex);
+  m_completionAvailable.wait(lock,[&](){ return m_completions.size()>=minCompletions; });
+  completions.insert(completions.end(),m_completions.begin(),m_completions.end());
+  m_completions.clear();
+}
+
+void ThreadPoolBackend::work()
+{
+  std::unique_lock lock(m_mutex);
+  while(true)
+  {
+    m_requestAvailable.wait(lock,[&](){ return m_stop || !m_requests.empty(); });
+    if(m_stop)
+    {
+      return;
+    }
+    const auto request = m_requests.front();
+    m_requests.pop_front();
+    lock.unlock();
+    const auto result = transfer(request);
+    lock.lock();
+    m_completions.push_back(IoCompletion{.userData = request.userData,.result = result});
+    m_completionAvailable.notify_all();
+  }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "IoBackend.hpp"
+
+// Blocking pread/pwrite on a pool of worker threads, for kernels without io_uring
+class ThreadPoolBackend : public IoBackend
+{
+public:
+  // one worker per queue slot up to a small maximum, more blocking threads only add context switches
+  explicit ThreadPoolBackend(unsigned queueDepth);
+  ~ThreadPoolBackend() override;
+
+  void submit(std::span<const IoRequest> requests) override;
+  void wait(std::vector<IoCompletion>& completions, size_t minCompletions) override;
+
+  [[nodiscard]] unsigned queueDepth() const noexcept override
+  {
+    return m_queueDepth;
+  }
+
+  [[nodiscard]] std::string_view name() const noexcept override
+  {
+    return "thread pool";
+  }
+
+private:
+  void work();
+
+  unsigned m_queueDepth;
+  std::mutex m_mutex;
+  std::condition_variable m_requestAvailable;
+  std::condition_variable m_completionAvailable;
+  std::deque<IoRequest> m_requests;
+  std::vector<IoCompletion> m_completions;
+  bool m_stop = false;
+  std::vector<std::thread> m_workers;
+};
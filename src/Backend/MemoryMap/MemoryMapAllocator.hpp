@@ -39,6 +39,9 @@
 
 // a total of TOTAL_DATA_SIZE/PAGE_SIZE extra data is needed for storing the pageTable
 
+// The page chains of the tables are kept in this order by Defragmenter.hpp, Pager::swap exchanges
+// two pages through the extent map of compressed files without moving their data
+
 // Option 2
 
 
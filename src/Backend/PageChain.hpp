@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstring>
+#include <span>
+
+#include "Pager.hpp"
+
+// Writes fixed size records into a linked list of pages starting at head
+// Pages of the previous contents of the chain are reused, surplus pages are released on finish
+class PageChainWriter
+{
+public:
+  PageChainWriter(Pager& pager, PageNum head, PageType type, size_t recordSize):
+  PageChainWriter(pager,head,type,recordSize,PAGE_PAYLOAD_SIZE/recordSize)
+  {
+  }
+
+  // pages hold recordsPerPage records, for page formats that place the records themselves with emplace
+  PageChainWriter(Pager& pager, PageNum head, PageType type, size_t recordSize, size_t recordsPerPage):
+  m_pager(pager),
+  m_type(type),
+  m_recordSize(recordSize),
+  m_recordsPerPage(recordsPerPage),
+  m_head(head),
+  m_current(head)
+  {
+    if(m_recordsPerPage==0)
+    {
+      throw PagerException(fmt::format("Record size {} exceeds page payload",recordSize));
+    }
+    m_oldNext = m_pager.get(m_current).header.next;
+    reset(m_current);
+  }
+
+  PageChainWriter(const PageChainWriter&) = delete;
+  PageChainWriter(PageChainWriter&&) = delete;
+  PageChainWriter& operator=(const PageChainWriter&) = delete;
+  PageChainWriter& operator=(PageChainWriter&&) = delete;
+  ~PageChainWriter() = default;
+
+  // record is copied into the chain, shorter records are zero padded
+  void append(std::span<const char> record)
+  {
+    if(m_count==m_recordsPerPage)
+    {
+      advance();
+    }
+    auto& page = m_pager.get(m_current);
+    auto* destination = page.payload.data()+m_count*m_recordSize;
+    std::memcpy(destination,record.data(),std::min(record.size(),m_recordSize));
+    if(record.size()<m_recordSize)
+    {
+      std::memset(destination+record.size(),0,m_recordSize-record.size());
+    }
+    page.header.count = static_cast<uint32_t>(++m_count);
+    m_pager.markDirty(m_current);
+  }
+
+  // Claims the next record of the chain, write(page, index) stores it in the page
+  template<typename Write>
+  void emplace(Write&& write)
+  {
+    if(m_count==m_recordsPerPage)
+    {
+      advance();
+    }
+    auto& page = m_pager.get(m_current);
+    write(page,static_cast<uint32_t>(m_count));
+    page.header.count = static_cast<uint32_t>(++m_count);
+    m_pager.markDirty(m_current);
+  }
+
+  // returns the head of the chain
+  PageNum finish()
+  {
+    for(PageNum pageNum = m_oldNext; pageNum!=INVALID_PAGE;)
+    {
+      const PageNum next = m_pager.get(pageNum).header.next;
+      m_pager.release(pageNum);
+      pageNum = next;
+    }
+    m_oldNext = INVALID_PAGE;
+    return m_head;
+  }
+
+private:
+  void advance()
+  {
+    PageNum next = m_oldNext;
+    if(next!=INVALID_PAGE)
+    {
+      m_oldNext = m_pager.get(next).header.next;
+    }
+    else
+    {
+      next = m_pager.allocate();
+    }
+    m_pager.get(m_current).header.next = next;
+    m_pager.markDirty(m_current);
+    m_current = next;
+    reset(m_current);
+  }
+
+  void reset(PageNum pageNum)
+  {
+    auto& page = m_pager.get(pageNum);
+    page.header = PageHeader{};
+    page.header.type = m_type;
+    m_pager.markDirty(pageNum);
+    m_count = 0;
+  }
+
+  Pager& m_pager;
+  PageType m_type;
+  size_t m_recordSize;
+  size_t m_recordsPerPage;
+  PageNum m_head;
+  PageNum m_current;
+  // remainder of the chain that has not been overwritten yet
+  PageNum m_oldNext = INVALID_PAGE;
+  size_t m_count = 0;
+};
+
+// Calls f with every record stored in the chain starting at head
+template<typename F>
+void readPageChain(Pager& pager, PageNum head, size_t recordSize, F&& f)
+{
+  for(PageNum pageNum = head; pageNum!=INVALID_PAGE;)
+  {
+    auto& page = pager.get(pageNum);
+    const PageNum next = page.header.next;
+    const uint32_t count = page.header.count;
+    for(uint32_t i=0; i<count; ++i)
+    {
+      // f may touch the pager and evict the page
+      auto& current = pager.get(pageNum);
+      f(std::span<const char>(current.payload.data()+i*recordSize,recordSize));
+    }
+    pageNum = next;
+  }
+}
+
+// Releases every page of the chain starting at head
+inline void releasePageChain(Pager& pager, PageNum head)
+{
+  for(PageNum pageNum = head; pageNum!=INVALID_PAGE;)
+  {
+    const PageNum next = pager.get(pageNum).header.next;
+    pager.release(pageNum);
+    pageNum = next;
+  }
+}
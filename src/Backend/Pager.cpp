@@ -0,0 +1,1041 @@
+#include "Pager.hpp"
+#include "Crc32c.hpp"
+#include "Compression.hpp"
+#include "Async/Executor.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <memory>
+#include <thread>
+
+namespace
+{
+constexpr std::array<char,16> FILE_MAGIC = {'S','Q','L','i','t','e','C','P','P',' ','d','b'};
+// 2: catalog entries hold the root page of the hash index of the table
+// 3: catalog entries hold the layout of the table
+// 4: hash indexes hold only the keys of the rows
+constexpr uint32_t FILE_VERSION = 4;
+// number of sequential page accesses after which the access pattern is treated as a scan
+constexpr unsigned SCAN_THRESHOLD = 4;
+
+constexpr std::array<char,16> JOURNAL_MAGIC = {'S','Q','L','i','t','e','C','P','P',' ','j','o','u','r','n','l'};
+
+#pragma pack(1)
+// Start of the rollback journal, followed by the records of the journaled pages
+struct JournalHeader
+{
+  std::array<char,16> magic{};
+  // pages in the file at the last commit
+  PageNum pages = 0;
+  uint32_t checksum = 0;
+};
+
+// followed by the committed contents of the page
+struct JournalRecord
+{
+  PageNum pageNum = INVALID_PAGE;
+  // CRC32C of the page number and the page, a torn record fails it
+  uint32_t checksum = 0;
+};
+#pragma pack()
+
+off_t pageOffset(PageNum pageNum)
+{
+  return static_cast<off_t>(pageNum) * static_cast<off_t>(PAGE_SIZE);
+}
+
+uint32_t headerChecksum(const JournalHeader& header)
+{
+  return crc32c(std::span<const char>(reinterpret_cast<const char*>(&header),offsetof(JournalHeader,checksum)));
+}
+
+uint32_t recordChecksum(PageNum pageNum, const Page& page)
+{
+  const uint32_t crc = crc32c(std::span<const char>(reinterpret_cast<const char*>(&pageNum),sizeof(pageNum)));
+  return crc32c(std::span<const char>(reinterpret_cast<const char*>(&page),PAGE_SIZE),crc);
+}
+
+void syncFile(int fd, const std::string& filename)
+{
+  if(::fsync(fd)!=0)
+  {
+    throw PagerException(fmt::format("Unable to sync file {}: {}",filename,std::strerror(errno)));
+  }
+}
+}
+
+Pager::Pager(const std::string& filename, size_t poolSize):
+Pager(filename,PagerOptions{.poolSize = poolSize})
+{
+}
+
+Pager::Pager(const std::string& filename, const PagerOptions& options):
+m_filename(filename),
+m_io(makeIoBackend(options.ioBackend,options.queueDepth)),
+m_readAhead(options.readAhead),
+m_ringStart(options.poolSize),
+// the ring holds two read ahead batches so the pages of the previous batch stay valid
+m_pool(options.poolSize+(options.readAhead!=0 ? 2*(options.readAhead+1) : 0)),
+m_frames(m_pool.size())
+{
+  if(options.poolSize==0)
+  {
+    throw PagerException("Buffer pool needs at least one frame");
+  }
+  if(options.directIo && options.compressPages)
+  {
+    throw PagerException("Direct I/O is not supported for compressed files");
+  }
+  const int flags = O_RDWR | O_CREAT | (options.directIo ? O_DIRECT : 0);
+  m_fd = ::open(filename.c_str(), flags, S_IRUSR | S_IWUSR);
+  if(m_fd<0)
+  {
+    throw PagerException(fmt::format("Unable to open file {}: {}",filename,std::strerror(errno)));
+  }
+  m_journalName = filename+"-journal";
+  for(size_t i=0; i<options.poolSize; ++i)
+  {
+    m_frames[i].lru = m_lru.insert(m_lru.end(),i);
+  }
+  try
+  {
+    recoverJournal();
+    readHeader(options.compressPages);
+    if(options.directIo && compressed())
+    {
+      throw PagerException("Direct I/O is not supported for compressed files");
+    }
+  }
+  catch(const DBException&)
+  {
+    ::close(m_fd);
+    throw;
+  }
+}
+
+Pager::~Pager()
+{
+  try
+  {
+    flush();
+    // the journal is empty after the commit
+    if(m_journalFd>=0)
+    {
+      ::unlink(m_journalName.c_str());
+    }
+  }
+  catch(const DBException& e)
+  {
+    fmt::print(stderr,"{}\n",e.what());
+  }
+  if(m_journalFd>=0)
+  {
+    ::close(m_journalFd);
+  }
+  ::close(m_fd);
+}
+
+Page& Pager::get(PageNum pageNum)
+{
+  if(pageNum==0 || pageNum>=m_header.pageCount)
+  {
+    throw PagerException(fmt::format("Page {} out of bounds",pageNum));
+  }
+  const bool scan = sequentialAccess(pageNum);
+  auto& page = m_pool[scan ? scanFrameFor(pageNum) : frameFor(pageNum,true)];
+  m_lastNext = page.header.next;
+  return page;
+}
+
+Task<Page*> Pager::getAsync(Executor& executor, PageNum pageNum)
+{
+  // the extent map of a compressed file may change while an I/O thread reads it
+  if(pageNum==0 || pageNum>=m_header.pageCount || resident(pageNum) || compressed())
+  {
+    co_return &get(pageNum);
+  }
+  const uint64_t writes = m_writes;
+  auto page = std::make_unique<Page>();
+  const bool written = co_await executor.offload([this, pageNum, &page]()
+  {
+    return readRaw(pageNum,*page);
+  });
+  // another coroutine loaded the page or wrote pages while it was read, the read may be stale
+  if(resident(pageNum) || writes!=m_writes)
+  {
+    co_return &get(pageNum);
+  }
+  if(written && page->header.checksum!=checksum(*page))
+  {
+    throw PagerException(fmt::format("Checksum mismatch on page {} of {}, page is corrupt or torn",pageNum,m_filename));
+  }
+  const size_t index = frameFor(pageNum,false);
+  m_pool[index] = *page;
+  co_return &m_pool[index];
+}
+
+Page& Pager::resolve(Swip& swip)
+{
+  if(swip.swizzled())
+  {
+    // hot path, no page table lookup
+    Page* page = swip.page();
+    m_lru.splice(m_lru.begin(),m_lru,m_frames[frameIndex(page)].lru);
+    return *page;
+  }
+  auto& page = get(swip.pageNum());
+  const size_t index = frameIndex(&page);
+  // frames of the scan ring are reused soon, their pages are not swizzled
+  if(!isRingFrame(index))
+  {
+    auto& frame = m_frames[index];
+    unswizzleFrame(frame);
+    frame.swip = &swip;
+    swip.m_word = reinterpret_cast<uintptr_t>(&page);
+  }
+  return page;
+}
+
+void Pager::unswizzle(Swip& swip) noexcept
+{
+  if(swip.swizzled())
+  {
+    unswizzleFrame(m_frames[frameIndex(swip.page())]);
+  }
+}
+
+PageNum Pager::pageNum(const Swip& swip) const noexcept
+{
+  return swip.swizzled() ? m_frames[frameIndex(swip.page())].pageNum : swip.pageNum();
+}
+
+void Pager::unswizzleFrame(Frame& frame) noexcept
+{
+  if(frame.swip)
+  {
+    frame.swip->m_word = Swip::tag(frame.pageNum);
+    frame.swip = nullptr;
+  }
+}
+
+void Pager::markDirty(PageNum pageNum)
+{
+  auto it = m_pageTable.find(pageNum);
+  if(it==m_pageTable.end())
+  {
+    throw PagerException(fmt::format("Page {} marked dirty while not in buffer pool",pageNum));
+  }
+  m_frames[it->second].dirty = true;
+}
+
+PageNum Pager::allocate()
+{
+  PageNum pageNum = m_header.freeList;
+  size_t frame = 0;
+  if(pageNum!=INVALID_PAGE)
+  {
+    frame = frameFor(pageNum,true);
+    m_header.freeList = m_pool[frame].header.next;
+  }
+  else
+  {
+    pageNum = m_header.pageCount++;
+    frame = frameFor(pageNum,false);
+  }
+  m_pool[frame] = Page{};
+  m_frames[frame].dirty = true;
+  return pageNum;
+}
+
+void Pager::release(PageNum pageNum)
+{
+  auto& page = get(pageNum);
+  page.header = PageHeader{};
+  page.header.next = m_header.freeList;
+  m_header.freeList = pageNum;
+  markDirty(pageNum);
+}
+
+void Pager::swap(PageNum lhs, PageNum rhs)
+{
+  if(lhs==rhs)
+  {
+    return;
+  }
+  if(lhs==0 || rhs==0 || lhs>=m_header.pageCount || rhs>=m_header.pageCount)
+  {
+    throw PagerException(fmt::format("Page {} or {} out of bounds",lhs,rhs));
+  }
+  if(compressed() && !resident(lhs) && !resident(rhs))
+  {
+    // operator[] grows the map, a reference taken before the other lookup may dangle
+    const Extent lhsExtent = m_extents[lhs];
+    const Extent rhsExtent = m_extents[rhs];
+    m_extents[lhs] = rhsExtent;
+    m_extents[rhs] = lhsExtent;
+    return;
+  }
+  // get may evict the other page, so both are copied
+  const Page lhsPage = get(lhs);
+  auto& rhsPage = get(rhs);
+  const Page rhsCopy = rhsPage;
+  rhsPage = lhsPage;
+  markDirty(rhs);
+  unswizzleFrame(m_frames[m_pageTable.at(rhs)]);
+  get(lhs) = rhsCopy;
+  markDirty(lhs);
+  unswizzleFrame(m_frames[m_pageTable.at(lhs)]);
+}
+
+void Pager::flush()
+{
+  std::vector<size_t> dirty;
+  for(size_t i=0; i<m_frames.size(); ++i)
+  {
+    if(m_frames[i].pageNum!=INVALID_PAGE && m_frames[i].dirty)
+    {
+      dirty.push_back(i);
+    }
+  }
+
+  if(!compressed())
+  {
+    journalDirty();
+  }
+  // compressed pages are staged in buffers until the whole batch is written
+  std::vector<std::array<char,PAGE_SIZE>> buffers(compressed() ? dirty.size() : 0);
+  std::vector<IoRequest> requests;
+  requests.reserve(dirty.size());
+  for(size_t i=0; i<dirty.size(); ++i)
+  {
+    const size_t index = dirty[i];
+    requests.push_back(writeRequest(m_frames[index].pageNum,m_pool[index],compressed() ? buffers[i].data() : nullptr));
+  }
+  const auto results = m_io->execute(requests);
+  for(size_t i=0; i<dirty.size(); ++i)
+  {
+    auto& frame = m_frames[dirty[i]];
+    if(results[i]!=static_cast<ssize_t>(requests[i].size))
+    {
+      throw PagerException(fmt::format("Unable to write page {}: {}",frame.pageNum,results[i]<0 ? std::strerror(static_cast<int>(-results[i])) : "short write"));
+    }
+    frame.dirty = false;
+  }
+
+  if(compressed())
+  {
+    writeExtentMap();
+  }
+  writeHeader();
+  syncFile(m_fd,m_filename);
+  if(compressed())
+  {
+    // the header on disk refers to the new map now
+    m_extents.commit();
+  }
+  else
+  {
+    commitJournal();
+  }
+}
+
+void Pager::prefetch(std::span<const PageNum> pages)
+{
+  // keep at least half of the pool for pages that are in use
+  const size_t maxPages = std::max<size_t>(1,m_lru.size()/2);
+  std::vector<PageNum> missing;
+  for(auto pageNum: pages)
+  {
+    if(pageNum==0 || pageNum>=m_header.pageCount || m_pageTable.contains(pageNum)
+      || std::find(missing.begin(),missing.end(),pageNum)!=missing.end())
+    {
+      continue;
+    }
+    missing.push_back(pageNum);
+    if(missing.size()==maxPages)
+    {
+      break;
+    }
+  }
+
+  std::vector<size_t> frames;
+  for(size_t i=0; i<missing.size(); ++i)
+  {
+    const size_t index = m_lru.back();
+    m_lru.splice(m_lru.begin(),m_lru,m_frames[index].lru);
+    frames.push_back(index);
+  }
+  loadFrames(missing,frames);
+}
+
+void Pager::loadFrames(std::span<const PageNum> pages, std::span<const size_t> frames)
+{
+  if(pages.empty())
+  {
+    return;
+  }
+
+  // free the frames, writing back the dirty ones in one batch
+  for(auto index: frames)
+  {
+    const auto& frame = m_frames[index];
+    if(frame.pageNum!=INVALID_PAGE && frame.dirty && needsJournal(frame.pageNum))
+    {
+      journalDirty();
+      break;
+    }
+  }
+  std::vector<std::array<char,PAGE_SIZE>> buffers(pages.size());
+  std::vector<IoRequest> requests;
+  for(size_t i=0; i<pages.size(); ++i)
+  {
+    auto& frame = m_frames[frames[i]];
+    if(frame.pageNum!=INVALID_PAGE)
+    {
+      if(frame.dirty)
+      {
+        requests.push_back(writeRequest(frame.pageNum,m_pool[frames[i]],compressed() ? buffers[i].data() : nullptr));
+      }
+      unswizzleFrame(frame);
+      m_pageTable.erase(frame.pageNum);
+    }
+    frame.pageNum = INVALID_PAGE;
+    frame.dirty = false;
+  }
+  auto results = m_io->execute(requests);
+  for(size_t i=0; i<requests.size(); ++i)
+  {
+    if(results[i]!=static_cast<ssize_t>(requests[i].size))
+    {
+      throw PagerException(fmt::format("Unable to write back page: {}",results[i]<0 ? std::strerror(static_cast<int>(-results[i])) : "short write"));
+    }
+  }
+
+  // read all pages, compressed extents are read into the buffers and decoded afterwards
+  requests.clear();
+  std::vector<size_t> requestPage;
+  for(size_t i=0; i<pages.size(); ++i)
+  {
+    const PageNum pageNum = pages[i];
+    if(compressed())
+    {
+      const auto& extents = m_extents.extents();
+      const Extent extent = pageNum<extents.size() ? extents[pageNum] : Extent{};
+      if(extent.length==0)
+      {
+        continue;
+      }
+      requests.push_back(IoRequest{.op = IoOp::READ,.fd = m_fd,.buffer = buffers[i].data(),.size = extent.length,.offset = static_cast<off_t>(extent.offset)});
+    }
+    else
+    {
+      requests.push_back(IoRequest{.op = IoOp::READ,.fd = m_fd,.buffer = reinterpret_cast<char*>(&m_pool[frames[i]]),.size = PAGE_SIZE,.offset = pageOffset(pageNum)});
+    }
+    requestPage.push_back(i);
+  }
+  results = m_io->execute(requests);
+
+  std::vector<bool> loaded(pages.size(),false);
+  for(size_t r=0; r<requests.size(); ++r)
+  {
+    const size_t i = requestPage[r];
+    auto& page = m_pool[frames[i]];
+    if(results[r]!=static_cast<ssize_t>(requests[r].size))
+    {
+      // error or short read at the end of the file, handled by the synchronous path
+      continue;
+    }
+    if(compressed())
+    {
+      decodeExtent(pages[i],m_extents.extents()[pages[i]],buffers[i].data(),page);
+    }
+    if(page.header.checksum!=checksum(page))
+    {
+      throw PagerException(fmt::format("Checksum mismatch on page {} of {}, page is corrupt or torn",pages[i],m_filename));
+    }
+    loaded[i] = true;
+  }
+  for(size_t i=0; i<pages.size(); ++i)
+  {
+    if(!loaded[i])
+    {
+      readPage(pages[i],m_pool[frames[i]]);
+    }
+    m_frames[frames[i]].pageNum = pages[i];
+    m_pageTable.emplace(pages[i],frames[i]);
+  }
+}
+
+uint64_t Pager::storedBytes() const
+{
+  if(!compressed())
+  {
+    return static_cast<uint64_t>(m_header.pageCount)*PAGE_SIZE;
+  }
+  return m_extents.end()-m_extents.freeBytes();
+}
+
+VerifyResult Pager::verify(unsigned threads) const
+{
+  PageNum pages = m_header.pageCount;
+  if(!compressed())
+  {
+    struct stat fileStat{};
+    if(::fstat(m_fd,&fileStat)!=0)
+    {
+      throw PagerException(fmt::format("Unable to stat file {}: {}",m_filename,std::strerror(errno)));
+    }
+    pages = static_cast<PageNum>((static_cast<size_t>(fileStat.st_size)+PAGE_SIZE-1)/PAGE_SIZE);
+  }
+  if(threads==0)
+  {
+    threads = std::max(1u,std::thread::hardware_concurrency());
+  }
+  threads = std::min(threads,std::max<PageNum>(pages,1));
+
+  // every worker checks a contiguous range of pages so reads stay sequential
+  std::vector<std::vector<PageNum>> corrupt(threads);
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  const PageNum pagesPerWorker = (pages+threads-1)/threads;
+  for(unsigned worker=0; worker<threads; ++worker)
+  {
+    workers.emplace_back([&,worker]()
+    {
+      auto page = std::make_unique<Page>();
+      const PageNum first = worker*pagesPerWorker;
+      const PageNum last = std::min(pages,first+pagesPerWorker);
+      for(PageNum pageNum = first; pageNum<last; ++pageNum)
+      {
+        try
+        {
+          if(!loadPage(pageNum,*page) || page->header.checksum!=checksum(*page))
+          {
+            corrupt[worker].push_back(pageNum);
+          }
+        }
+        catch(const PagerException&)
+        {
+          corrupt[worker].push_back(pageNum);
+        }
+      }
+    });
+  }
+  for(auto& thread: workers)
+  {
+    thread.join();
+  }
+
+  VerifyResult result;
+  result.pagesChecked = pages;
+  for(auto& workerPages: corrupt)
+  {
+    result.corruptPages.insert(result.corruptPages.end(),workerPages.begin(),workerPages.end());
+  }
+  return result;
+}
+
+size_t Pager::frameFor(PageNum pageNum, bool load)
+{
+  if(auto it = m_pageTable.find(pageNum); it!=m_pageTable.end())
+  {
+    if(isRingFrame(it->second))
+    {
+      // page read by a scan is used again, move it to the buffer pool
+      return promote(it->second);
+    }
+    auto& frame = m_frames[it->second];
+    m_lru.splice(m_lru.begin(),m_lru,frame.lru);
+    return it->second;
+  }
+
+  // evict the least recently used frame
+  const size_t index = m_lru.back();
+  evict(index);
+  if(load)
+  {
+    readPage(pageNum,m_pool[index]);
+  }
+  else
+  {
+    m_pool[index] = Page{};
+  }
+  auto& frame = m_frames[index];
+  frame.pageNum = pageNum;
+  m_pageTable.emplace(pageNum,index);
+  m_lru.splice(m_lru.begin(),m_lru,frame.lru);
+  return index;
+}
+
+size_t Pager::scanFrameFor(PageNum pageNum)
+{
+  if(auto it = m_pageTable.find(pageNum); it!=m_pageTable.end())
+  {
+    // resident pages stay where they are, the scan does not change their LRU position
+    return it->second;
+  }
+
+  // read pageNum and the following pages into the next frames of the ring
+  std::vector<PageNum> pages;
+  std::vector<size_t> frames;
+  for(PageNum next = pageNum; pages.size()<=m_readAhead && next<m_header.pageCount; ++next)
+  {
+    if(next!=pageNum && m_pageTable.contains(next))
+    {
+      continue;
+    }
+    pages.push_back(next);
+    frames.push_back(m_ringStart+m_ringNext);
+    m_ringNext = (m_ringNext+1)%(m_frames.size()-m_ringStart);
+  }
+  loadFrames(pages,frames);
+  return m_pageTable.at(pageNum);
+}
+
+size_t Pager::promote(size_t ringIndex)
+{
+  const size_t index = m_lru.back();
+  evict(index);
+  auto& ringFrame = m_frames[ringIndex];
+  auto& frame = m_frames[index];
+  m_pool[index] = m_pool[ringIndex];
+  frame.pageNum = ringFrame.pageNum;
+  frame.dirty = ringFrame.dirty;
+  m_pageTable[frame.pageNum] = index;
+  ringFrame.pageNum = INVALID_PAGE;
+  ringFrame.dirty = false;
+  m_lru.splice(m_lru.begin(),m_lru,frame.lru);
+  return index;
+}
+
+void Pager::evict(size_t index)
+{
+  auto& frame = m_frames[index];
+  if(frame.pageNum!=INVALID_PAGE)
+  {
+    if(frame.dirty)
+    {
+      if(needsJournal(frame.pageNum))
+      {
+        journalDirty();
+      }
+      writePage(frame.pageNum,m_pool[index]);
+    }
+    unswizzleFrame(frame);
+    m_pageTable.erase(frame.pageNum);
+  }
+  frame.pageNum = INVALID_PAGE;
+  frame.dirty = false;
+}
+
+bool Pager::sequentialAccess(PageNum pageNum)
+{
+  if(m_readAhead==0)
+  {
+    return false;
+  }
+  if(pageNum!=m_lastAccess)
+  {
+    // the next page in the file or the next page of a page chain
+    const bool sequential = pageNum==m_lastAccess+1 || pageNum==m_lastNext;
+    m_sequentialRun = sequential ? m_sequentialRun+1 : 0;
+    m_lastAccess = pageNum;
+  }
+  return m_sequentialRun>=SCAN_THRESHOLD;
+}
+
+uint32_t Pager::checksum(const Page& page) noexcept
+{
+  const auto* data = reinterpret_cast<const char*>(&page);
+  return crc32c(std::span<const char>(data+sizeof(PageHeader::checksum),PAGE_SIZE-sizeof(PageHeader::checksum)));
+}
+
+void Pager::pread(char* data, size_t size, off_t offset) const
+{
+  size_t done = 0;
+  while(done<size)
+  {
+    auto ret = ::pread(m_fd,data+done,size-done,offset+static_cast<off_t>(done));
+    if(ret<0)
+    {
+      throw PagerException(fmt::format("Unable to read {} at offset {}: {}",m_filename,offset,std::strerror(errno)));
+    }
+    if(ret==0)
+    {
+      throw PagerException(fmt::format("Unexpected end of file {} at offset {}",m_filename,offset));
+    }
+    done += static_cast<size_t>(ret);
+  }
+}
+
+void Pager::pwrite(const char* data, size_t size, off_t offset)
+{
+  size_t done = 0;
+  while(done<size)
+  {
+    auto ret = ::pwrite(m_fd,data+done,size-done,offset+static_cast<off_t>(done));
+    if(ret<0)
+    {
+      throw PagerException(fmt::format("Unable to write {} at offset {}: {}",m_filename,offset,std::strerror(errno)));
+    }
+    done += static_cast<size_t>(ret);
+  }
+}
+
+bool Pager::readRaw(PageNum pageNum, Page& page) const
+{
+  auto* data = reinterpret_cast<char*>(&page);
+  size_t done = 0;
+  while(done<PAGE_SIZE)
+  {
+    auto ret = ::pread(m_fd,data+done,PAGE_SIZE-done,pageOffset(pageNum)+static_cast<off_t>(done));
+    if(ret<0)
+    {
+      throw PagerException(fmt::format("Unable to read page {}: {}",pageNum,std::strerror(errno)));
+    }
+    if(ret==0)
+    {
+      // short file, the remainder of the page was never written
+      std::memset(data+done,0,PAGE_SIZE-done);
+      return done!=0;
+    }
+    done += static_cast<size_t>(ret);
+  }
+  return true;
+}
+
+bool Pager::readExtent(PageNum pageNum, Page& page) const
+{
+  const auto& extents = m_extents.extents();
+  const Extent extent = pageNum<extents.size() ? extents[pageNum] : Extent{};
+  if(extent.length==0)
+  {
+    page = Page{};
+    return false;
+  }
+  auto* data = reinterpret_cast<char*>(&page);
+  if((extent.flags & EXTENT_COMPRESSED)==0)
+  {
+    if(extent.length!=PAGE_SIZE)
+    {
+      throw PagerException(fmt::format("Invalid extent length {} for page {}",extent.length,pageNum));
+    }
+    pread(data,PAGE_SIZE,static_cast<off_t>(extent.offset));
+    return true;
+  }
+  std::array<char,PAGE_SIZE> buffer;
+  if(extent.length>buffer.size())
+  {
+    throw PagerException(fmt::format("Invalid extent length {} for page {}",extent.length,pageNum));
+  }
+  pread(buffer.data(),extent.length,static_cast<off_t>(extent.offset));
+  decodeExtent(pageNum,extent,buffer.data(),page);
+  return true;
+}
+
+void Pager::decodeExtent(PageNum pageNum, const Extent& extent, const char* data, Page& page) const
+{
+  auto* destination = reinterpret_cast<char*>(&page);
+  if((extent.flags & EXTENT_COMPRESSED)==0)
+  {
+    std::memcpy(destination,data,PAGE_SIZE);
+    return;
+  }
+  auto size = lz4Decompress(std::span<const char>(data,extent.length),std::span<char>(destination,PAGE_SIZE));
+  if(!size || *size!=PAGE_SIZE)
+  {
+    throw PagerException(fmt::format("Unable to decompress page {} of {}, page is corrupt",pageNum,m_filename));
+  }
+}
+
+bool Pager::loadPage(PageNum pageNum, Page& page) const
+{
+  // the file header is always stored uncompressed at the start of the file
+  if(compressed() && pageNum!=0)
+  {
+    return readExtent(pageNum,page);
+  }
+  return readRaw(pageNum,page);
+}
+
+void Pager::readPage(PageNum pageNum, Page& page)
+{
+  // pages that were allocated but never written have no checksum yet
+  if(loadPage(pageNum,page) && page.header.checksum!=checksum(page))
+  {
+    throw PagerException(fmt::format("Checksum mismatch on page {} of {}, page is corrupt or torn",pageNum,m_filename));
+  }
+}
+
+void Pager::writePage(PageNum pageNum, Page& page)
+{
+  ++m_writes;
+  page.header.checksum = checksum(page);
+  if(compressed() && pageNum!=0)
+  {
+    writeExtent(pageNum,page);
+    return;
+  }
+  pwrite(reinterpret_cast<const char*>(&page),PAGE_SIZE,pageOffset(pageNum));
+}
+
+void Pager::writeExtent(PageNum pageNum, const Page& page)
+{
+  std::array<char,PAGE_SIZE> buffer;
+  const Extent extent = placeExtent(pageNum,page,buffer.data());
+  const char* data = (extent.flags & EXTENT_COMPRESSED) ? buffer.data() : reinterpret_cast<const char*>(&page);
+  pwrite(data,extent.length,static_cast<off_t>(extent.offset));
+}
+
+Extent Pager::placeExtent(PageNum pageNum, const Page& page, char* buffer)
+{
+  const auto* data = reinterpret_cast<const char*>(&page);
+  // only stored compressed when it saves at least one granule
+  auto size = lz4Compress(std::span<const char>(data,PAGE_SIZE),std::span<char>(buffer,PAGE_SIZE-EXTENT_GRANULE));
+
+  Extent extent;
+  extent.length = static_cast<uint32_t>(size!=0 ? size : PAGE_SIZE);
+  extent.flags = size!=0 ? EXTENT_COMPRESSED : 0;
+
+  // never written in place, the map on disk may still refer to the current extent until the next flush completes
+  auto& current = m_extents[pageNum];
+  m_extents.retire(current);
+  extent.offset = m_extents.allocate(extent.length);
+  current = extent;
+  return extent;
+}
+
+IoRequest Pager::writeRequest(PageNum pageNum, Page& page, char* buffer)
+{
+  ++m_writes;
+  page.header.checksum = checksum(page);
+  auto* data = reinterpret_cast<char*>(&page);
+  if(!compressed())
+  {
+    return IoRequest{.op = IoOp::WRITE,.fd = m_fd,.buffer = data,.size = PAGE_SIZE,.offset = pageOffset(pageNum)};
+  }
+  const Extent extent = placeExtent(pageNum,page,buffer);
+  return IoRequest{.op = IoOp::WRITE,.fd = m_fd,.buffer = (extent.flags & EXTENT_COMPRESSED) ? buffer : data,
+    .size = extent.length,.offset = static_cast<off_t>(extent.offset)};
+}
+
+void Pager::readHeader(bool compressPages)
+{
+  struct stat fileStat{};
+  if(::fstat(m_fd,&fileStat)!=0)
+  {
+    throw PagerException(fmt::format("Unable to stat file {}: {}",m_filename,std::strerror(errno)));
+  }
+  m_committedPages = static_cast<PageNum>(static_cast<size_t>(fileStat.st_size)/PAGE_SIZE);
+  if(fileStat.st_size==0)
+  {
+    // new database file
+    m_header.magic = FILE_MAGIC;
+    m_header.version = FILE_VERSION;
+    m_header.flags = compressPages ? FILE_COMPRESSED : 0;
+    return;
+  }
+
+  Page page;
+  readPage(0,page);
+  std::memcpy(&m_header,page.payload.data(),sizeof(FileHeader));
+  if(page.header.type!=PageType::FILE_HEADER || m_header.magic!=FILE_MAGIC || m_header.version!=FILE_VERSION)
+  {
+    throw PagerException(fmt::format("{} is not a database file",m_filename));
+  }
+  if(compressed())
+  {
+    readExtentMap();
+  }
+}
+
+void Pager::writeHeader()
+{
+  Page page{};
+  page.header.type = PageType::FILE_HEADER;
+  std::memcpy(page.payload.data(),&m_header,sizeof(FileHeader));
+  writePage(0,page);
+}
+
+void Pager::readExtentMap()
+{
+  if(m_header.mapLength%sizeof(Extent)!=0)
+  {
+    throw PagerException(fmt::format("Invalid extent map length {} in {}",m_header.mapLength,m_filename));
+  }
+  std::vector<Extent> extents(m_header.mapLength/sizeof(Extent));
+  auto* data = reinterpret_cast<char*>(extents.data());
+  if(m_header.mapLength!=0)
+  {
+    pread(data,m_header.mapLength,static_cast<off_t>(m_header.mapOffset));
+  }
+  if(crc32c(std::span<const char>(data,m_header.mapLength))!=m_header.mapChecksum)
+  {
+    throw PagerException(fmt::format("Checksum mismatch on extent map of {}",m_filename));
+  }
+  // the map on disk stays in use until the next map has been written
+  m_extents.assign(std::move(extents),Extent{.offset = m_header.mapOffset,.length = m_header.mapLength,.flags = 0});
+}
+
+void Pager::writeExtentMap()
+{
+  const auto& extents = m_extents.extents();
+  const auto* data = reinterpret_cast<const char*>(extents.data());
+  const auto length = static_cast<uint32_t>(extents.size()*sizeof(Extent));
+
+  // The new map never overwrites the old one, and neither the old map nor the extents it refers to
+  // are reused before the header pointing to the new map is synced, so a crash during the flush
+  // leaves the file as it was after the previous flush
+  const Extent oldMap{.offset = m_header.mapOffset,.length = m_header.mapLength,.flags = 0};
+  const uint64_t offset = m_extents.allocate(length);
+  pwrite(data,length,static_cast<off_t>(offset));
+  if(::fsync(m_fd)!=0)
+  {
+    throw PagerException(fmt::format("Unable to sync file {}: {}",m_filename,std::strerror(errno)));
+  }
+  m_header.mapOffset = offset;
+  m_header.mapLength = length;
+  m_header.mapChecksum = crc32c(std::span<const char>(data,length));
+  m_extents.retire(oldMap);
+}
+
+bool Pager::needsJournal(PageNum pageNum) const
+{
+  return !compressed() && (m_journalSize==0 || (pageNum<m_committedPages && !m_journaled.contains(pageNum)));
+}
+
+void Pager::journalDirty()
+{
+  std::vector<PageNum> pages;
+  if(m_committedPages!=0 && !m_journaled.contains(0))
+  {
+    pages.push_back(0);
+  }
+  for(const auto& frame: m_frames)
+  {
+    if(frame.pageNum!=INVALID_PAGE && frame.dirty && frame.pageNum<m_committedPages && !m_journaled.contains(frame.pageNum))
+    {
+      pages.push_back(frame.pageNum);
+    }
+  }
+  if(pages.empty() && m_journalSize!=0)
+  {
+    return;
+  }
+  if(m_journalFd<0)
+  {
+    m_journalFd = ::open(m_journalName.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if(m_journalFd<0)
+    {
+      throw PagerException(fmt::format("Unable to open journal {}: {}",m_journalName,std::strerror(errno)));
+    }
+  }
+
+  // the records are staged and appended with one write
+  std::vector<char> data;
+  if(m_journalSize==0)
+  {
+    JournalHeader header;
+    header.magic = JOURNAL_MAGIC;
+    header.pages = m_committedPages;
+    header.checksum = headerChecksum(header);
+    const auto* bytes = reinterpret_cast<const char*>(&header);
+    data.insert(data.end(),bytes,bytes+sizeof(header));
+  }
+  // aligned for direct I/O
+  auto page = std::make_unique<Page>();
+  for(auto pageNum: pages)
+  {
+    // the file still holds the committed contents, pages are journaled before they are overwritten
+    readRaw(pageNum,*page);
+    const JournalRecord record{.pageNum = pageNum,.checksum = recordChecksum(pageNum,*page)};
+    const auto* bytes = reinterpret_cast<const char*>(&record);
+    data.insert(data.end(),bytes,bytes+sizeof(record));
+    const auto* contents = reinterpret_cast<const char*>(page.get());
+    data.insert(data.end(),contents,contents+PAGE_SIZE);
+  }
+  for(size_t done = 0; done<data.size();)
+  {
+    auto ret = ::pwrite(m_journalFd,data.data()+done,data.size()-done,m_journalSize+static_cast<off_t>(done));
+    if(ret<0)
+    {
+      throw PagerException(fmt::format("Unable to write journal {}: {}",m_journalName,std::strerror(errno)));
+    }
+    done += static_cast<size_t>(ret);
+  }
+  // no page is overwritten before its committed contents are durable
+  syncFile(m_journalFd,m_journalName);
+  m_journalSize += static_cast<off_t>(data.size());
+  m_journaled.insert(pages.begin(),pages.end());
+}
+
+void Pager::commitJournal()
+{
+  if(m_journalSize!=0)
+  {
+    if(::ftruncate(m_journalFd,0)!=0)
+    {
+      throw PagerException(fmt::format("Unable to truncate journal {}: {}",m_journalName,std::strerror(errno)));
+    }
+    syncFile(m_journalFd,m_journalName);
+  }
+  m_journalSize = 0;
+  m_journaled.clear();
+  m_committedPages = m_header.pageCount;
+}
+
+void Pager::recoverJournal()
+{
+  const int fd = ::open(m_journalName.c_str(), O_RDWR);
+  if(fd<0)
+  {
+    if(errno==ENOENT)
+    {
+      return;
+    }
+    throw PagerException(fmt::format("Unable to open journal {}: {}",m_journalName,std::strerror(errno)));
+  }
+  try
+  {
+    // a journal with a torn header was not synced, no page was overwritten after it was started
+    JournalHeader header;
+    if(::pread(fd,&header,sizeof(header),0)==static_cast<ssize_t>(sizeof(header))
+      && header.magic==JOURNAL_MAGIC && header.checksum==headerChecksum(header))
+    {
+      auto page = std::make_unique<Page>();
+      for(off_t offset = sizeof(header);; offset += static_cast<off_t>(sizeof(JournalRecord)+PAGE_SIZE))
+      {
+        // the records after a torn one were never synced
+        JournalRecord record;
+        if(::pread(fd,&record,sizeof(record),offset)!=static_cast<ssize_t>(sizeof(record))
+          || ::pread(fd,page.get(),PAGE_SIZE,offset+static_cast<off_t>(sizeof(record)))!=static_cast<ssize_t>(PAGE_SIZE)
+          || record.checksum!=recordChecksum(record.pageNum,*page))
+        {
+          break;
+        }
+        pwrite(reinterpret_cast<const char*>(page.get()),PAGE_SIZE,pageOffset(record.pageNum));
+      }
+      // pages appended after the last commit are dropped
+      if(::ftruncate(m_fd,pageOffset(header.pages))!=0)
+      {
+        throw PagerException(fmt::format("Unable to truncate file {}: {}",m_filename,std::strerror(errno)));
+      }
+      syncFile(m_fd,m_filename);
+    }
+    ::close(fd);
+  }
+  catch(...)
+  {
+    ::close(fd);
+    throw;
+  }
+  if(::unlink(m_journalName.c_str())!=0)
+  {
+    throw PagerException(fmt::format("Unable to remove journal {}: {}",m_journalName,std::strerror(errno)));
+  }
+}
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <array>
+#include <cinttypes>
+#include <limits>
+#include <list>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "DBException.hpp"
+#include "BTreeForwardDeclares.hpp"
+#include "ExtentMap.hpp"
+#include "IO/IoBackend.hpp"
+#include "Async/Task.hpp"
+
+class Executor;
+
+class PagerException : public DBException
+{
+public:
+  PagerException(const std::string& msg) : DBException(fmt::format("<Pager>: \"{}\"", msg)) {}
+  virtual ~PagerException() noexcept = default;
+};
+
+using PageNum = uint32_t;
+inline constexpr PageNum INVALID_PAGE = std::numeric_limits<PageNum>::max();
+inline constexpr size_t DEFAULT_POOL_SIZE = 256;
+inline constexpr size_t DEFAULT_READ_AHEAD = 8;
+
+enum class PageType : uint8_t
+{
+  FREE,
+  FILE_HEADER,
+  CATALOG,
+  TABLE_DATA,
+  HASH_INDEX,
+  // rows in the PAX layout of PaxPage.hpp
+  TABLE_PAX
+};
+
+#pragma pack(1)
+struct PageHeader
+{
+  // CRC32C of the remainder of the page, set when the page is written and verified when it is read
+  uint32_t checksum = 0;
+  PageType type = PageType::FREE;
+  std::array<uint8_t,3> reserved{};
+  // next page of the chain this page belongs to
+  PageNum next = INVALID_PAGE;
+  // number of records stored in the page
+  uint32_t count = 0;
+};
+#pragma pack()
+
+inline constexpr size_t PAGE_PAYLOAD_SIZE = PAGE_SIZE - sizeof(PageHeader);
+
+struct alignas(PAGE_SIZE) Page
+{
+  PageHeader header;
+  std::array<char,PAGE_PAYLOAD_SIZE> payload;
+};
+static_assert(sizeof(Page)==PAGE_SIZE);
+
+// Contents of page 0 of the database file
+#pragma pack(1)
+struct FileHeader
+{
+  std::array<char,16> magic{};
+  uint32_t version = 0;
+  PageNum pageCount = 1;
+  PageNum freeList = INVALID_PAGE;
+  PageNum catalogRoot = INVALID_PAGE;
+  uint32_t flags = 0;
+  // location of the extent map of a compressed file
+  uint64_t mapOffset = 0;
+  uint32_t mapLength = 0;
+  uint32_t mapChecksum = 0;
+};
+#pragma pack()
+
+inline constexpr uint32_t FILE_COMPRESSED = 1;
+
+// Reference to a page, a pointer to the frame of the page while it is resident (swizzled)
+// and the page number otherwise. Pager::resolve follows a swizzled reference without a page table lookup
+// and swizzles the others, the pager unswizzles the reference when it evicts the page.
+// The pager holds the address of a swizzled reference, so a reference can not be copied or moved
+// and has to be unswizzled with Pager::unswizzle before it is destroyed
+class Swip
+{
+public:
+  explicit Swip(PageNum pageNum) noexcept:
+  m_word(tag(pageNum))
+  {
+  }
+
+  Swip(const Swip&) = delete;
+  Swip(Swip&&) = delete;
+  Swip& operator=(const Swip&) = delete;
+  Swip& operator=(Swip&&) = delete;
+  ~Swip() = default;
+
+  [[nodiscard]] bool swizzled() const noexcept
+  {
+    return (m_word & 1u)==0;
+  }
+
+private:
+  friend class Pager;
+
+  // frames are page aligned, page numbers are tagged with the lowest bit
+  static uintptr_t tag(PageNum pageNum) noexcept
+  {
+    return (static_cast<uintptr_t>(pageNum)<<1) | 1u;
+  }
+
+  [[nodiscard]] PageNum pageNum() const noexcept
+  {
+    return static_cast<PageNum>(m_word>>1);
+  }
+
+  [[nodiscard]] Page* page() const noexcept
+  {
+    return reinterpret_cast<Page*>(m_word);
+  }
+
+  uintptr_t m_word;
+};
+
+struct PagerOptions
+{
+  size_t poolSize = DEFAULT_POOL_SIZE;
+  // Store pages LZ4 compressed in variable size extents, only used when a new file is created
+  bool compressPages = false;
+  IoBackendType ioBackend = IoBackendType::AUTO;
+  unsigned queueDepth = DEFAULT_QUEUE_DEPTH;
+  // Bypass the page cache with O_DIRECT, not supported for compressed files
+  bool directIo = false;
+  // pages read ahead once a sequential scan is detected, 0 disables scan detection
+  size_t readAhead = DEFAULT_READ_AHEAD;
+};
+
+struct VerifyResult
+{
+  PageNum pagesChecked = 0;
+  std::vector<PageNum> corruptPages;
+};
+
+// Single database file, divided in pages of PAGE_SIZE
+// All pages are accessed through a buffer pool with LRU eviction,
+// dirty pages are written back on eviction and on flush
+// Sequential scans are detected and read ahead into a small ring of frames, so a scan
+// does not evict the working set from the buffer pool
+// A flush is atomic: compressed files never overwrite an extent the header on disk refers to, uncompressed files
+// copy the committed contents of a page to the rollback journal <filename>-journal before the page is overwritten
+// in place. A journal left behind by a crash is rolled back when the file is opened
+class Pager
+{
+public:
+  explicit Pager(const std::string& filename, size_t poolSize = DEFAULT_POOL_SIZE);
+  Pager(const std::string& filename, const PagerOptions& options);
+
+  // delete copy and move constructors, pager owns the file descriptor and flushes on destruction
+  Pager(const Pager&) = delete;
+  Pager(Pager&&) = delete;
+  Pager& operator=(const Pager&) = delete;
+  Pager& operator=(Pager&&) = delete;
+  ~Pager();
+
+  // Reference is valid until the next call that may evict a page (get, allocate, release)
+  [[nodiscard]] Page& get(PageNum pageNum);
+  // Coroutine variant of get for event loops, a page that is not resident is read on an I/O thread
+  // of executor while the coroutine is suspended. The page is valid until the next call that may evict a page
+  [[nodiscard]] Task<Page*> getAsync(Executor& executor, PageNum pageNum);
+  void markDirty(PageNum pageNum);
+
+  // Page of swip, swizzling it when the page is loaded into the buffer pool
+  // A page has at most one swizzled reference, resolving another one unswizzles the previous one
+  [[nodiscard]] Page& resolve(Swip& swip);
+  // turns swip back into a page number, it is not referenced by the pager anymore
+  void unswizzle(Swip& swip) noexcept;
+  [[nodiscard]] PageNum pageNum(const Swip& swip) const noexcept;
+
+  // page from the free list or a new page at the end of the file
+  [[nodiscard]] PageNum allocate();
+  void release(PageNum pageNum);
+
+  // Exchanges the contents of two pages, the caller updates the references to them
+  // Compressed files only swap the entries of the extent map when neither page is resident, no data is moved.
+  // Swizzled references to either page are unswizzled
+  void swap(PageNum lhs, PageNum rhs);
+
+  // Writes all dirty pages as one batch of asynchronous writes and commits them
+  void flush();
+
+  // Loads the pages that are not resident yet with one batch of asynchronous reads
+  void prefetch(std::span<const PageNum> pages);
+
+  // Checks the checksum of every page in the file, using threads workers (hardware concurrency when 0)
+  // Only the file is checked, dirty pages in the buffer pool have to be flushed first
+  [[nodiscard]] VerifyResult verify(unsigned threads = 0) const;
+
+  [[nodiscard]] static uint32_t checksum(const Page& page) noexcept;
+
+  [[nodiscard]] PageNum pageCount() const noexcept
+  {
+    return m_header.pageCount;
+  }
+
+  [[nodiscard]] PageNum catalogRoot() const noexcept
+  {
+    return m_header.catalogRoot;
+  }
+
+  void setCatalogRoot(PageNum pageNum) noexcept
+  {
+    m_header.catalogRoot = pageNum;
+  }
+
+  [[nodiscard]] const std::string& filename() const noexcept
+  {
+    return m_filename;
+  }
+
+  [[nodiscard]] bool compressed() const noexcept
+  {
+    return (m_header.flags & FILE_COMPRESSED)!=0;
+  }
+
+  [[nodiscard]] bool resident(PageNum pageNum) const
+  {
+    return m_pageTable.contains(pageNum);
+  }
+
+  [[nodiscard]] std::string_view ioBackend() const noexcept
+  {
+    return m_io->name();
+  }
+
+  // bytes used by the pages in the file, excluding free space
+  [[nodiscard]] uint64_t storedBytes() const;
+
+  // pages written to the file since it was opened, including the file header
+  [[nodiscard]] uint64_t writes() const noexcept
+  {
+    return m_writes;
+  }
+
+private:
+  struct Frame
+  {
+    PageNum pageNum = INVALID_PAGE;
+    bool dirty = false;
+    std::list<size_t>::iterator lru;
+    // reference swizzled to the frame, unswizzled when the page leaves the frame
+    Swip* swip = nullptr;
+  };
+
+  [[nodiscard]] size_t frameIndex(const Page* page) const noexcept
+  {
+    return static_cast<size_t>(page-m_pool.data());
+  }
+  void unswizzleFrame(Frame& frame) noexcept;
+
+  // frame holding pageNum, evicting the least recently used frame when pageNum is not resident
+  size_t frameFor(PageNum pageNum, bool load);
+  // frame holding pageNum during a scan, pages that are not resident are read ahead into the ring
+  size_t scanFrameFor(PageNum pageNum);
+  // moves the page of a ring frame to the buffer pool
+  size_t promote(size_t ringIndex);
+  // writes back the page of the frame when it is dirty and removes it from the page table
+  void evict(size_t index);
+  // reads pages into frames with one batch, evicting the current pages of the frames
+  void loadFrames(std::span<const PageNum> pages, std::span<const size_t> frames);
+  // tracks the access pattern, returns true while the pages are accessed by a sequential scan
+  bool sequentialAccess(PageNum pageNum);
+  [[nodiscard]] bool isRingFrame(size_t index) const noexcept
+  {
+    return index>=m_ringStart;
+  }
+  // returns false when the page was never written and was zero filled
+  bool readRaw(PageNum pageNum, Page& page) const;
+  bool readExtent(PageNum pageNum, Page& page) const;
+  bool loadPage(PageNum pageNum, Page& page) const;
+  void readPage(PageNum pageNum, Page& page);
+  void writePage(PageNum pageNum, Page& page);
+  void writeExtent(PageNum pageNum, const Page& page);
+  // allocates the extent for page, compressing it into buffer when that saves space
+  Extent placeExtent(PageNum pageNum, const Page& page, char* buffer);
+  // write request for page, buffer holds the compressed page for compressed files
+  IoRequest writeRequest(PageNum pageNum, Page& page, char* buffer);
+  void decodeExtent(PageNum pageNum, const Extent& extent, const char* data, Page& page) const;
+  void pread(char* data, size_t size, off_t offset) const;
+  void pwrite(const char* data, size_t size, off_t offset);
+  void readHeader(bool compressPages);
+  void writeHeader();
+  void readExtentMap();
+  void writeExtentMap();
+  // The page has to be journaled before it is overwritten in place, either its committed contents
+  // are not in the journal yet or no journal was started since the last commit
+  [[nodiscard]] bool needsJournal(PageNum pageNum) const;
+  // appends the committed contents of the file header and of all dirty pages that are not journaled yet
+  // to the journal and syncs it
+  void journalDirty();
+  // empties the journal once the flush is synced, the file is not rolled back from here on
+  void commitJournal();
+  // restores the pages of a journal left behind by a crash and removes it
+  void recoverJournal();
+
+  std::string m_filename;
+  int m_fd = -1;
+  FileHeader m_header;
+  std::unique_ptr<IoBackend> m_io;
+  // only used for compressed files
+  ExtentMap m_extents{PAGE_SIZE};
+  // only used for uncompressed files
+  std::string m_journalName;
+  int m_journalFd = -1;
+  off_t m_journalSize = 0;
+  // pages in the file at the last commit, a rollback truncates the pages after them
+  PageNum m_committedPages = 0;
+  std::unordered_set<PageNum> m_journaled;
+
+  size_t m_readAhead;
+  // frames from m_ringStart on form the ring used by scans, they are not part of the LRU list
+  size_t m_ringStart;
+  size_t m_ringNext = 0;
+  PageNum m_lastAccess = INVALID_PAGE;
+  PageNum m_lastNext = INVALID_PAGE;
+  unsigned m_sequentialRun = 0;
+  // pages written to the file, a page read by getAsync is discarded when the file was written meanwhile
+  uint64_t m_writes = 0;
+
+  std::vector<Page> m_pool;
+  std::vector<Frame> m_frames;
+  std::unordered_map<PageNum,size_t> m_pageTable;
+  // front is most recently used
+  std::list<size_t> m_lru;
+};
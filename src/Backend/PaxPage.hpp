@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <cinttypes>
+#include <cstring>
+
+#include "Pager.hpp"
+#include "Schema.hpp"
+
+// How the rows of a table are stored in its pages
+enum class TableLayout : uint8_t
+{
+  // key and row stored together as one record
+  ROW,
+  // PAX, every page holds a mini page per column
+  COLUMNAR
+};
+
+// PAX layout of the rows of a schema inside a page
+// The payload is split into a mini page of keys followed by one mini page per column,
+// every mini page holds the values of that column for all rows of the page.
+// A scan of one column reads only its mini page, a row is still found within a single page
+class PaxLayout
+{
+public:
+  using KeyType = uint32_t;
+
+  explicit PaxLayout(const TableSchema& schema):
+  m_columnCount(schema.columnCount)
+  {
+    for(uint32_t i=0; i<m_columnCount; ++i)
+    {
+      m_sizes[i] = schema.columns[i].size;
+      m_rowOffsets[i] = schema.offset(i);
+    }
+    m_capacity = static_cast<uint32_t>(PAGE_PAYLOAD_SIZE/(sizeof(KeyType)+schema.rowSize()));
+    // mini pages start 8 byte aligned, the padding may cost a few rows
+    while(m_capacity>0 && layout()>PAGE_PAYLOAD_SIZE)
+    {
+      --m_capacity;
+    }
+    if(m_capacity==0)
+    {
+      throw SchemaException(fmt::format("Row size {} exceeds page payload",schema.rowSize()));
+    }
+  }
+
+  // rows per page
+  [[nodiscard]] uint32_t capacity() const noexcept
+  {
+    return m_capacity;
+  }
+
+  [[nodiscard]] uint32_t columnCount() const noexcept
+  {
+    return m_columnCount;
+  }
+
+  [[nodiscard]] uint32_t columnSize(uint32_t column) const noexcept
+  {
+    return m_sizes[column];
+  }
+
+  // values of column for the rows of page, columnSize bytes each
+  [[nodiscard]] const char* column(const Page& page, uint32_t column) const noexcept
+  {
+    return page.payload.data()+m_miniPages[column];
+  }
+
+  [[nodiscard]] KeyType key(const Page& page, uint32_t index) const noexcept
+  {
+    KeyType key;
+    std::memcpy(&key,page.payload.data()+index*sizeof(KeyType),sizeof(key));
+    return key;
+  }
+
+  // scatters row, in the layout of the schema, into the mini pages
+  void write(Page& page, uint32_t index, KeyType key, const char* row) const noexcept
+  {
+    std::memcpy(page.payload.data()+index*sizeof(KeyType),&key,sizeof(key));
+    for(uint32_t i=0; i<m_columnCount; ++i)
+    {
+      std::memcpy(page.payload.data()+m_miniPages[i]+index*m_sizes[i],row+m_rowOffsets[i],m_sizes[i]);
+    }
+  }
+
+  // gathers the row at index from the mini pages
+  void read(const Page& page, uint32_t index, char* row) const noexcept
+  {
+    for(uint32_t i=0; i<m_columnCount; ++i)
+    {
+      std::memcpy(row+m_rowOffsets[i],page.payload.data()+m_miniPages[i]+index*m_sizes[i],m_sizes[i]);
+    }
+  }
+
+private:
+  static constexpr size_t MINI_PAGE_ALIGNMENT = 8;
+
+  static constexpr size_t align(size_t size) noexcept
+  {
+    return (size+MINI_PAGE_ALIGNMENT-1)/MINI_PAGE_ALIGNMENT*MINI_PAGE_ALIGNMENT;
+  }
+
+  // places the mini pages for m_capacity rows, returns the bytes they use
+  size_t layout() noexcept
+  {
+    size_t offset = align(m_capacity*sizeof(KeyType));
+    for(uint32_t i=0; i<m_columnCount; ++i)
+    {
+      m_miniPages[i] = static_cast<uint32_t>(offset);
+      offset = align(offset+m_capacity*m_sizes[i]);
+    }
+    return offset;
+  }
+
+  uint32_t m_columnCount;
+  uint32_t m_capacity = 0;
+  std::array<uint32_t,MAX_COLUMNS> m_sizes{};
+  std::array<uint32_t,MAX_COLUMNS> m_rowOffsets{};
+  // offset of the mini page of each column in the payload
+  std::array<uint32_t,MAX_COLUMNS> m_miniPages{};
+};
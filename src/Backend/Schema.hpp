@@ -0,0 +1,329 @@
+#pragma once
+
+#include <array>
+#include <cinttypes>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <fmt/format.h>
+
+#include "DBException.hpp"
+
+class SchemaException : public DBException 
+{
+public:
+  SchemaException(const std::string& msg) : DBException(fmt::format("<Schema>: \"{}\"", msg)) {}
+  virtual ~SchemaException() noexcept = default;
+};
+
+inline constexpr size_t COLUMN_NAME_SIZE = 16;
+inline constexpr size_t MAX_COLUMNS = 16;
+
+enum class ColumnType : uint8_t
+{
+  UINT32,
+  INT32,
+  INT64,
+  CHAR
+};
+
+#pragma pack(1)
+struct Column
+{
+  std::array<char,COLUMN_NAME_SIZE> name{};
+  ColumnType type = ColumnType::UINT32;
+  // size in bytes of the column, CHAR columns are fixed width
+  uint32_t size = 0;
+};
+#pragma pack()
+
+// Runtime description of the rows of a table as it is stored in the catalog
+// The first column is the primary key and has to be UINT32
+struct TableSchema
+{
+  uint32_t columnCount = 0;
+  std::array<Column,MAX_COLUMNS> columns{};
+
+  TableSchema& add(std::string_view name, ColumnType type, uint32_t size = 0)
+  {
+    if(columnCount>=MAX_COLUMNS)
+    {
+      throw SchemaException("Too many columns");
+    }
+    if(name.size()>=COLUMN_NAME_SIZE)
+    {
+      throw SchemaException(fmt::format("Column name {} too long",name));
+    }
+    auto& column = columns[columnCount++];
+    std::memcpy(column.name.data(),name.data(),name.size());
+    column.type = type;
+    column.size = (type==ColumnType::CHAR) ? size : fixedSize(type);
+    return *this;
+  }
+
+  [[nodiscard]] uint32_t rowSize() const noexcept
+  {
+    uint32_t size = 0;
+    for(uint32_t i=0; i<columnCount; ++i)
+    {
+      size += columns[i].size;
+    }
+    return size;
+  }
+
+  // index of the column with name
+  [[nodiscard]] std::optional<uint32_t> find(std::string_view name) const noexcept
+  {
+    for(uint32_t i=0; i<columnCount; ++i)
+    {
+      if(name==std::string_view(columns[i].name.data(),::strnlen(columns[i].name.data(),columns[i].name.size())))
+      {
+        return i;
+      }
+    }
+    return std::nullopt;
+  }
+
+  [[nodiscard]] uint32_t offset(uint32_t column) const noexcept
+  {
+    uint32_t ret = 0;
+    for(uint32_t i=0; i<column; ++i)
+    {
+      ret += columns[i].size;
+    }
+    return ret;
+  }
+
+  [[nodiscard]] static constexpr uint32_t fixedSize(ColumnType type) noexcept
+  {
+    switch (type)
+    {
+      case ColumnType::UINT32:
+      case ColumnType::INT32:
+        return 4;
+      case ColumnType::INT64:
+        return 8;
+      case ColumnType::CHAR:
+        return 0;
+    }
+    return 0;
+  }
+};
+
+// Column access compiled once from a runtime schema, for tables created at runtime
+// Every column is resolved to its offset and to the formatter of its type up front,
+// so a row is formatted with one specialized call per column instead of interpreting the schema per row
+class RowLayout
+{
+public:
+  explicit RowLayout(const TableSchema& schema)
+  {
+    m_columns.reserve(schema.columnCount);
+    for(uint32_t i=0; i<schema.columnCount; ++i)
+    {
+      const auto& column = schema.columns[i];
+      m_columns.push_back(Accessor{std::string(column.name.data(),::strnlen(column.name.data(),column.name.size())),
+                                   schema.offset(i),column.size,column.type,formatter(column.type)});
+    }
+  }
+
+  // "name: value, ..." for every column of row
+  [[nodiscard]] std::string format(const char* row) const
+  {
+    std::string ret;
+    for(const auto& column: m_columns)
+    {
+      if(!ret.empty())
+      {
+        ret += ", ";
+      }
+      ret += column.name;
+      ret += ": ";
+      column.format(ret,row+column.offset,column.size);
+    }
+    return ret;
+  }
+
+  // Column of type T resolved once, reads the value at a fixed offset of every row without checking the schema
+  // T is an integer type or std::string_view for CHAR columns
+  template<typename T>
+  class Column
+  {
+  public:
+    [[nodiscard]] T get(const char* row) const noexcept
+    {
+      if constexpr(std::is_same_v<T,std::string_view>)
+      {
+        // without the zero padding
+        return std::string_view(row+m_offset,::strnlen(row+m_offset,m_size));
+      }
+      else
+      {
+        T value;
+        std::memcpy(&value,row+m_offset,sizeof(value));
+        return value;
+      }
+    }
+
+  private:
+    friend class RowLayout;
+    Column(uint32_t offset, uint32_t size) noexcept:
+    m_offset(offset),
+    m_size(size)
+    {
+    }
+
+    uint32_t m_offset;
+    uint32_t m_size;
+  };
+
+  // throws SchemaException when the column is not of type T, filters resolve it before the scan
+  template<typename T>
+  [[nodiscard]] Column<T> column(uint32_t column) const
+  {
+    const auto& accessor = checked(column,columnTypeOf<T>());
+    return Column<T>(accessor.offset,accessor.size);
+  }
+
+  // integer column of row, throws SchemaException when the column is not of type T
+  template<typename T>
+  [[nodiscard]] T get(const char* row, uint32_t column) const
+  {
+    return this->column<T>(column).get(row);
+  }
+
+  // CHAR column of row without the zero padding
+  [[nodiscard]] std::string_view chars(const char* row, uint32_t column) const
+  {
+    return this->column<std::string_view>(column).get(row);
+  }
+
+private:
+  using FormatFn = void(*)(std::string&, const char*, uint32_t);
+
+  struct Accessor
+  {
+    std::string name;
+    uint32_t offset;
+    uint32_t size;
+    ColumnType type;
+    FormatFn format;
+  };
+
+  template<typename T>
+  static constexpr ColumnType columnTypeOf()
+  {
+    static_assert(std::is_same_v<T,uint32_t> || std::is_same_v<T,int32_t> || std::is_same_v<T,int64_t>
+                  || std::is_same_v<T,std::string_view>, "No column type");
+    if constexpr(std::is_same_v<T,std::string_view>)
+    {
+      return ColumnType::CHAR;
+    }
+    else if constexpr(std::is_same_v<T,uint32_t>)
+    {
+      return ColumnType::UINT32;
+    }
+    else if constexpr(std::is_same_v<T,int32_t>)
+    {
+      return ColumnType::INT32;
+    }
+    else
+    {
+      return ColumnType::INT64;
+    }
+  }
+
+  const Accessor& checked(uint32_t column, ColumnType type) const
+  {
+    if(column>=m_columns.size())
+    {
+      throw SchemaException(fmt::format("No column {}",column));
+    }
+    if(m_columns[column].type!=type)
+    {
+      throw SchemaException(fmt::format("Column {} has a different type",m_columns[column].name));
+    }
+    return m_columns[column];
+  }
+
+  template<typename T>
+  static void formatNumber(std::string& out, const char* data, [[maybe_unused]] uint32_t size)
+  {
+    T value;
+    std::memcpy(&value,data,sizeof(value));
+    fmt::format_to(std::back_inserter(out),"{}",value);
+  }
+
+  // CHAR columns are zero padded
+  static void formatChars(std::string& out, const char* data, uint32_t size)
+  {
+    out.append(data,::strnlen(data,size));
+  }
+
+  static FormatFn formatter(ColumnType type)
+  {
+    switch(type)
+    {
+      case ColumnType::UINT32:
+        return &formatNumber<uint32_t>;
+      case ColumnType::INT32:
+        return &formatNumber<int32_t>;
+      case ColumnType::INT64:
+        return &formatNumber<int64_t>;
+      case ColumnType::CHAR:
+        return &formatChars;
+    }
+    throw SchemaException("Invalid column type");
+  }
+
+  std::vector<Accessor> m_columns;
+};
+
+// Read only view of a row stored elsewhere, in a leaf of the table BTree or in the hash index
+// Columns are read from the row when they are accessed, nothing is copied up front.
+// The view is valid until the row is written or moved by the next insert into its table
+class RowView
+{
+public:
+  RowView(const RowLayout& layout, const char* row) noexcept:
+  m_layout(&layout),
+  m_row(row)
+  {
+  }
+
+  [[nodiscard]] const char* data() const noexcept
+  {
+    return m_row;
+  }
+
+  template<typename T>
+  [[nodiscard]] T get(uint32_t column) const
+  {
+    return m_layout->get<T>(m_row,column);
+  }
+
+  // column resolved with RowLayout::column, no schema lookup per row
+  template<typename T>
+  [[nodiscard]] T get(const RowLayout::Column<T>& column) const noexcept
+  {
+    return column.get(m_row);
+  }
+
+  [[nodiscard]] std::string_view chars(uint32_t column) const
+  {
+    return m_layout->chars(m_row,column);
+  }
+
+  [[nodiscard]] std::string format() const
+  {
+    return m_layout->format(m_row);
+  }
+
+private:
+  const RowLayout* m_layout;
+  const char* m_row;
+};
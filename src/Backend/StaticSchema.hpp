@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstring>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include "Schema.hpp"
+
+// Column name usable as template argument, Field<"id",uint32_t>
+template<size_t N>
+struct ColumnName
+{
+  constexpr ColumnName(const char (&name)[N])
+  {
+    std::copy_n(name,N,value.begin());
+  }
+
+  [[nodiscard]] constexpr std::string_view view() const noexcept
+  {
+    return std::string_view(value.data(),N-1);
+  }
+
+  std::array<char,N> value{};
+};
+
+// Storage type of the columns of each ColumnType
+template<typename T>
+struct ColumnTraits;
+
+template<>
+struct ColumnTraits<uint32_t>
+{
+  static constexpr ColumnType type = ColumnType::UINT32;
+};
+
+template<>
+struct ColumnTraits<int32_t>
+{
+  static constexpr ColumnType type = ColumnType::INT32;
+};
+
+template<>
+struct ColumnTraits<int64_t>
+{
+  static constexpr ColumnType type = ColumnType::INT64;
+};
+
+template<size_t N>
+struct ColumnTraits<std::array<char,N>>
+{
+  static constexpr ColumnType type = ColumnType::CHAR;
+};
+
+template<ColumnName Name, typename T>
+  requires requires { ColumnTraits<T>::type; }
+struct Field
+{
+  using type = T;
+  static constexpr std::string_view name = Name.view();
+  static constexpr ColumnType columnType = ColumnTraits<T>::type;
+  static constexpr uint32_t size = sizeof(T);
+  static_assert(name.size()<COLUMN_NAME_SIZE, "Column name too long");
+};
+
+// Schema known at compile time, the rows of the table are the columns packed back to back
+// in declaration order without padding, the layout TableSchema describes at runtime.
+// Column offsets are constants, so typed accessors compile to a single load or store at a fixed offset
+template<typename... Fields>
+struct StaticSchema
+{
+  static constexpr size_t columnCount = sizeof...(Fields);
+  static_assert(columnCount>0 && columnCount<=MAX_COLUMNS, "Invalid number of columns");
+
+  using Tuple = std::tuple<typename Fields::type...>;
+
+  template<size_t I>
+  using type = std::tuple_element_t<I,Tuple>;
+
+  static_assert(std::is_same_v<type<0>,uint32_t>, "First column has to be an UINT32 key");
+
+  static constexpr std::array<uint32_t,columnCount+1> offsets = []()
+  {
+    std::array<uint32_t,columnCount+1> ret{};
+    constexpr std::array<uint32_t,columnCount> sizes = {Fields::size...};
+    for(size_t i=0; i<columnCount; ++i)
+    {
+      ret[i+1] = ret[i]+sizes[i];
+    }
+    return ret;
+  }();
+
+  static constexpr uint32_t rowSize = offsets[columnCount];
+
+  // index of the column called Name
+  template<ColumnName Name>
+  static constexpr size_t index = []()
+  {
+    constexpr std::array<std::string_view,columnCount> names = {Fields::name...};
+    const auto it = std::find(names.begin(),names.end(),Name.view());
+    return static_cast<size_t>(it-names.begin());
+  }();
+
+  template<size_t I>
+  [[nodiscard]] static type<I> get(const char* row) noexcept
+  {
+    type<I> value;
+    std::memcpy(&value,row+offsets[I],sizeof(value));
+    return value;
+  }
+
+  template<ColumnName Name>
+  [[nodiscard]] static auto get(const char* row) noexcept
+  {
+    static_assert(index<Name><columnCount, "No such column");
+    return get<index<Name>>(row);
+  }
+
+  template<size_t I>
+  static void set(char* row, const type<I>& value) noexcept
+  {
+    std::memcpy(row+offsets[I],&value,sizeof(value));
+  }
+
+  template<ColumnName Name>
+  static void set(char* row, const type<index<Name>>& value) noexcept
+  {
+    static_assert(index<Name><columnCount, "No such column");
+    set<index<Name>>(row,value);
+  }
+
+  [[nodiscard]] static Tuple read(const char* row) noexcept
+  {
+    return [&]<size_t... I>(std::index_sequence<I...>)
+    {
+      return Tuple{get<I>(row)...};
+    }(std::index_sequence_for<Fields...>{});
+  }
+
+  static void write(char* row, const Tuple& values) noexcept
+  {
+    [&]<size_t... I>(std::index_sequence<I...>)
+    {
+      (set<I>(row,std::get<I>(values)),...);
+    }(std::index_sequence_for<Fields...>{});
+  }
+
+  // Read only view of a row with this schema, a column is loaded with a single load when it is accessed
+  class View
+  {
+  public:
+    explicit View(const char* row) noexcept:
+    m_row(row)
+    {
+    }
+
+    template<size_t I>
+    [[nodiscard]] type<I> get() const noexcept
+    {
+      return StaticSchema::get<I>(m_row);
+    }
+
+    template<ColumnName Name>
+    [[nodiscard]] auto get() const noexcept
+    {
+      return StaticSchema::get<Name>(m_row);
+    }
+
+    // copies all columns
+    [[nodiscard]] Tuple read() const noexcept
+    {
+      return StaticSchema::read(m_row);
+    }
+
+    [[nodiscard]] const char* data() const noexcept
+    {
+      return m_row;
+    }
+
+  private:
+    const char* m_row;
+  };
+
+  // runtime description stored in the catalog
+  [[nodiscard]] static TableSchema tableSchema()
+  {
+    TableSchema schema;
+    (schema.add(Fields::name,Fields::columnType,Fields::size),...);
+    return schema;
+  }
+
+  // true when the rows of schema have the layout of this schema
+  [[nodiscard]] static bool matches(const TableSchema& schema) noexcept
+  {
+    if(schema.columnCount!=columnCount)
+    {
+      return false;
+    }
+    constexpr std::array<ColumnType,columnCount> types = {Fields::columnType...};
+    for(uint32_t i=0; i<columnCount; ++i)
+    {
+      if(schema.columns[i].type!=types[i] || schema.offset(i)!=offsets[i] || schema.columns[i].size!=offsets[i+1]-offsets[i])
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+};
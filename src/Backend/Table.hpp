@@ -1,21 +1,93 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
 #include "Pager.hpp"
+#include "PageChain.hpp"
+#include "Catalog.hpp"
 #include "BTree.hpp"
+#include "HashIndex.hpp"
+#include "PaxPage.hpp"
+#include "Async/Executor.hpp"
+#include "Async/Generator.hpp"
 
-class TableException : public DBException 
+class TableException : public DBException
 {
 public:
   TableException(const std::string& msg) : DBException(fmt::format("<Table>: \"{}\"", msg)) {}
   virtual ~TableException() noexcept = default;
 };
 
+// Rows of every schema are stored in a fixed size buffer in the BTree,
+// only TableSchema::rowSize bytes of it are written to disk
+inline constexpr size_t MAX_ROW_SIZE = 252;
+using RowData = std::array<char,MAX_ROW_SIZE>;
+
+class Cursor;
+
 // DataBase Table
+// One of the tables in the catalog of a database file, the rows are loaded from the pager on construction
+// and written back to the page chain of the table on flush
+// The pages of the chain partition the keys, a flush rewrites only the pages whose rows changed
+// A table may have a hash index of its keys, lookups of absent keys probe it instead of descending the BTree.
+// Rows are only written through emplace, assign and clear, which keep the index in sync with the BTree.
+// Columnar tables store their pages in the PAX layout, so column scans read only the bytes of the column
 class Table{
 public:
-  explicit Table(const std::string& filename):
-  m_pager(filename)
+  using KeyType = uint32_t;
+  using ValueType = RowData;
+  using TreeType = BTree<KeyType,ValueType>;
+  static constexpr size_t SCAN_BATCH = 256;
+
+  Table(Pager& pager, Catalog& catalog, std::string_view name):
+  m_pager(pager),
+  m_catalog(catalog),
+  m_name(makeTableName(name)),
+  m_schema(m_catalog.at(name).schema),
+  m_layout(m_schema)
   {
+    const auto& entry = m_catalog.at(name);
+    if(m_schema.rowSize()>MAX_ROW_SIZE)
+    {
+      throw TableException(fmt::format("Row size {} of table {} exceeds {}",m_schema.rowSize(),name,MAX_ROW_SIZE));
+    }
+    // the destructor does not run when the constructor throws, the swizzled pages are unswizzled here
+    try
+    {
+      if(entry.layout==TableLayout::COLUMNAR)
+      {
+        m_pax.emplace(m_schema);
+      }
+      for(PageNum pageNum = entry.rootPage; pageNum!=INVALID_PAGE;)
+      {
+        const auto& page = m_pager.get(pageNum);
+        // an empty page gets the keys up to the next page, the head page all keys before it
+        const KeyType first = m_chain.empty() ? 0 : page.header.count!=0 ? keyAt(page,0) : m_chain.back().first;
+        m_chain.push_back(ChainPage{.pageNum = pageNum,.first = first});
+        for(uint32_t i=0; i<page.header.count; ++i)
+        {
+          ValueType value{};
+          readRow(page,i,value.data());
+          m_btree.emplace(keyAt(page,i),value);
+        }
+        pageNum = page.header.next;
+      }
+      if(entry.indexRoot!=INVALID_PAGE)
+      {
+        m_index.emplace(HashIndex<KeyType>::read(m_pager,entry.indexRoot));
+      }
+    }
+    catch(...)
+    {
+      dropPages();
+      throw;
+    }
   }
 
   // delete copy and move constructors because table flushes on destruction and pager has deleted copy constructor
@@ -23,10 +95,525 @@ public:
   Table(Table&&) = delete;
   Table& operator=(const Table&) = delete;
   Table& operator=(Table&&) = delete;
-  ~Table() = default;
-  
-//private:
-  BTree btree;
-  Pager m_pager;
-};
+  ~Table()
+  {
+    dropPages();
+  }
+
+  [[nodiscard]] std::string_view name() const
+  {
+    return tableNameView(m_name);
+  }
+
+  [[nodiscard]] const TableSchema& schema() const noexcept
+  {
+    return m_schema;
+  }
+
+  [[nodiscard]] const RowLayout& layout() const noexcept
+  {
+    return m_layout;
+  }
+
+  // Builds the hash index from the rows of the table, it is stored with the table from the next flush on
+  void createHashIndex()
+  {
+    if(m_index)
+    {
+      return;
+    }
+    HashIndex<KeyType> index(m_btree.size()*2);
+    for(auto& row: m_btree)
+    {
+      index.insert(row.key);
+    }
+    m_index.emplace(std::move(index));
+    m_catalog.at(name()).indexRoot = m_pager.allocate();
+  }
+
+  [[nodiscard]] bool hasHashIndex() const noexcept
+  {
+    return m_index.has_value();
+  }
+
+  // true when the pages of the table use the PAX layout
+  [[nodiscard]] bool columnar() const noexcept
+  {
+    return m_pax.has_value();
+  }
+
+  // Calls fn(values, count) with runs of count consecutive values of column, columnSize bytes each, in key order
+  // Columnar tables pass the mini page of the column of every page, so only the bytes of the column are read,
+  // changes since the last flush are flushed first. Row tables pass the value of every row on its own
+  template<typename Fn>
+  void scanColumn(uint32_t column, Fn&& fn)
+  {
+    if(column>=m_schema.columnCount)
+    {
+      throw TableException(fmt::format("Table {} has no column {}",name(),column));
+    }
+    if(!m_pax)
+    {
+      const uint32_t offset = m_schema.offset(column);
+      for(auto& row: m_btree)
+      {
+        fn(row.value.data()+offset,uint32_t{1});
+      }
+      return;
+    }
+    if(m_modified)
+    {
+      flush();
+    }
+    forEachPage([&](const Page& page)
+    {
+      fn(m_pax->column(page,column),page.header.count);
+    });
+  }
+
+  // sum of an integer column
+  [[nodiscard]] int64_t sumColumn(uint32_t column)
+  {
+    if(column>=m_schema.columnCount)
+    {
+      throw TableException(fmt::format("Table {} has no column {}",name(),column));
+    }
+    switch(m_schema.columns[column].type)
+    {
+      case ColumnType::UINT32:
+        return sumColumn<uint32_t>(column);
+      case ColumnType::INT32:
+        return sumColumn<int32_t>(column);
+      case ColumnType::INT64:
+        return sumColumn<int64_t>(column);
+      case ColumnType::CHAR:
+        break;
+    }
+    throw TableException(fmt::format("Column {} of table {} is not an integer",column,name()));
+  }
+
+  // false when key is already in the table
+  bool emplace(KeyType key, const ValueType& value)
+  {
+    if(!m_btree.try_emplace(key,value).second)
+    {
+      return false;
+    }
+    markModified(key);
+    if(m_index)
+    {
+      m_index->insert(key);
+    }
+    return true;
+  }
+
+  // inserts the row or replaces the row of key
+  void assign(KeyType key, const ValueType& value)
+  {
+    m_btree.insert_or_assign(key,value);
+    markModified(key);
+    if(m_index)
+    {
+      m_index->insert(key);
+    }
+  }
+
+  // removes all rows, the chain of the table is emptied by the next flush
+  void clear()
+  {
+    m_btree.clear();
+    m_modified = true;
+    for(auto& page: m_chain)
+    {
+      page.dirty = true;
+    }
+    if(m_index)
+    {
+      m_index->clear();
+    }
+  }
+
+  [[nodiscard]] size_t size()
+  {
+    return m_btree.size();
+  }
+
+  // Folds the rows on all cores, see BTree::parallel_reduce, fn reads the rows with fn(T&, const RowType&)
+  template<typename T, typename Fn, typename Reduce>
+  T parallel_reduce(const T& identity, Fn&& fn, Reduce&& reduce)
+  {
+    return m_btree.parallel_reduce(identity,[&](T& acc, const TreeType::RowType& row)
+    {
+      fn(acc,row);
+    },std::forward<Reduce>(reduce));
+  }
+
+  // pager of the database file of the table
+  [[nodiscard]] Pager& pager() noexcept
+  {
+    return m_pager;
+  }
+
+  // prints the nodes of the BTree
+  void print() const
+  {
+    m_btree.print();
+  }
+
+  // Point lookup, absent keys are answered by the hash index when the table has one
+  [[nodiscard]] std::optional<ValueType> lookup(KeyType key)
+  {
+    const auto row = view(key);
+    if(!row)
+    {
+      return std::nullopt;
+    }
+    ValueType value{};
+    std::memcpy(value.data(),row->data(),m_schema.rowSize());
+    return value;
+  }
+
+  // Point lookup without copying the row, the view points into the BTree leaf
+  // and is valid until the next emplace, assign or clear of the table moves or frees the row
+  [[nodiscard]] std::optional<RowView> view(KeyType key)
+  {
+    if(m_index && !m_index->contains(key))
+    {
+      return std::nullopt;
+    }
+    auto it = m_btree.find(key);
+    if(it==m_btree.end())
+    {
+      return std::nullopt;
+    }
+    return view(it->value);
+  }
+
+  [[nodiscard]] RowView view(const ValueType& value) const noexcept
+  {
+    return RowView(m_layout,value.data());
+  }
+
+  // accepts every row of a scan
+  struct AllRows
+  {
+    bool operator()([[maybe_unused]] KeyType key, [[maybe_unused]] const RowView& row) const noexcept
+    {
+      return true;
+    }
+  };
+
+  // Yields the rows in key order for which filter(key, view) is true, every batch holds the matches
+  // of up to SCAN_BATCH rows, a batch is valid until the next one is awaited
+  // filter reads the rows in the BTree leaves, only the matching rows are copied into the batch.
+  // The scan lets the other coroutines of executor run between batches, rows they insert meanwhile
+  // behind the current position are returned by later batches
+  template<typename Filter = AllRows>
+  AsyncGenerator<std::span<const TreeType::RowType>> scan(Executor& executor, Filter filter = Filter())
+  {
+    std::vector<TreeType::RowType> batch;
+    batch.reserve(SCAN_BATCH);
+    auto it = m_btree.begin();
+    while(it!=m_btree.end())
+    {
+      batch.clear();
+      KeyType last = it->key;
+      for(size_t visited = 0; it!=m_btree.end() && visited<SCAN_BATCH; ++it, ++visited)
+      {
+        last = it->key;
+        if(filter(it->key,view(it->value)))
+        {
+          batch.push_back(*it);
+        }
+      }
+      if(!batch.empty())
+      {
+        co_yield std::span<const TreeType::RowType>(batch);
+      }
+      co_await executor.schedule();
+      // inserts while suspended invalidate the iterator, continue after the last returned key
+      it = m_btree.lower_bound(last);
+      if(it!=m_btree.end() && it->key==last)
+      {
+        ++it;
+      }
+    }
+  }
+
+  // Writes the pages whose rows changed since the last flush
+  // A page whose rows do not fit anymore is split into new pages linked after it, a page left without rows
+  // is unlinked from the chain, so a flush touches only the pages around the changed rows
+  void flush()
+  {
+    auto& entry = m_catalog.at(name());
+    if(m_modified)
+    {
+      // pages may be split or released
+      dropPages();
+      if(m_chainMoved)
+      {
+        // the defragmenter exchanged pages of the chain, every position kept its rows
+        PageNum pageNum = entry.rootPage;
+        for(auto& page: m_chain)
+        {
+          page.pageNum = pageNum;
+          pageNum = m_pager.get(pageNum).header.next;
+        }
+        m_chainMoved = false;
+      }
+      std::vector<PageNum> released;
+      // back to front, so the pages inserted by a split do not move the pages that are not written yet
+      for(size_t position = m_chain.size(); position-->0;)
+      {
+        if(m_chain[position].dirty)
+        {
+          writeChainPage(position,released);
+        }
+      }
+      // released in chain order, like the surplus pages of a rewritten chain
+      for(auto it = released.rbegin(); it!=released.rend(); ++it)
+      {
+        m_pager.release(*it);
+      }
+      m_modified = false;
+      entry.rowCount = m_btree.size();
+    }
+    if(m_index)
+    {
+      m_index->write(m_pager,entry.indexRoot);
+    }
+  }
+
+  // The defragmenter moved pages of the chains, positions in the chains keep their rows but not their page numbers
+  void pagesMoved() noexcept
+  {
+    dropPages();
+    m_chainMoved = true;
+    if(m_index)
+    {
+      m_index->pagesMoved();
+    }
+  }
 
+  // Forgets the pages of the chain, they are collected again by the next scan of the pages
+  // Called when the chain was rewritten or its pages were moved
+  void dropPages() noexcept
+  {
+    for(auto& swip: m_pages)
+    {
+      m_pager.unswizzle(swip);
+    }
+    m_pages.clear();
+  }
+
+private:
+  // cursors iterate the rows of the BTree and only read them
+  friend class Cursor;
+  friend Cursor table_start(Table& table);
+  friend Cursor table_find(Table& table, KeyType key);
+
+  // page of the chain and the smallest key that belongs to it, a page holds the keys up to the next page
+  struct ChainPage
+  {
+    PageNum pageNum = INVALID_PAGE;
+    KeyType first = 0;
+    // rows of the page changed since the last flush
+    bool dirty = false;
+  };
+
+  [[nodiscard]] size_t recordSize() const noexcept
+  {
+    return sizeof(KeyType)+m_schema.rowSize();
+  }
+
+  // rows per page
+  [[nodiscard]] size_t pageCapacity() const noexcept
+  {
+    return m_pax ? m_pax->capacity() : PAGE_PAYLOAD_SIZE/recordSize();
+  }
+
+  [[nodiscard]] KeyType keyAt(const Page& page, uint32_t index) const noexcept
+  {
+    if(m_pax)
+    {
+      return m_pax->key(page,index);
+    }
+    KeyType key;
+    std::memcpy(&key,page.payload.data()+index*recordSize(),sizeof(KeyType));
+    return key;
+  }
+
+  void readRow(const Page& page, uint32_t index, char* row) const noexcept
+  {
+    if(m_pax)
+    {
+      m_pax->read(page,index,row);
+      return;
+    }
+    std::memcpy(row,page.payload.data()+index*recordSize()+sizeof(KeyType),m_schema.rowSize());
+  }
+
+  // the rows are copied from the leaves straight into the records of the page
+  void writeRow(Page& page, uint32_t index, KeyType key, const char* row) const noexcept
+  {
+    if(m_pax)
+    {
+      m_pax->write(page,index,key,row);
+      return;
+    }
+    char* record = page.payload.data()+index*recordSize();
+    std::memcpy(record,&key,sizeof(KeyType));
+    std::memcpy(record+sizeof(KeyType),row,m_schema.rowSize());
+  }
+
+  // position in the chain of the page that holds key
+  [[nodiscard]] size_t chainPosition(KeyType key) const noexcept
+  {
+    auto it = std::upper_bound(m_chain.begin()+1,m_chain.end(),key,[](KeyType lhs, const ChainPage& rhs)
+    {
+      return lhs<rhs.first;
+    });
+    return static_cast<size_t>(it-m_chain.begin())-1;
+  }
+
+  void markModified(KeyType key) noexcept
+  {
+    m_modified = true;
+    m_chain[chainPosition(key)].dirty = true;
+  }
+
+  // Writes count rows from it on into the page and keeps its link, returns the iterator after the rows
+  TreeType::iterator fillPage(PageNum pageNum, TreeType::iterator it, size_t count)
+  {
+    auto& page = m_pager.get(pageNum);
+    const PageNum next = page.header.next;
+    page.header = PageHeader{};
+    page.header.type = m_pax ? PageType::TABLE_PAX : PageType::TABLE_DATA;
+    page.header.next = next;
+    for(uint32_t index=0; index<count; ++index, ++it)
+    {
+      writeRow(page,index,it->key,it->value.data());
+    }
+    page.header.count = static_cast<uint32_t>(count);
+    m_pager.markDirty(pageNum);
+    return it;
+  }
+
+  // Writes the rows of the page at position, splitting it when they do not fit
+  // A page other than the head that has no rows left is unlinked and added to released
+  void writeChainPage(size_t position, std::vector<PageNum>& released)
+  {
+    const PageNum pageNum = m_chain[position].pageNum;
+    const bool last = position+1==m_chain.size();
+    auto it = position==0 ? m_btree.begin() : m_btree.lower_bound(m_chain[position].first);
+    const auto end = last ? m_btree.end() : m_btree.lower_bound(m_chain[position+1].first);
+    size_t rows = 0;
+    for(auto row = it; row!=end; ++row)
+    {
+      ++rows;
+    }
+    m_chain[position].dirty = false;
+
+    if(rows==0 && position!=0)
+    {
+      const PageNum next = m_pager.get(pageNum).header.next;
+      const PageNum previous = m_chain[position-1].pageNum;
+      m_pager.get(previous).header.next = next;
+      m_pager.markDirty(previous);
+      released.push_back(pageNum);
+      m_chain.erase(m_chain.begin()+static_cast<std::ptrdiff_t>(position));
+      return;
+    }
+
+    const size_t capacity = pageCapacity();
+    const size_t pages = std::max<size_t>(1,(rows+capacity-1)/capacity);
+    // appended rows fill whole pages, pages within the chain are split evenly and keep room for later inserts
+    const size_t perPage = last ? capacity : (rows+pages-1)/pages;
+    size_t remaining = rows;
+    size_t count = std::min(perPage,remaining);
+    it = fillPage(pageNum,it,count);
+    remaining -= count;
+    PageNum previous = pageNum;
+    for(size_t inserted = position+1; remaining!=0; ++inserted)
+    {
+      const PageNum split = m_pager.allocate();
+      auto& previousPage = m_pager.get(previous);
+      const PageNum next = previousPage.header.next;
+      previousPage.header.next = split;
+      m_pager.markDirty(previous);
+      m_pager.get(split).header.next = next;
+      const KeyType first = it->key;
+      count = std::min(perPage,remaining);
+      it = fillPage(split,it,count);
+      remaining -= count;
+      m_chain.insert(m_chain.begin()+static_cast<std::ptrdiff_t>(inserted),ChainPage{.pageNum = split,.first = first});
+      previous = split;
+    }
+  }
+
+  // Calls fn with every page of the table
+  // The pages are collected on the first call, later calls follow the swizzled references
+  // to the resident pages instead of looking every page up in the page table
+  // A walk that throws drops the pages it collected, so the next call does not skip the rest of the chain
+  template<typename Fn>
+  void forEachPage(Fn&& fn)
+  {
+    if(m_pages.empty())
+    {
+      try
+      {
+        for(PageNum pageNum = m_catalog.at(name()).rootPage; pageNum!=INVALID_PAGE;)
+        {
+          const auto& page = m_pager.resolve(m_pages.emplace_back(pageNum));
+          pageNum = page.header.next;
+          fn(page);
+        }
+      }
+      catch(...)
+      {
+        dropPages();
+        throw;
+      }
+      return;
+    }
+    for(auto& swip: m_pages)
+    {
+      fn(m_pager.resolve(swip));
+    }
+  }
+
+  // the values of a mini page are contiguous, the loop vectorizes
+  template<typename T>
+  int64_t sumColumn(uint32_t column)
+  {
+    int64_t sum = 0;
+    scanColumn(column,[&](const char* values, uint32_t count)
+    {
+      for(uint32_t i=0; i<count; ++i)
+      {
+        T value;
+        std::memcpy(&value,values+i*sizeof(T),sizeof(T));
+        sum += static_cast<int64_t>(value);
+      }
+    });
+    return sum;
+  }
+
+  // rows are only written through the table, so the hash index stays in sync
+  TreeType m_btree;
+  Pager& m_pager;
+  Catalog& m_catalog;
+  TableName m_name;
+  TableSchema m_schema;
+  RowLayout m_layout;
+  std::optional<HashIndex<KeyType>> m_index;
+  std::optional<PaxLayout> m_pax;
+  // pages of the chain of the table in chain order, a deque so the references do not move
+  std::deque<Swip> m_pages;
+  // the pages of the chain in chain order with the keys they hold, the head page holds all keys before the next one
+  std::vector<ChainPage> m_chain;
+  // the page numbers in m_chain are stale since the defragmenter moved pages
+  bool m_chainMoved = false;
+  // rows were written through the table since the last flush
+  bool m_modified = false;
+};
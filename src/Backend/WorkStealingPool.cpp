@@ -0,0 +1,141 @@
+#include "WorkStealingPool.hpp"
+
+#include <algorithm>
+
+namespace
+{
+// pool and worker index of the calling thread
+thread_local const WorkStealingPool* currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+}
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+{
+  if(threads==0)
+  {
+    threads = std::max(1u,std::thread::hardware_concurrency());
+  }
+  m_workers.reserve(threads);
+  for(unsigned i=0; i<threads; ++i)
+  {
+    m_workers.push_back(std::make_unique<Worker>());
+  }
+  m_threads.reserve(threads);
+  for(unsigned i=0; i<threads; ++i)
+  {
+    m_threads.emplace_back([this, i](){ work(i); });
+  }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+  {
+    std::lock_guard lock(m_sleepMutex);
+    m_stop = true;
+  }
+  m_taskAvailable.notify_all();
+  for(auto& thread: m_threads)
+  {
+    thread.join();
+  }
+}
+
+void WorkStealingPool::submit(std::function<void()> task)
+{
+  size_t index = self();
+  if(index==m_workers.size())
+  {
+    index = m_nextWorker.fetch_add(1,std::memory_order_relaxed)%m_workers.size();
+  }
+  {
+    std::lock_guard lock(m_workers[index]->mutex);
+    m_workers[index]->tasks.push_back(std::move(task));
+  }
+  m_queued.fetch_add(1,std::memory_order_release);
+  {
+    // a worker that checked m_queued before the increment is waiting once the lock is released
+    std::lock_guard lock(m_sleepMutex);
+  }
+  m_taskAvailable.notify_one();
+}
+
+bool WorkStealingPool::runOne()
+{
+  const size_t index = self();
+  std::function<void()> task;
+  if((index<m_workers.size() && take(index,task)) || steal(index,task))
+  {
+    task();
+    return true;
+  }
+  return false;
+}
+
+WorkStealingPool& WorkStealingPool::global()
+{
+  static WorkStealingPool pool;
+  return pool;
+}
+
+size_t WorkStealingPool::self() const noexcept
+{
+  return currentPool==this ? currentWorker : m_workers.size();
+}
+
+bool WorkStealingPool::take(size_t index, std::function<void()>& task)
+{
+  auto& worker = *m_workers[index];
+  std::lock_guard lock(worker.mutex);
+  if(worker.tasks.empty())
+  {
+    return false;
+  }
+  task = std::move(worker.tasks.back());
+  worker.tasks.pop_back();
+  m_queued.fetch_sub(1,std::memory_order_relaxed);
+  return true;
+}
+
+bool WorkStealingPool::steal(size_t thief, std::function<void()>& task)
+{
+  const size_t count = m_workers.size();
+  for(size_t i=1; i<=count; ++i)
+  {
+    const size_t index = (thief+i)%count;
+    if(index==thief)
+    {
+      continue;
+    }
+    auto& worker = *m_workers[index];
+    std::lock_guard lock(worker.mutex);
+    if(!worker.tasks.empty())
+    {
+      task = std::move(worker.tasks.front());
+      worker.tasks.pop_front();
+      m_queued.fetch_sub(1,std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::work(size_t index)
+{
+  currentPool = this;
+  currentWorker = index;
+  for(;;)
+  {
+    std::function<void()> task;
+    if(take(index,task) || steal(index,task))
+    {
+      task();
+      continue;
+    }
+    std::unique_lock lock(m_sleepMutex);
+    m_taskAvailable.wait(lock,[&](){ return m_stop || m_queued.load(std::memory_order_acquire)!=0; });
+    if(m_stop && m_queued.load(std::memory_order_acquire)==0)
+    {
+      return;
+    }
+  }
+}
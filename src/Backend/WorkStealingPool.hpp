@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool of worker threads with one task deque per worker
+// Workers take their own tasks from the back and steal the oldest tasks of other workers from the front,
+// so tasks spawned by a task stay on the worker that spawned them until another worker runs out of work
+class WorkStealingPool
+{
+public:
+  // hardware concurrency when threads is 0
+  explicit WorkStealingPool(unsigned threads = 0);
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool(WorkStealingPool&&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(WorkStealingPool&&) = delete;
+  // runs the remaining tasks before the workers are joined
+  ~WorkStealingPool();
+
+  // Queues task on the deque of the calling worker, tasks from other threads are spread over the workers
+  void submit(std::function<void()> task);
+
+  // Runs one queued task on the calling thread, returns false when no task was queued
+  bool runOne();
+
+  // Calls fn(i) for i in [0,count) on the pool and returns when all calls returned
+  // The calling thread runs queued tasks while it waits, so parallelFor may be nested inside a task
+  // The first exception thrown by fn is rethrown after all calls returned
+  template<typename Fn>
+  void parallelFor(size_t count, Fn&& fn)
+  {
+    std::atomic<size_t> remaining = count;
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    for(size_t i=0; i<count; ++i)
+    {
+      submit([&, i]()
+      {
+        try
+        {
+          fn(i);
+        }
+        catch(...)
+        {
+          std::lock_guard lock(errorMutex);
+          if(!error)
+          {
+            error = std::current_exception();
+          }
+        }
+        remaining.fetch_sub(1,std::memory_order_release);
+      });
+    }
+    while(remaining.load(std::memory_order_acquire)!=0)
+    {
+      if(!runOne())
+      {
+        std::this_thread::yield();
+      }
+    }
+    if(error)
+    {
+      std::rethrow_exception(error);
+    }
+  }
+
+  [[nodiscard]] size_t size() const noexcept
+  {
+    return m_workers.size();
+  }
+
+  // pool shared by the parallel scans of all BTrees, created on first use
+  static WorkStealingPool& global();
+
+private:
+  // one cache line per deque, so workers taking their own tasks do not contend with each other
+  struct alignas(64) Worker
+  {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  // index of the calling worker of this pool, size() for other threads
+  [[nodiscard]] size_t self() const noexcept;
+  bool take(size_t index, std::function<void()>& task);
+  bool steal(size_t thief, std::function<void()>& task);
+  void work(size_t index);
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::atomic<size_t> m_nextWorker{0};
+  // queued tasks that have not been taken yet
+  std::atomic<size_t> m_queued{0};
+  std::mutex m_sleepMutex;
+  std::condition_variable m_taskAvailable;
+  bool m_stop = false;
+  std::vector<std::thread> m_threads;
+};
@@ -24,8 +24,24 @@ public:
     if (input_buffer ==  ".btree") 
     {
      fmt::print("Tree:\n");
-     auto node = table.m_root;
-     node.print(&table.m_pager);
+     table.print();
+     return MetaCommandResult::SUCCESS;
+    }
+    if (input_buffer ==  ".hashindex") 
+    {
+     table.createHashIndex();
+     fmt::print("Hash index on {}\n", table.name());
+     return MetaCommandResult::SUCCESS;
+    }
+    if (input_buffer ==  ".verify") 
+    {
+     table.pager().flush();
+     auto result = table.pager().verify();
+     fmt::print("Verified {} pages, {} corrupt\n", result.pagesChecked, result.corruptPages.size());
+     for(auto pageNum: result.corruptPages)
+     {
+       fmt::print("- page {}\n", pageNum);
+     }
      return MetaCommandResult::SUCCESS;
     }
     return MetaCommandResult::UNRECOGNIZED_COMMAND;
@@ -6,6 +6,7 @@
 #include <sstream>
 #include <memory>
 #include <span>
+#include <algorithm>
 
 #include "VirtualMachine.hpp"
 
@@ -17,6 +18,79 @@ enum class PrepareResult
     UNRECOGNIZED_STATEMENT 
 };
 
+// column type of a CREATE TABLE column, char(N) is a fixed width string of N bytes
+// TODO move out of header
+inline bool parse_column_type(const std::string& type, ColumnType& columnType, uint32_t& size)
+{
+  static constexpr std::pair<std::string_view, ColumnType> types[] = {
+    {"uint32", ColumnType::UINT32}, {"int32", ColumnType::INT32}, {"int64", ColumnType::INT64}};
+  for (const auto& [name, value] : types) {
+    if (type == name) {
+      columnType = value;
+      size = 0;
+      return true;
+    }
+  }
+  if (type.starts_with("char(") && type.ends_with(")")) {
+    std::stringstream s;
+    s.str(type.substr(5, type.size() - 6));
+    s >> size;
+    columnType = ColumnType::CHAR;
+    return !s.fail() && (s >> std::ws).eof() && size > 0;
+  }
+  return false;
+}
+
+// create table <name> (<column> <type>, ...) [columnar]
+// TODO move out of header
+inline PrepareResult prepare_create_table(const std::string& input_buffer, Statement& statement)
+{
+  const auto open = input_buffer.find('(');
+  const auto close = input_buffer.rfind(')');
+  if (open == std::string::npos || close == std::string::npos || close < open) {
+    return PrepareResult::SYNTAX_ERROR;
+  }
+  std::stringstream options;
+  options.str(input_buffer.substr(close + 1));
+  std::string layout;
+  options >> layout;
+  if (!(options >> std::ws).eof() || (!layout.empty() && layout != "columnar")) {
+    return PrepareResult::SYNTAX_ERROR;
+  }
+  statement.layout = layout.empty() ? TableLayout::ROW : TableLayout::COLUMNAR;
+  std::stringstream name;
+  name.str(input_buffer.substr(12, open - 12));
+  name >> statement.table_name;
+  if (name.fail() || !(name >> std::ws).eof() || statement.table_name.size() >= TABLE_NAME_SIZE) {
+    return PrepareResult::SYNTAX_ERROR;
+  }
+  statement.schema = TableSchema();
+  std::stringstream columns;
+  columns.str(input_buffer.substr(open + 1, close - open - 1));
+  std::string column;
+  while (std::getline(columns, column, ',')) {
+    std::stringstream s;
+    s.str(column);
+    std::string column_name;
+    std::string type;
+    ColumnType columnType;
+    uint32_t size;
+    s >> column_name >> type;
+    if (s.fail() || !(s >> std::ws).eof() || column_name.size() >= COLUMN_NAME_SIZE
+        || statement.schema.columnCount >= MAX_COLUMNS || !parse_column_type(type, columnType, size)) {
+      return PrepareResult::SYNTAX_ERROR;
+    }
+    statement.schema.add(column_name, columnType, size);
+  }
+  // the key of the table is its first column
+  if (statement.schema.columnCount == 0 || statement.schema.columns[0].type != ColumnType::UINT32
+      || statement.schema.rowSize() > MAX_ROW_SIZE) {
+    return PrepareResult::SYNTAX_ERROR;
+  }
+  statement.type = StatementType::CREATE_TABLE;
+  return PrepareResult::SUCCESS;
+}
+
 // TODO move out of header
 PrepareResult prepare_statement(const std::string& input_buffer, Statement& statement) 
 {
@@ -25,16 +99,40 @@ PrepareResult prepare_statement(const std::string& input_buffer, Statement& stat
     std::stringstream s;
     s.str(input_buffer.substr(7));
     auto& row = statement.row_to_insert;
-    s >>row.id >> row.age >> row.lastvar[0];
-    if (s.fail()) {
+    std::string lastvar;
+    s >>row.id >> row.age >> lastvar;
+    if (s.fail() || lastvar.size() >= row.lastvar.size()) {
       return PrepareResult::SYNTAX_ERROR;
     }
+    row.lastvar = {};
+    std::copy(lastvar.begin(), lastvar.end(), row.lastvar.begin());
     return PrepareResult::SUCCESS;
   }
+  if (input_buffer.starts_with("create table ")) {
+    return prepare_create_table(input_buffer, statement);
+  }
   if (input_buffer ==  "select") {
     statement.type = StatementType::SELECT;
     return PrepareResult::SUCCESS;
   }
+  if (input_buffer.starts_with("select where id =")) {
+    statement.type = StatementType::SELECT_KEY;
+    std::stringstream s;
+    s.str(input_buffer.substr(17));
+    s >> statement.key;
+    if (s.fail() || !(s >> std::ws).eof()) {
+      return PrepareResult::SYNTAX_ERROR;
+    }
+    return PrepareResult::SUCCESS;
+  }
+  if (input_buffer == "select count") {
+    statement.type = StatementType::COUNT;
+    return PrepareResult::SUCCESS;
+  }
+  if (input_buffer == "select sum") {
+    statement.type = StatementType::SUM;
+    return PrepareResult::SUCCESS;
+  }
 
   return PrepareResult::UNRECOGNIZED_STATEMENT;
 }
\ No newline at end of file
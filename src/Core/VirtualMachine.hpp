@@ -7,21 +7,80 @@
 #include <cstring>
 #include <fmt/format.h>
 
-#include "Pager.hpp"
+#include "../DB.hpp"
+#include "StaticSchema.hpp"
+#include "Table.hpp"
 #include "Cursor.hpp"
 
 
+inline constexpr size_t LASTVAR_SIZE = 32;
+
+// Row layout of the tables used by the statements
+using DefaultSchema = StaticSchema<
+  Field<"id",uint32_t>,
+  Field<"age",uint32_t>,
+  Field<"lastvar",std::array<char,LASTVAR_SIZE>>>;
+
+struct DefaultRow
+{
+    uint32_t id;
+    uint32_t age;
+    std::array<char,LASTVAR_SIZE> lastvar;
+
+    void print() const
+    {
+        fmt::print("id: {}, age: {}, lastvar: {}\n",id,age,std::string_view(lastvar.data(),::strnlen(lastvar.data(),lastvar.size())));
+    }
+};
+
+inline TableSchema default_schema()
+{
+    return DefaultSchema::tableSchema();
+}
+
+inline RowData serialize_row(const DefaultRow& source)
+{
+    static_assert(DefaultSchema::rowSize<=MAX_ROW_SIZE);
+    RowData destination{};
+    DefaultSchema::write(destination.data(), {source.id, source.age, source.lastvar});
+    return destination;
+}
+
+inline DefaultRow deserialize_row(const RowData& source)
+{
+    const auto [id, age, lastvar] = DefaultSchema::read(source.data());
+    return DefaultRow{id, age, lastvar};
+}
+
+// typed columns of a row without copying it, get<"age">() loads only the age
+using DefaultRowView = DefaultSchema::View;
+
+inline DefaultRowView view_row(const RowData& source) noexcept
+{
+    return DefaultRowView(source.data());
+}
+
+
 enum class StatementType
 { 
     INSERT, 
-    SELECT 
+    SELECT,
+    SELECT_KEY,
+    COUNT,
+    SUM,
+    CREATE_TABLE
 };
 
 enum class ExecuteResult
 { 
     SUCCESS, 
     TABLE_FULL,
-    DUPLICATE_KEY
+    DUPLICATE_KEY,
+    TABLE_EXISTS,
+    // the statement assumes columns the table does not have
+    SCHEMA_MISMATCH,
+    NO_SUCH_COLUMN,
+    WRONG_COLUMN_TYPE
 };
 
 
@@ -29,45 +88,114 @@ enum class ExecuteResult
 struct Statement
 {
     StatementType type;
-    Row row_to_insert;
+    DefaultRow row_to_insert;
+    // id of the equality predicate of SELECT_KEY
+    uint32_t key = 0;
+    // name and columns of CREATE_TABLE
+    std::string table_name;
+    TableSchema schema;
+    TableLayout layout = TableLayout::ROW;
 };
 
 //TODO move defination to cpp file
+// INSERT parses the columns of DefaultSchema, tables created with other columns would get misplaced bytes
 ExecuteResult execute_insert(const Statement& statement, Table& table) {
+  if (!DefaultSchema::matches(table.schema())) {
+    return ExecuteResult::SCHEMA_MISMATCH;
+  }
   const auto& row_to_insert = statement.row_to_insert;
   const uint32_t key_to_insert = row_to_insert.id;
-  auto cursor = table_find(table, key_to_insert);
-
-  auto* leafNode = std::get<LeafNode<>*>(cursor.m_node.ptr);
-  auto numCells = leafNode->m_header.m_numCells;
-
-  if (cursor.m_cellNum < numCells) {
-    const uint32_t key_at_index = leafNode->m_cells[cursor.m_cellNum].m_key;
-    if (key_at_index == key_to_insert) {
-      return ExecuteResult::DUPLICATE_KEY;
-    }
+  if (!table.emplace(key_to_insert,serialize_row(row_to_insert))) {
+    return ExecuteResult::DUPLICATE_KEY;
   }
-  cursor.insert(row_to_insert.id,row_to_insert);
-
   return ExecuteResult::SUCCESS;
 }
 
+// Rows are printed with the layout of the table, so tables created at runtime print their own columns
 //TODO move defination to cpp file
 ExecuteResult execute_select(Table& table) {
   auto cursor = table_start(table);
-  
-  Row row{};
 
   while (!(cursor.m_endOfTable)) 
   {
-    row = cursor.value();
-    row.print();
+    fmt::print("{}\n", cursor.view().format());
     cursor.advance();
   }
 
   return ExecuteResult::SUCCESS;
 }
 
+// Equality on the key is a point lookup, answered by the hash index when the table has one
+//TODO move defination to cpp file
+ExecuteResult execute_select_key(const Statement& statement, Table& table) {
+  if (const auto row = table.view(statement.key)) {
+    fmt::print("{}\n", row->format());
+  }
+  return ExecuteResult::SUCCESS;
+}
+
+// Aggregates run on all cores, every thread reduces the rows of a few subtrees of the BTree
+//TODO move defination to cpp file
+ExecuteResult execute_count(Table& table) {
+  const auto count = table.parallel_reduce(uint64_t{0},
+    [](uint64_t& acc, const Table::TreeType::RowType&) { ++acc; },
+    [](uint64_t lhs, uint64_t rhs) { return lhs+rhs; });
+  fmt::print("count: {}\n",count);
+  return ExecuteResult::SUCCESS;
+}
+
+template<typename T>
+int64_t sum_rows(Table& table, uint32_t column) {
+  const auto accessor = table.layout().column<T>(column);
+  return table.parallel_reduce(int64_t{0},
+    [accessor](int64_t& acc, const Table::TreeType::RowType& row) { acc += static_cast<int64_t>(accessor.get(row.value.data())); },
+    [](int64_t lhs, int64_t rhs) { return lhs+rhs; });
+}
+
+// The age column is looked up by name in the schema of the table, its offset is resolved once for all rows
+//TODO move defination to cpp file
+// columnar tables stream only the mini pages of the column instead
+ExecuteResult execute_sum(Table& table) {
+  const auto column = table.schema().find("age");
+  if (!column) {
+    return ExecuteResult::NO_SUCH_COLUMN;
+  }
+  const ColumnType type = table.schema().columns[*column].type;
+  if (type == ColumnType::CHAR) {
+    return ExecuteResult::WRONG_COLUMN_TYPE;
+  }
+  int64_t sum = 0;
+  if (table.columnar()) {
+    sum = table.sumColumn(*column);
+  } else {
+    switch (type) {
+      case ColumnType::UINT32:
+        sum = sum_rows<uint32_t>(table, *column);
+        break;
+      case ColumnType::INT32:
+        sum = sum_rows<int32_t>(table, *column);
+        break;
+      case ColumnType::INT64:
+        sum = sum_rows<int64_t>(table, *column);
+        break;
+      case ColumnType::CHAR:
+        break;
+    }
+  }
+  fmt::print("sum: {}\n",sum);
+  return ExecuteResult::SUCCESS;
+}
+
+// Runtime schema fallback, the columns of the table are only known when the statement runs
+//TODO move defination to cpp file
+ExecuteResult execute_create_table(const Statement& statement, Database& db) {
+  if (db.hasTable(statement.table_name)) {
+    return ExecuteResult::TABLE_EXISTS;
+  }
+  db.createTable(statement.table_name, statement.schema, statement.layout);
+  return ExecuteResult::SUCCESS;
+}
+
 //TODO move defination to cpp file
 // TODO throw exception instead of returning optional;
 ExecuteResult execute_statement(const Statement& statement, Table& table) {
@@ -77,6 +205,22 @@ ExecuteResult execute_statement(const Statement& statement, Table& table) {
       return execute_insert(statement, table);
     case (StatementType::SELECT):
       return execute_select(table);
+    case (StatementType::SELECT_KEY):
+      return execute_select_key(statement, table);
+    case (StatementType::COUNT):
+      return execute_count(table);
+    case (StatementType::SUM):
+      return execute_sum(table);
+    case (StatementType::CREATE_TABLE):
+      break;
   }
   throw std::runtime_error("Invalid statement");
+}
+
+// statements on the database, CREATE TABLE, or on table
+ExecuteResult execute_statement(const Statement& statement, Database& db, Table& table) {
+  if (statement.type == StatementType::CREATE_TABLE) {
+    return execute_create_table(statement, db);
+  }
+  return execute_statement(statement, table);
 }
\ No newline at end of file
@@ -1,21 +1,140 @@
 #pragma once
 
 #include <string>
-#include <iostream>
-#include <fmt/format.h>
-#include <sstream>
-#include <vector>
-#include <array>
+#include <string_view>
+#include <map>
 #include <memory>
 #include <span>
 
+#include "Pager.hpp"
+#include "Catalog.hpp"
+#include "Table.hpp"
+#include "Defragmenter.hpp"
 
+// Database file holding any number of tables
+// All tables share the file descriptor and the buffer pool of a single pager,
+// the catalog maps the table names to their schema and root page
+// The page chains are defragmented online in small steps while the database is idle, see defragment
+class Database
+{
+public:
+  explicit Database(const std::string& filename, size_t poolSize = DEFAULT_POOL_SIZE):
+  Database(filename,PagerOptions{.poolSize = poolSize})
+  {
+  }
 
+  Database(const std::string& filename, const PagerOptions& options):
+  m_pager(filename,options),
+  m_catalog(m_pager)
+  {
+  }
 
+  // delete copy and move constructors because tables hold references to pager and catalog
+  Database(const Database&) = delete;
+  Database(Database&&) = delete;
+  Database& operator=(const Database&) = delete;
+  Database& operator=(Database&&) = delete;
+  ~Database()
+  {
+    try
+    {
+      flush();
+    }
+    catch(const DBException& e)
+    {
+      fmt::print(stderr,"{}\n",e.what());
+    }
+  }
 
+  Table& createTable(std::string_view name, const TableSchema& schema, TableLayout layout = TableLayout::ROW)
+  {
+    if(schema.columnCount==0 || schema.columns[0].type!=ColumnType::UINT32)
+    {
+      throw CatalogException(fmt::format("First column of table {} has to be an UINT32 key",name));
+    }
+    m_catalog.create(name,schema,layout);
+    return table(name);
+  }
 
+  // opens the table on first use
+  Table& table(std::string_view name)
+  {
+    auto it = m_tables.find(name);
+    if(it==m_tables.end())
+    {
+      it = m_tables.emplace(std::string(name),std::make_unique<Table>(m_pager,m_catalog,name)).first;
+    }
+    return *(it->second);
+  }
 
+  [[nodiscard]] bool hasTable(std::string_view name)
+  {
+    return m_catalog.contains(name);
+  }
 
+  void flush()
+  {
+    for(auto& [name,table]: m_tables)
+    {
+      table->flush();
+    }
+    m_catalog.flush();
+    m_pager.flush();
+    m_defragmenter.restart();
+  }
 
+  // Writes only the given tables together with the catalog and commits the file,
+  // so a commit of a few changed tables does not visit every open table
+  void flush(std::span<Table* const> tables)
+  {
+    for(auto* table: tables)
+    {
+      table->flush();
+    }
+    m_catalog.flush();
+    m_pager.flush();
+    m_defragmenter.restart();
+  }
 
+  // One throttled step of the defragmentation of the page chains, returns the number of pages moved
+  // Moved pages are written with the next flush
+  size_t defragment()
+  {
+    const size_t moved = m_defragmenter.step();
+    if(moved!=0)
+    {
+      for(auto& [name,table]: m_tables)
+      {
+        table->pagesMoved();
+      }
+    }
+    return moved;
+  }
 
+  // true when the page chains are in order and defragment has nothing to do until the next flush
+  [[nodiscard]] bool defragmented() const noexcept
+  {
+    return m_defragmenter.ordered();
+  }
+
+  [[nodiscard]] Defragmenter& defragmenter() noexcept
+  {
+    return m_defragmenter;
+  }
+
+  [[nodiscard]] Catalog& catalog() noexcept
+  {
+    return m_catalog;
+  }
+
+  [[nodiscard]] Pager& pager() noexcept
+  {
+    return m_pager;
+  }
+
+private:
+  Pager m_pager;
+  Catalog m_catalog;
+  Defragmenter m_defragmenter{m_pager,m_catalog};
+  std::map<std::string,std::unique_ptr<Table>,std::less<>> m_tables;
+};
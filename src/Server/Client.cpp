@@ -0,0 +1,156 @@
+#include "Client.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Client::Client(const std::string& socketPath)
+{
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if(socketPath.empty() || socketPath.size()>=sizeof(address.sun_path))
+  {
+    throw ServerException(fmt::format("Invalid socket path '{}'",socketPath));
+  }
+  std::memcpy(address.sun_path,socketPath.data(),socketPath.size());
+  m_fd = ::socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+  if(m_fd<0)
+  {
+    throw ServerException(fmt::format("Unable to create socket: {}",std::strerror(errno)));
+  }
+  if(::connect(m_fd,reinterpret_cast<const sockaddr*>(&address),sizeof(address))!=0)
+  {
+    const int error = errno;
+    ::close(m_fd);
+    throw ServerException(fmt::format("Unable to connect to {}: {}",socketPath,std::strerror(error)));
+  }
+}
+
+Client::~Client()
+{
+  ::close(m_fd);
+}
+
+void Client::open(std::string_view name)
+{
+  queue(Opcode::OPEN,0,0,std::span<const char>(name.data(),name.size()));
+}
+
+void Client::insert(uint16_t table, uint32_t key, std::span<const char> row)
+{
+  queue(Opcode::INSERT,table,key,row);
+}
+
+void Client::upsert(uint16_t table, uint32_t key, std::span<const char> row)
+{
+  queue(Opcode::UPSERT,table,key,row);
+}
+
+void Client::get(uint16_t table, uint32_t key)
+{
+  queue(Opcode::GET,table,key,{});
+}
+
+void Client::count(uint16_t table)
+{
+  queue(Opcode::COUNT,table,0,{});
+}
+
+std::vector<Client::Response> Client::execute()
+{
+  // the responses are received while the requests are sent, the server stops reading
+  // the requests of a connection while its responses are not received
+  std::vector<Response> responses;
+  responses.reserve(m_queued);
+  std::vector<char> received;
+  size_t sent = 0;
+  while(responses.size()<m_queued)
+  {
+    pollfd fd{m_fd,static_cast<short>(POLLIN | (sent<m_requests.size() ? POLLOUT : 0)),0};
+    if(::poll(&fd,1,-1)<0)
+    {
+      if(errno==EINTR)
+      {
+        continue;
+      }
+      throw ServerException(fmt::format("poll failed: {}",std::strerror(errno)));
+    }
+    if(fd.revents & POLLOUT)
+    {
+      const ssize_t ret = ::send(m_fd,m_requests.data()+sent,m_requests.size()-sent,MSG_NOSIGNAL | MSG_DONTWAIT);
+      if(ret<0 && errno!=EINTR && errno!=EAGAIN && errno!=EWOULDBLOCK)
+      {
+        throw ServerException(fmt::format("Unable to send requests: {}",std::strerror(errno)));
+      }
+      sent += static_cast<size_t>(std::max<ssize_t>(ret,0));
+    }
+    if(fd.revents & (POLLIN | POLLHUP | POLLERR))
+    {
+      receive(received);
+      parse(received,responses);
+    }
+  }
+  m_requests.clear();
+  m_queued = 0;
+  return responses;
+}
+
+uint16_t Client::openTable(std::string_view name)
+{
+  open(name);
+  const auto responses = execute();
+  if(responses[0].status!=Status::OK || responses[0].payload.size()!=sizeof(uint16_t))
+  {
+    throw ServerException(fmt::format("Unable to open table {}",name));
+  }
+  uint16_t handle;
+  std::memcpy(&handle,responses[0].payload.data(),sizeof(handle));
+  return handle;
+}
+
+void Client::queue(Opcode op, uint16_t table, uint32_t key, std::span<const char> payload)
+{
+  if(payload.size()>MAX_REQUEST_PAYLOAD)
+  {
+    throw ServerException(fmt::format("Request payload of {} bytes exceeds {}",payload.size(),MAX_REQUEST_PAYLOAD));
+  }
+  const RequestHeader header{.length = static_cast<uint32_t>(payload.size()),.op = op,.table = table,.key = key};
+  const auto* bytes = reinterpret_cast<const char*>(&header);
+  m_requests.insert(m_requests.end(),bytes,bytes+sizeof(header));
+  m_requests.insert(m_requests.end(),payload.begin(),payload.end());
+  ++m_queued;
+}
+
+void Client::receive(std::vector<char>& received)
+{
+  const size_t size = received.size();
+  received.resize(size+RECEIVE_SIZE);
+  const ssize_t ret = ::recv(m_fd,received.data()+size,RECEIVE_SIZE,MSG_DONTWAIT);
+  received.resize(size+static_cast<size_t>(std::max<ssize_t>(ret,0)));
+  if(ret==0 || (ret<0 && errno!=EINTR && errno!=EAGAIN && errno!=EWOULDBLOCK))
+  {
+    throw ServerException(ret==0 ? std::string("Connection closed by server") : fmt::format("Unable to receive responses: {}",std::strerror(errno)));
+  }
+}
+
+void Client::parse(std::vector<char>& received, std::vector<Response>& responses)
+{
+  size_t parsed = 0;
+  while(received.size()-parsed>=sizeof(ResponseHeader))
+  {
+    ResponseHeader header;
+    std::memcpy(&header,received.data()+parsed,sizeof(header));
+    if(received.size()-parsed<sizeof(header)+header.length)
+    {
+      break;
+    }
+    const auto payload = received.begin()+static_cast<std::ptrdiff_t>(parsed+sizeof(header));
+    responses.push_back(Response{header.status,std::vector<char>(payload,payload+header.length)});
+    parsed += sizeof(header)+header.length;
+  }
+  received.erase(received.begin(),received.begin()+static_cast<std::ptrdiff_t>(parsed));
+}
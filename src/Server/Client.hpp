@@ -0,0 +1,52 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Server.hpp"
+
+// Connection to a Server, requests are queued and sent together by execute
+// so a whole pipeline of requests costs a single round trip
+class Client
+{
+public:
+  struct Response
+  {
+    Status status = Status::OK;
+    std::vector<char> payload;
+  };
+
+  explicit Client(const std::string& socketPath);
+  Client(const Client&) = delete;
+  Client(Client&&) = delete;
+  Client& operator=(const Client&) = delete;
+  Client& operator=(Client&&) = delete;
+  ~Client();
+
+  void open(std::string_view name);
+  void insert(uint16_t table, uint32_t key, std::span<const char> row);
+  void upsert(uint16_t table, uint32_t key, std::span<const char> row);
+  void get(uint16_t table, uint32_t key);
+  void count(uint16_t table);
+
+  // Sends the queued requests and returns their responses in the order of the requests
+  std::vector<Response> execute();
+
+  // handle of the table for the other requests, throws ServerException when there is no such table
+  uint16_t openTable(std::string_view name);
+
+private:
+  static constexpr size_t RECEIVE_SIZE = 64*1024;
+
+  void queue(Opcode op, uint16_t table, uint32_t key, std::span<const char> payload);
+  // appends the bytes that arrived to received
+  void receive(std::vector<char>& received);
+  // moves the complete responses at the start of received to responses
+  static void parse(std::vector<char>& received, std::vector<Response>& responses);
+
+  int m_fd = -1;
+  std::vector<char> m_requests;
+  size_t m_queued = 0;
+};
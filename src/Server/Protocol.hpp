@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cinttypes>
+
+// Binary protocol of the server, every request and response is a fixed size header followed by length payload bytes
+// Clients may send any number of requests before reading the responses, the responses of a connection
+// are returned in the order of its requests
+// All integers are in host byte order, the server only accepts connections from the same host
+
+enum class Opcode : uint8_t
+{
+  // payload is the table name, response payload is the uint16_t handle used by the other requests
+  OPEN,
+  // payload is the row without the key, fails with DUPLICATE_KEY when key exists
+  INSERT,
+  // inserts the row or overwrites the row with key
+  UPSERT,
+  // response payload is the row without the key
+  GET,
+  // response payload is the uint64_t number of rows of the table
+  COUNT
+};
+
+enum class Status : uint8_t
+{
+  OK,
+  NOT_FOUND,
+  DUPLICATE_KEY,
+  NO_SUCH_TABLE,
+  BAD_REQUEST,
+  SERVER_ERROR,
+  // INSERT or UPSERT was applied but the group commit failed, the row is visible to later requests and
+  // is written by the next commit that succeeds, it is lost when the server stops before that
+  UNKNOWN_OUTCOME
+};
+
+#pragma pack(1)
+struct RequestHeader
+{
+  uint32_t length = 0;
+  Opcode op = Opcode::GET;
+  uint8_t reserved = 0;
+  uint16_t table = 0;
+  uint32_t key = 0;
+};
+
+struct ResponseHeader
+{
+  uint32_t length = 0;
+  Status status = Status::OK;
+  std::array<uint8_t,3> reserved{};
+};
+#pragma pack()
+
+// larger requests are rejected and the connection is closed
+inline constexpr uint32_t MAX_REQUEST_PAYLOAD = 4096;
@@ -0,0 +1,426 @@
+#include "Server.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <numeric>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr size_t READ_SIZE = 64*1024;
+// bytes read from one connection per poll round, so a client that keeps sending does not starve the others
+constexpr size_t MAX_READ_PER_ROUND = 4*READ_SIZE;
+// responses of a connection that were not sent yet, above it no requests are read from the connection
+// until the client received them, so a client that does not read can not grow the output without bound
+constexpr size_t MAX_PENDING_OUTPUT = 1024*1024;
+// poll timeout in ms while the database file is defragmented, a step runs whenever poll times out
+constexpr int DEFRAGMENT_POLL = 10;
+
+// OPEN and COUNT depend on the requests before them, the requests between them may be reordered
+bool isBarrier(const RequestHeader& header)
+{
+  return header.op==Opcode::OPEN || header.op==Opcode::COUNT;
+}
+}
+
+Server::Server(Database& db, std::string socketPath, const ServerOptions& options):
+m_db(db),
+m_socketPath(std::move(socketPath)),
+m_options(options)
+{
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if(m_socketPath.empty() || m_socketPath.size()>=sizeof(address.sun_path))
+  {
+    throw ServerException(fmt::format("Invalid socket path '{}'",m_socketPath));
+  }
+  std::memcpy(address.sun_path,m_socketPath.data(),m_socketPath.size());
+
+  int pipe[2];
+  if(::pipe2(pipe,O_NONBLOCK | O_CLOEXEC)!=0)
+  {
+    throw ServerException(fmt::format("Unable to create pipe: {}",std::strerror(errno)));
+  }
+  m_wakeRead = pipe[0];
+  m_wakeWrite = pipe[1];
+
+  m_listen = ::socket(AF_UNIX,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,0);
+  if(m_listen<0)
+  {
+    const int error = errno;
+    ::close(m_wakeRead);
+    ::close(m_wakeWrite);
+    throw ServerException(fmt::format("Unable to create socket: {}",std::strerror(error)));
+  }
+  // a socket file left behind by a server that did not shut down cleanly
+  ::unlink(m_socketPath.c_str());
+  if(::bind(m_listen,reinterpret_cast<const sockaddr*>(&address),sizeof(address))!=0
+    || ::listen(m_listen,m_options.backlog)!=0)
+  {
+    const int error = errno;
+    ::close(m_listen);
+    ::close(m_wakeRead);
+    ::close(m_wakeWrite);
+    throw ServerException(fmt::format("Unable to listen on {}: {}",m_socketPath,std::strerror(error)));
+  }
+}
+
+Server::~Server()
+{
+  for(auto& connection: m_connections)
+  {
+    ::close(connection.fd);
+  }
+  ::close(m_listen);
+  ::close(m_wakeRead);
+  ::close(m_wakeWrite);
+  ::unlink(m_socketPath.c_str());
+}
+
+void Server::run()
+{
+  std::vector<pollfd> fds;
+  while(!m_stop.load(std::memory_order_acquire))
+  {
+    fds.clear();
+    fds.push_back(pollfd{m_wakeRead,POLLIN,0});
+    fds.push_back(pollfd{m_listen,POLLIN,0});
+    for(const auto& connection: m_connections)
+    {
+      const size_t pending = connection.out.size()-connection.written;
+      const bool readable = pending<MAX_PENDING_OUTPUT;
+      if(!readable)
+      {
+        m_throttled.fetch_add(1,std::memory_order_relaxed);
+      }
+      fds.push_back(pollfd{connection.fd,static_cast<short>((readable ? POLLIN : 0) | (pending!=0 ? POLLOUT : 0)),0});
+    }
+    const int timeout = (m_options.defragment && !m_db.defragmented()) ? DEFRAGMENT_POLL : -1;
+    const int ready = ::poll(fds.data(),fds.size(),timeout);
+    if(ready<0)
+    {
+      if(errno==EINTR)
+      {
+        continue;
+      }
+      throw ServerException(fmt::format("poll failed: {}",std::strerror(errno)));
+    }
+    if(ready==0)
+    {
+      // idle, the moved pages are written by the next commit
+      static_cast<void>(m_db.defragment());
+      continue;
+    }
+    if(fds[0].revents!=0)
+    {
+      char buffer[64];
+      while(::read(m_wakeRead,buffer,sizeof(buffer))>0)
+      {
+      }
+      continue;
+    }
+
+    // connections accepted now are polled in the next round
+    const size_t polled = m_connections.size();
+    for(size_t i=0; i<polled; ++i)
+    {
+      // a connection with too many pending responses is only written, a failed send closes it
+      if((fds[i+2].events & POLLIN) && (fds[i+2].revents & (POLLIN | POLLHUP | POLLERR)))
+      {
+        read(i);
+      }
+    }
+    if(fds[1].revents & POLLIN)
+    {
+      accept();
+    }
+
+    execute();
+
+    for(auto& connection: m_connections)
+    {
+      write(connection);
+      // drop the requests of the batch
+      connection.in.erase(connection.in.begin(),connection.in.begin()+static_cast<std::ptrdiff_t>(connection.parsed));
+      connection.parsed = 0;
+    }
+    std::erase_if(m_connections,[](const Connection& connection)
+    {
+      if(connection.closed)
+      {
+        ::close(connection.fd);
+      }
+      return connection.closed;
+    });
+  }
+}
+
+void Server::stop() noexcept
+{
+  m_stop.store(true,std::memory_order_release);
+  const char byte = 0;
+  [[maybe_unused]] auto ret = ::write(m_wakeWrite,&byte,1);
+}
+
+void Server::accept()
+{
+  for(;;)
+  {
+    const int fd = ::accept4(m_listen,nullptr,nullptr,SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd<0)
+    {
+      if(errno==EINTR)
+      {
+        continue;
+      }
+      // EAGAIN once all pending connections are accepted, other errors only affect the connecting client
+      return;
+    }
+    Connection connection;
+    connection.fd = fd;
+    m_connections.push_back(std::move(connection));
+  }
+}
+
+void Server::read(size_t index)
+{
+  auto& connection = m_connections[index];
+  // poll reports the rest of the input again in the next round
+  for(size_t received = 0; received<MAX_READ_PER_ROUND;)
+  {
+    const size_t size = connection.in.size();
+    connection.in.resize(size+READ_SIZE);
+    const ssize_t ret = ::read(connection.fd,connection.in.data()+size,READ_SIZE);
+    connection.in.resize(size+static_cast<size_t>(std::max<ssize_t>(ret,0)));
+    if(ret>0)
+    {
+      received += static_cast<size_t>(ret);
+      continue;
+    }
+    if(ret<0 && errno==EINTR)
+    {
+      continue;
+    }
+    if(ret==0 || (errno!=EAGAIN && errno!=EWOULDBLOCK))
+    {
+      // the requests that arrived before the client closed are still answered, if it can receive them
+      connection.closed = true;
+    }
+    break;
+  }
+
+  while(connection.in.size()-connection.parsed>=sizeof(RequestHeader))
+  {
+    RequestHeader header;
+    std::memcpy(&header,connection.in.data()+connection.parsed,sizeof(header));
+    if(header.length>MAX_REQUEST_PAYLOAD)
+    {
+      connection.closed = true;
+      break;
+    }
+    if(connection.in.size()-connection.parsed<sizeof(header)+header.length)
+    {
+      break;
+    }
+    const char* payload = connection.in.data()+connection.parsed+sizeof(header);
+    m_batch.push_back(Request{index,header,std::span<const char>(payload,header.length)});
+    connection.parsed += sizeof(header)+header.length;
+  }
+}
+
+void Server::write(Connection& connection)
+{
+  while(connection.written<connection.out.size())
+  {
+    const ssize_t ret = ::send(connection.fd,connection.out.data()+connection.written,
+                               connection.out.size()-connection.written,MSG_NOSIGNAL);
+    if(ret<0)
+    {
+      if(errno==EINTR)
+      {
+        continue;
+      }
+      if(errno!=EAGAIN && errno!=EWOULDBLOCK)
+      {
+        connection.closed = true;
+      }
+      break;
+    }
+    connection.written += static_cast<size_t>(ret);
+  }
+  if(connection.written==connection.out.size())
+  {
+    connection.out.clear();
+    connection.written = 0;
+  }
+}
+
+void Server::execute()
+{
+  if(m_batch.empty())
+  {
+    return;
+  }
+  std::vector<size_t> order(m_batch.size());
+  std::iota(order.begin(),order.end(),size_t{0});
+  size_t begin = 0;
+  for(size_t i=0; i<=m_batch.size(); ++i)
+  {
+    if(i==m_batch.size() || isBarrier(m_batch[i].header))
+    {
+      // stable, so requests on the same key keep their order
+      std::stable_sort(order.begin()+static_cast<std::ptrdiff_t>(begin),order.begin()+static_cast<std::ptrdiff_t>(i),
+        [&](size_t lhs, size_t rhs)
+        {
+          const auto& l = m_batch[lhs].header;
+          const auto& r = m_batch[rhs].header;
+          return l.table<r.table || (l.table==r.table && l.key<r.key);
+        });
+      begin = i+1;
+    }
+  }
+
+  m_responseData.clear();
+  std::vector<Response> responses(m_batch.size());
+  std::vector<Table*> written;
+  for(auto index: order)
+  {
+    responses[index] = execute(m_batch[index],written);
+  }
+  if(m_options.groupCommit && !written.empty())
+  {
+    try
+    {
+      m_db.flush(written);
+      ++m_commits;
+    }
+    catch(const DBException& e)
+    {
+      fmt::print(stderr,"{}\n",e.what());
+      // the rows stay in the tables, the BTree can not take them back, so the clients learn that they
+      // are not durable yet instead of a plain error
+      for(size_t i=0; i<m_batch.size(); ++i)
+      {
+        const auto op = m_batch[i].header.op;
+        if(responses[i].status==Status::OK && (op==Opcode::INSERT || op==Opcode::UPSERT))
+        {
+          responses[i] = Response{Status::UNKNOWN_OUTCOME};
+        }
+      }
+    }
+  }
+
+  // responses of a connection in the order of its requests
+  for(size_t i=0; i<m_batch.size(); ++i)
+  {
+    auto& out = m_connections[m_batch[i].connection].out;
+    const ResponseHeader header{.length = responses[i].length,.status = responses[i].status};
+    const auto* bytes = reinterpret_cast<const char*>(&header);
+    out.insert(out.end(),bytes,bytes+sizeof(header));
+    const auto data = m_responseData.begin()+static_cast<std::ptrdiff_t>(responses[i].offset);
+    out.insert(out.end(),data,data+responses[i].length);
+  }
+  m_batch.clear();
+}
+
+Server::Response Server::execute(const Request& request, std::vector<Table*>& written)
+{
+  const auto& header = request.header;
+  try
+  {
+    if(header.op==Opcode::OPEN)
+    {
+      const std::string_view name(request.payload.data(),request.payload.size());
+      if(!m_db.hasTable(name))
+      {
+        return respond(Status::NO_SUCH_TABLE);
+      }
+      Table* table = &m_db.table(name);
+      auto it = std::find(m_tables.begin(),m_tables.end(),table);
+      if(it==m_tables.end())
+      {
+        if(m_tables.size()>std::numeric_limits<uint16_t>::max())
+        {
+          return respond(Status::SERVER_ERROR);
+        }
+        it = m_tables.insert(m_tables.end(),table);
+      }
+      const auto handle = static_cast<uint16_t>(it-m_tables.begin());
+      return respond(Status::OK,std::span<const char>(reinterpret_cast<const char*>(&handle),sizeof(handle)));
+    }
+
+    if(header.table>=m_tables.size())
+    {
+      return respond(Status::NO_SUCH_TABLE);
+    }
+    Table& table = *m_tables[header.table];
+    const size_t rowSize = table.schema().rowSize();
+    switch(header.op)
+    {
+      case Opcode::INSERT:
+      case Opcode::UPSERT:
+      {
+        if(request.payload.size()!=rowSize)
+        {
+          return respond(Status::BAD_REQUEST);
+        }
+        RowData row{};
+        std::memcpy(row.data(),request.payload.data(),rowSize);
+        bool inserted = true;
+        if(header.op==Opcode::INSERT)
+        {
+          inserted = table.emplace(header.key,row);
+        }
+        else
+        {
+          table.assign(header.key,row);
+        }
+        if(!inserted)
+        {
+          return respond(Status::DUPLICATE_KEY);
+        }
+        if(std::find(written.begin(),written.end(),&table)==written.end())
+        {
+          written.push_back(&table);
+        }
+        return respond(Status::OK);
+      }
+      case Opcode::GET:
+      {
+        // copied from the index or the leaf straight into the response
+        const auto row = table.view(header.key);
+        if(!row)
+        {
+          return respond(Status::NOT_FOUND);
+        }
+        return respond(Status::OK,std::span<const char>(row->data(),rowSize));
+      }
+      case Opcode::COUNT:
+      {
+        const uint64_t count = table.size();
+        return respond(Status::OK,std::span<const char>(reinterpret_cast<const char*>(&count),sizeof(count)));
+      }
+      case Opcode::OPEN:
+        break;
+    }
+    return respond(Status::BAD_REQUEST);
+  }
+  catch(const std::exception& e)
+  {
+    fmt::print(stderr,"{}\n",e.what());
+    return respond(Status::SERVER_ERROR);
+  }
+}
+
+Server::Response Server::respond(Status status, std::span<const char> payload)
+{
+  Response response{status,m_responseData.size(),static_cast<uint32_t>(payload.size())};
+  m_responseData.insert(m_responseData.end(),payload.begin(),payload.end());
+  return response;
+}
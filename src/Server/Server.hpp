@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../DB.hpp"
+#include "Protocol.hpp"
+
+class ServerException : public DBException
+{
+public:
+  ServerException(const std::string& msg) : DBException(fmt::format("<Server>: \"{}\"", msg)) {}
+  virtual ~ServerException() noexcept = default;
+};
+
+struct ServerOptions
+{
+  // commit the tables written by a batch with one flush before the responses of the batch are sent
+  bool groupCommit = true;
+  int backlog = 128;
+  // defragment the page chains while no requests arrive, see Database::defragment
+  bool defragment = true;
+};
+
+// Serves the tables of a database on a Unix domain socket with the protocol of Protocol.hpp
+// A single thread polls all connections, the requests that arrived in one poll round form a batch.
+// Requests on different keys commute, so within a batch they run ordered by table and key and
+// consecutive inserts go to the same or neighbouring leaves. OPEN and COUNT are executed in arrival order.
+// All tables written by a batch are committed with a single flush, which writes only the changed pages
+// and is atomic, see Table::flush and Pager.
+// A connection is not read while too many of its responses are pending, the client has to receive them first
+// While the connections are idle the server runs steps of the defragmentation of the database file
+class Server
+{
+public:
+  Server(Database& db, std::string socketPath, const ServerOptions& options = ServerOptions());
+  Server(const Server&) = delete;
+  Server(Server&&) = delete;
+  Server& operator=(const Server&) = delete;
+  Server& operator=(Server&&) = delete;
+  // closes all connections and removes the socket
+  ~Server();
+
+  // Serves connections until stop is called
+  void run();
+
+  // may be called from any thread, run returns after the current batch
+  void stop() noexcept;
+
+  [[nodiscard]] const std::string& socketPath() const noexcept
+  {
+    return m_socketPath;
+  }
+
+  // flushes done by group commit, a single one for all writes of a batch
+  [[nodiscard]] uint64_t commits() const noexcept
+  {
+    return m_commits;
+  }
+
+  // times a connection was not read in a poll round because too many of its responses were pending,
+  // may be called from any thread
+  [[nodiscard]] uint64_t throttled() const noexcept
+  {
+    return m_throttled.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Connection
+  {
+    int fd = -1;
+    std::vector<char> in;
+    // start of the first request in in that was not parsed yet
+    size_t parsed = 0;
+    std::vector<char> out;
+    size_t written = 0;
+    bool closed = false;
+  };
+
+  struct Request
+  {
+    size_t connection;
+    RequestHeader header;
+    // points into Connection::in, valid until the batch was executed
+    std::span<const char> payload;
+  };
+
+  struct Response
+  {
+    Status status = Status::OK;
+    // payload in m_responseData
+    size_t offset = 0;
+    uint32_t length = 0;
+  };
+
+  void accept();
+  // reads the available bytes of the connection and adds its complete requests to the batch
+  void read(size_t index);
+  void write(Connection& connection);
+  void execute();
+  Response execute(const Request& request, std::vector<Table*>& written);
+  Response respond(Status status, std::span<const char> payload = {});
+
+  Database& m_db;
+  std::string m_socketPath;
+  ServerOptions m_options;
+  int m_listen = -1;
+  // stop writes to m_wakeWrite to interrupt poll
+  int m_wakeRead = -1;
+  int m_wakeWrite = -1;
+  std::atomic<bool> m_stop = false;
+  uint64_t m_commits = 0;
+  std::atomic<uint64_t> m_throttled = 0;
+
+  std::vector<Connection> m_connections;
+  std::vector<Request> m_batch;
+  std::vector<char> m_responseData;
+  // tables opened by clients, the index is the handle
+  std::vector<Table*> m_tables;
+};
@@ -3,18 +3,61 @@
 // #include "Pager.hpp"
 // #include "Command.hpp"
 #include "BTree.hpp"
+#include "Server.hpp"
 
+#include <csignal>
 #include <iostream>
+#include <string_view>
 #include <vector>
 #include <map>
 
+namespace
+{
+Server* runningServer = nullptr;
+
+void stopServer(int)
+{
+  if(runningServer)
+  {
+    runningServer->stop();
+  }
+}
+
+// db <file> --serve <socket>: serves the tables of file on a Unix domain socket until SIGINT or SIGTERM
+int serve(const std::string& filename, const std::string& socketPath)
+{
+  Database db(filename);
+  Server server(db,socketPath);
+  runningServer = &server;
+  std::signal(SIGINT,stopServer);
+  std::signal(SIGTERM,stopServer);
+  fmt::print("Serving {} on {}\n",filename,socketPath);
+  server.run();
+  runningServer = nullptr;
+  return 0;
+}
+}
+
 void print_prompt() 
 { 
     fmt::print("db > "); 
 }
 
-int main(/*int argc, char* argv[]*/) 
+int main(int argc, char* argv[]) 
 {
+  if(argc==4 && std::string_view(argv[2])=="--serve")
+  {
+    try
+    {
+      return serve(argv[1],argv[3]);
+    }
+    catch(const DBException& e)
+    {
+      fmt::print(stderr,"{}\n",e.what());
+      return 1;
+    }
+  }
+
   // std::string input_buffer;
   // const std::string dbFile = "file.db";
   // Table table(dbFile);
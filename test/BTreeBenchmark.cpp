@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <fmt/core.h>
+
+#include "BTree.hpp"
+#include "PartitionedBTree.hpp"
+#include "NodeSizes.hpp"
+#include "BufferedBTree.hpp"
+
+// Insert throughput for random and descending keys, the insert paths shift and split rows inside the nodes
+// Larger rows make the row moves dominate, run with a Release build
+// Node sizes lists lookup and scan times of the leaf and internal node sizes measured by NodeSizes.hpp
+// Write buffer compares the insert latency of random keys into a BTree and into a BufferedBTree
+// Parallel ingest compares producers sharing one locked BTree with producers inserting into a PartitionedBTree
+
+namespace
+{
+template<size_t ValueSize, size_t PageSize>
+void benchmark(const std::vector<uint32_t>& keys, const char* order)
+{
+  using ValueType = std::array<char,ValueSize>;
+  constexpr int runs = 5;
+  double best = 0;
+  for(int run=0; run<runs; ++run)
+  {
+    BTree<uint32_t,ValueType,PageSize> tree;
+    ValueType value{};
+    const auto start = std::chrono::steady_clock::now();
+    for(auto key: keys)
+    {
+      value[0] = static_cast<char>(key);
+      tree.emplace(key,value);
+    }
+    const std::chrono::duration<double,std::nano> elapsed = std::chrono::steady_clock::now()-start;
+    const double perInsert = elapsed.count()/static_cast<double>(keys.size());
+    best = run==0 ? perInsert : std::min(best,perInsert);
+  }
+  fmt::print("{:>10} value {:>4} B page {:>6} B: {:8.1f} ns/insert\n",order,ValueSize,PageSize,best);
+}
+
+template<size_t ValueSize, size_t PageSize>
+void benchmarkOrders(size_t count)
+{
+  std::vector<uint32_t> keys(count);
+  for(size_t i=0; i<count; ++i)
+  {
+    keys[i] = static_cast<uint32_t>(count-i);
+  }
+  benchmark<ValueSize,PageSize>(keys,"descending");
+  std::shuffle(keys.begin(),keys.end(),std::mt19937(42));
+  benchmark<ValueSize,PageSize>(keys,"random");
+}
+
+// every producer inserts increasing keys, interleaved with the keys of the other producers
+template<typename Insert>
+double ingest(unsigned producers, size_t rowsPerProducer, Insert&& insert)
+{
+  std::vector<std::thread> threads;
+  const auto start = std::chrono::steady_clock::now();
+  for(unsigned t=0; t<producers; ++t)
+  {
+    threads.emplace_back([&, t]()
+    {
+      for(size_t i=0; i<rowsPerProducer; ++i)
+      {
+        insert(static_cast<uint32_t>(i*producers+t));
+      }
+    });
+  }
+  for(auto& thread: threads)
+  {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now()-start;
+  return static_cast<double>(producers*rowsPerProducer)/elapsed.count()/1e6;
+}
+
+template<typename ValueType>
+void benchmarkNodeSizes(size_t rows)
+{
+  const auto sizes = measureNodeSizes<uint32_t,ValueType>(rows,[](size_t i){ return static_cast<uint32_t>(i); });
+  fmt::print("value {:>4} B, {} rows\n",sizeof(ValueType),rows);
+  for(const auto& size: sizes)
+  {
+    fmt::print("  leaf {:>6} B inner {:>5} B: {:8.1f} ns/lookup {:6.2f} ns/row scanned\n",
+               size.leafPageSize,size.innerPageSize,size.lookupNs,size.scanNs);
+  }
+  fmt::print("  recommended leaf {} B inner {} B\n",sizes.front().leafPageSize,sizes.front().innerPageSize);
+}
+
+// percentiles of the latency of every insert
+template<typename Insert>
+void latency(const char* name, const std::vector<uint32_t>& keys, Insert&& insert)
+{
+  std::vector<double> latencies;
+  latencies.reserve(keys.size());
+  const auto start = std::chrono::steady_clock::now();
+  for(auto key: keys)
+  {
+    const auto begin = std::chrono::steady_clock::now();
+    insert(key);
+    latencies.push_back(std::chrono::duration<double,std::nano>(std::chrono::steady_clock::now()-begin).count());
+  }
+  const std::chrono::duration<double,std::nano> elapsed = std::chrono::steady_clock::now()-start;
+  std::sort(latencies.begin(),latencies.end());
+  const auto percentile = [&](double p){ return latencies[static_cast<size_t>(p*static_cast<double>(latencies.size()-1))]; };
+  fmt::print("{:>14}: {:8.1f} ns/insert p50 {:8.1f} ns p99 {:8.1f} ns p99.9 {:10.1f} ns\n",name,
+             elapsed.count()/static_cast<double>(keys.size()),percentile(0.5),percentile(0.99),percentile(0.999));
+}
+
+template<size_t ValueSize, size_t PageSize>
+void benchmarkWriteBuffer(size_t count)
+{
+  using ValueType = std::array<char,ValueSize>;
+  std::vector<uint32_t> keys(count);
+  for(size_t i=0; i<count; ++i)
+  {
+    keys[i] = static_cast<uint32_t>(i);
+  }
+  std::shuffle(keys.begin(),keys.end(),std::mt19937(42));
+  fmt::print("random inserts value {:>4} B page {:>6} B\n",ValueSize,PageSize);
+  BTree<uint32_t,ValueType,PageSize> tree;
+  latency("BTree",keys,[&](uint32_t key)
+  {
+    tree.emplace(key,ValueType{});
+  });
+  BufferedBTree<uint32_t,ValueType,PageSize> buffered;
+  latency("BufferedBTree",keys,[&](uint32_t key)
+  {
+    buffered.assign(key,ValueType{});
+  });
+}
+
+void benchmarkIngest(size_t rows)
+{
+  for(unsigned producers: {1u,2u,4u,8u})
+  {
+    const size_t rowsPerProducer = rows/producers;
+    BTree<uint32_t,uint64_t> tree;
+    std::mutex mutex;
+    const double locked = ingest(producers,rowsPerProducer,[&](uint32_t key)
+    {
+      std::lock_guard lock(mutex);
+      tree.emplace(key,key);
+    });
+    PartitionedBTree<uint32_t,uint64_t> partitioned(std::max(producers,std::thread::hardware_concurrency()));
+    const double sharded = ingest(producers,rowsPerProducer,[&](uint32_t key)
+    {
+      partitioned.emplace(key,key);
+    });
+    fmt::print("{:>2} producers: locked BTree {:6.2f} M rows/s, {} shards {:6.2f} M rows/s\n",
+               producers,locked,partitioned.shardCount(),sharded);
+  }
+}
+}
+
+int main()
+{
+  benchmarkOrders<12,4096>(200000);
+  benchmarkOrders<124,16384>(200000);
+  benchmarkOrders<252,65536>(200000);
+  benchmarkNodeSizes<uint64_t>(1000000);
+  benchmarkNodeSizes<std::array<char,124>>(200000);
+  benchmarkWriteBuffer<124,16384>(400000);
+  benchmarkWriteBuffer<252,65536>(200000);
+  benchmarkIngest(400000);
+  return 0;
+}
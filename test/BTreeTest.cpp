@@ -1,7 +1,13 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include "BTree.hpp"
+#include "PartitionedBTree.hpp"
+#include "NodeSizes.hpp"
+#include "BufferedBTree.hpp"
 
 
 class BTreeTest : public ::testing::Test {
@@ -130,7 +136,8 @@ TEST_F(BTreeTest, SplitInternalNewRoot)
     EXPECT_EQ(val, ret);
     EXPECT_EQ(btree.size(), (InternalNode<int,std::array<int,1000>,0>::maxValues+99));
     EXPECT_EQ(rootnode->m_size, 2);
-    EXPECT_EQ(rootnode->keys[0], ((InternalNode<int,std::array<int,1000>,0>::maxValues+1)/2+1));
+    // appends split full nodes, the left node keeps all but one of its children
+    EXPECT_EQ(rootnode->keys[0], (InternalNode<int,std::array<int,1000>,0>::maxValues));
 }
 
 TEST_F(BTreeTest, SplitInternalNewRootDecreasing) 
@@ -156,8 +163,13 @@ TEST_F(BTreeTest, SplitInternalNewRootDecreasing)
 TEST_F(BTreeTest, SplitInternalUpdateParent) 
 {
     const size_t pagesize = 128;
+    // appended rows fill the leaves, the internal nodes keep all but one of their children
+    const int leafRows = LeafNode<int,long long,pagesize>::maxValues;
+    const int children = InternalNode<int,long long,0,pagesize>::maxValues-1;
+    // enough rows to split the internal node below the root once it is full
+    const int rows = leafRows*children*(children+2);
     BTree<int,long long, pagesize> btree;
-    for(int i = 0; i<512; ++i)
+    for(int i = 0; i<rows; ++i)
     {
         btree.emplace(i,i);
     }
@@ -166,9 +178,39 @@ TEST_F(BTreeTest, SplitInternalUpdateParent)
     auto& rootnode = std::get<InternalNode<int,long long,2, pagesize>*>(btree.m_root);
 
     EXPECT_EQ(val, 128);
-    EXPECT_EQ(btree.size(), 512);
-    EXPECT_EQ(rootnode->m_size, 5);
-    EXPECT_EQ(rootnode->keys[0], 100);
+    EXPECT_EQ(btree.size(), rows);
+    EXPECT_EQ(rootnode->m_size, 2);
+    EXPECT_EQ(rootnode->keys[0], leafRows*children*children);
+}
+
+TEST_F(BTreeTest, SplitRandomDescentPath) 
+{
+    const size_t pagesize = 128;
+    // nodes do not point to their parent, splits use the path of the descent
+    static_assert(LeafNode<int,long long,pagesize>::headerSize==sizeof(uint32_t)*2);
+    BTree<int,long long, pagesize> btree;
+    std::vector<int> keys(600);
+    for(int i = 0; i<600; ++i)
+    {
+        keys[i] = (i*7919)%600;
+    }
+    for(auto key: keys)
+    {
+        btree.emplace(key,-key);
+    }
+    EXPECT_TRUE((std::holds_alternative<InternalNode<int,long long,2, pagesize>*>(btree.m_root)));
+    int expected = 0;
+    for(auto& row: btree)
+    {
+        ASSERT_EQ(row.key, expected);
+        EXPECT_EQ(row.value, -expected);
+        ++expected;
+    }
+    EXPECT_EQ(expected, 600);
+    for(auto key: keys)
+    {
+        EXPECT_EQ(btree.at(key), -key);
+    }
 }
 
 // Test if default constructed value of key dus not give duplicate key error
@@ -177,4 +219,675 @@ TEST_F(BTreeTest, DefaultKey)
     BTree<int,int> btree;
     auto val = btree.emplace(0,0);
     EXPECT_EQ(val, 0);
-}
\ No newline at end of file
+}
+TEST_F(BTreeTest, Iterate) 
+{
+    const size_t pagesize = 128;
+    BTree<int,long long, pagesize> btree;
+    for(int i = 511; i>=0; --i)
+    {
+        btree.emplace(i*2,i);
+    }
+    long long expected = 0;
+    for(auto& row: btree)
+    {
+        EXPECT_EQ(row.key, expected*2);
+        EXPECT_EQ(row.value, expected);
+        ++expected;
+    }
+    EXPECT_EQ(expected, 512);
+    EXPECT_EQ(btree.lower_bound(301)->key, 302);
+    EXPECT_EQ(btree.find(301), btree.end());
+    EXPECT_EQ(btree.find(300)->value, 150);
+    EXPECT_EQ(btree.lower_bound(2000), btree.end());
+}
+
+TEST_F(BTreeTest, AppendAfterSplit) 
+{
+    const size_t pagesize = 128;
+    BTree<int,long long, pagesize> btree;
+    for(int i = 0; i<200; i+=2)
+    {
+        btree.emplace(i,i);
+    }
+    // splits in the middle and at the end of the tree change the rightmost leaf
+    for(int i = 199; i>0; i-=2)
+    {
+        btree.emplace(i,i);
+    }
+    for(int i = 200; i<300; ++i)
+    {
+        btree.emplace(i,i);
+    }
+    int key = 0;
+    for(auto& row: btree)
+    {
+        EXPECT_EQ(row.key, key);
+        EXPECT_EQ(row.value, key);
+        ++key;
+    }
+    EXPECT_EQ(key, 300);
+    EXPECT_EQ(btree.size(), 300);
+}
+
+TEST_F(BTreeTest, DescendingCompare) 
+{
+    const size_t pagesize = 128;
+    BTree<int,long long, pagesize, std::allocator<long long>, std::greater<int>> btree;
+    for(int i = 0; i<300; ++i)
+    {
+        btree.emplace((i*7)%300,i);
+    }
+    int key = 299;
+    for(auto& row: btree)
+    {
+        EXPECT_EQ(row.key, key);
+        --key;
+    }
+    EXPECT_EQ(key, -1);
+    EXPECT_EQ(btree.at(7), 1);
+    EXPECT_THROW(btree.emplace(7,1), std::out_of_range);
+    EXPECT_EQ(btree.lower_bound(1000)->key, 299);
+}
+
+namespace
+{
+struct CompositeKey
+{
+    uint32_t group;
+    uint32_t id;
+};
+
+// orders by group and id, a bare group compares with all keys of that group as equivalent
+struct CompositeLess
+{
+    using is_transparent = void;
+
+    bool operator()(const CompositeKey& lhs, const CompositeKey& rhs) const
+    {
+        return lhs.group<rhs.group || (lhs.group==rhs.group && lhs.id<rhs.id);
+    }
+    bool operator()(const CompositeKey& lhs, uint32_t group) const
+    {
+        return lhs.group<group;
+    }
+    bool operator()(uint32_t group, const CompositeKey& rhs) const
+    {
+        return group<rhs.group;
+    }
+};
+}
+
+TEST_F(BTreeTest, TransparentLookup) 
+{
+    const size_t pagesize = 128;
+    BTree<int64_t,int, pagesize, std::allocator<int>, std::less<>> btree;
+    for(int i = 0; i<100; ++i)
+    {
+        btree.emplace(i*2,i);
+    }
+    // looked up with an int without converting to the key type
+    EXPECT_EQ(btree.at(int{40}), 20);
+    EXPECT_EQ(btree.find(int{41}), btree.end());
+    EXPECT_EQ(btree.lower_bound(int{41})->key, 42);
+
+    BTree<CompositeKey,int, pagesize, std::allocator<int>, CompositeLess> composite;
+    for(uint32_t group = 0; group<10; ++group)
+    {
+        for(uint32_t id = 0; id<20; ++id)
+        {
+            composite.emplace({group, 19-id}, static_cast<int>(group*100+19-id));
+        }
+    }
+    // first row of group 4
+    auto it = composite.lower_bound(uint32_t{4});
+    EXPECT_EQ(it->key.group, 4u);
+    EXPECT_EQ(it->key.id, 0u);
+    EXPECT_EQ(composite.at(CompositeKey{7, 3}), 703);
+}
+
+TEST_F(BTreeTest, TryEmplace) 
+{
+    const size_t pagesize = 128;
+    BTree<int,long long, pagesize> btree;
+    for(int i = 0; i<100; ++i)
+    {
+        auto [it, inserted] = btree.try_emplace(i,i);
+        EXPECT_TRUE(inserted);
+        EXPECT_EQ(it->key, i);
+    }
+    // duplicates in full leaves are found before the leaf is split
+    for(int i = 0; i<100; ++i)
+    {
+        auto [it, inserted] = btree.try_emplace(i,-1);
+        EXPECT_FALSE(inserted);
+        EXPECT_EQ(it->value, i);
+    }
+    EXPECT_EQ(btree.size(), 100);
+    EXPECT_EQ(std::distance(btree.begin(), btree.end()), 100);
+}
+
+TEST_F(BTreeTest, InsertOrAssign) 
+{
+    const size_t pagesize = 128;
+    BTree<int,long long, pagesize> btree;
+    for(int i = 0; i<50; ++i)
+    {
+        EXPECT_TRUE(btree.insert_or_assign(i*2,i).second);
+    }
+    for(int i = 0; i<100; ++i)
+    {
+        auto [it, inserted] = btree.insert_or_assign(i,1000+i);
+        EXPECT_EQ(inserted, i%2==1);
+        EXPECT_EQ(it->value, 1000+i);
+    }
+    EXPECT_EQ(btree.size(), 100);
+    EXPECT_EQ(btree.at(42), 1042);
+}
+
+TEST_F(BTreeTest, Modify) 
+{
+    BTree<uint32_t,int> btree;
+    btree.emplace(1,3);
+    EXPECT_TRUE(btree.modify(1,[](int& value){ value *= 2; }));
+    EXPECT_FALSE(btree.modify(2,[](int& value){ value *= 2; }));
+    EXPECT_EQ(btree.at(1), 6);
+    EXPECT_EQ(btree.size(), 1);
+}
+
+TEST_F(BTreeTest, ConcurrentLookup) 
+{
+    const size_t pagesize = 256;
+    const int rows = 5000;
+    BTree<int,long long, pagesize> btree;
+    std::atomic<bool> done = false;
+    std::atomic<int> errors = 0;
+    std::vector<std::thread> readers;
+    for(int t = 0; t<4; ++t)
+    {
+        readers.emplace_back([&, t]()
+        {
+            for(int i = t; !done.load(); i = (i*7+13)%rows)
+            {
+                auto value = btree.lookup(i);
+                if(value && *value!=i*3LL)
+                {
+                    ++errors;
+                }
+            }
+        });
+    }
+    for(int i = 0; i<rows; ++i)
+    {
+        btree.emplace((i*7919)%rows,((i*7919)%rows)*3LL);
+    }
+    done = true;
+    for(auto& reader: readers)
+    {
+        reader.join();
+    }
+    EXPECT_EQ(errors.load(), 0);
+    for(int i = 0; i<rows; ++i)
+    {
+        EXPECT_EQ(btree.lookup(i), i*3LL);
+    }
+    EXPECT_FALSE(btree.lookup(rows).has_value());
+}
+
+TEST_F(BTreeTest, ConcurrentLookupNewRoot) 
+{
+    const size_t pagesize = 128;
+    BTree<int,long long, pagesize> btree;
+    std::atomic<bool> done = false;
+    std::atomic<int> errors = 0;
+    std::vector<std::thread> readers;
+    for(int t = 0; t<4; ++t)
+    {
+        readers.emplace_back([&, t]()
+        {
+            for(int i = t; !done.load(); i = (i+1)%300)
+            {
+                auto value = btree.lookup(i);
+                if(value && *value!=-i)
+                {
+                    ++errors;
+                }
+            }
+        });
+    }
+    // the root grows and is replaced by clear while the readers descend from it
+    for(int round = 0; round<50; ++round)
+    {
+        for(int i = 0; i<300; ++i)
+        {
+            btree.emplace(i,-i);
+        }
+        btree.clear();
+    }
+    done = true;
+    for(auto& reader: readers)
+    {
+        reader.join();
+    }
+    EXPECT_EQ(errors.load(), 0);
+}
+
+TEST_F(BTreeTest, Clear) 
+{
+    const size_t pagesize = 128;
+    BTree<int,long long, pagesize> btree;
+    for(int i = 0; i<1000; ++i)
+    {
+        btree.emplace(i,i);
+    }
+    btree.clear();
+    EXPECT_EQ(btree.size(), 0);
+    EXPECT_TRUE(btree.begin()==btree.end());
+    EXPECT_FALSE(btree.lookup(1).has_value());
+    btree.emplace(1,2);
+    EXPECT_EQ(btree.at(1), 2);
+    EpochManager::global().reclaim();
+}
+
+TEST_F(BTreeTest, Contains) 
+{
+    const size_t pagesize = 512;
+    using Value = std::array<char,26>;
+    // the rows leave 24 bytes of the page for the filter
+    static_assert(LeafNode<uint32_t,Value,pagesize>::filterWords==3);
+    BTree<uint32_t,Value,pagesize> btree;
+    for(uint32_t i = 0; i<2000; i+=2)
+    {
+        btree.emplace(i,Value{static_cast<char>(i)});
+    }
+    for(uint32_t i = 0; i<2000; ++i)
+    {
+        EXPECT_EQ(btree.contains(i), i%2==0);
+        EXPECT_EQ(btree.lookup(i).has_value(), i%2==0);
+    }
+    EXPECT_EQ(btree.at(100)[0], 100);
+    EXPECT_THROW(btree.at(101), std::out_of_range);
+    EXPECT_FALSE(btree.contains(5000));
+
+    // rows leaving no room for a filter
+    static_assert(!LeafNode<uint32_t,int>::filtered);
+    BTree<uint32_t,int> unfiltered;
+    unfiltered.emplace(3,4);
+    EXPECT_TRUE(unfiltered.contains(3));
+    EXPECT_FALSE(unfiltered.contains(4));
+}
+
+TEST_F(BTreeTest, EpochReclaim) 
+{
+    EpochManager epochs;
+    int freed = 0;
+    {
+        auto guard = epochs.pin();
+        epochs.retire([&](){ ++freed; });
+        epochs.reclaim();
+        epochs.reclaim();
+        // retired while the guard was held, so it may still be read
+        EXPECT_EQ(freed, 0);
+        EXPECT_EQ(epochs.pending(), 1);
+    }
+    epochs.reclaim();
+    epochs.reclaim();
+    EXPECT_EQ(freed, 1);
+    EXPECT_EQ(epochs.pending(), 0);
+}
+
+TEST_F(BTreeTest, PartitionedParallelIngest) 
+{
+    const int threads = 4;
+    const int rowsPerThread = 5000;
+    PartitionedBTree<int,long long> btree(8);
+    std::vector<std::thread> producers;
+    for(int t = 0; t<threads; ++t)
+    {
+        // every producer appends increasing keys
+        producers.emplace_back([&, t]()
+        {
+            for(int i = 0; i<rowsPerThread; ++i)
+            {
+                btree.emplace(i*threads+t,i);
+            }
+        });
+    }
+    for(auto& producer: producers)
+    {
+        producer.join();
+    }
+    EXPECT_EQ(btree.size(), threads*rowsPerThread);
+    int expected = 0;
+    for(auto& row: btree)
+    {
+        EXPECT_EQ(row.key, expected);
+        EXPECT_EQ(row.value, expected/threads);
+        ++expected;
+    }
+    EXPECT_EQ(expected, threads*rowsPerThread);
+    EXPECT_EQ(btree.lookup(4242), 4242/threads);
+    EXPECT_FALSE(btree.try_emplace(7,0));
+    for(size_t i = 0; i<btree.shardCount(); ++i)
+    {
+        EXPECT_GT(btree.shard(i).size(), 0);
+    }
+}
+
+TEST_F(BTreeTest, PartitionedRange) 
+{
+    using Tree = PartitionedBTree<int,int,PAGE_SIZE,std::allocator<int>,std::less<int>,RangePartitioner<int>>;
+    Tree btree(3,RangePartitioner<int>{{100,200}});
+    for(int i = 299; i>=0; --i)
+    {
+        btree.emplace(i,-i);
+    }
+    EXPECT_EQ(btree.shardIndex(99), 0);
+    EXPECT_EQ(btree.shardIndex(100), 1);
+    EXPECT_EQ(btree.shardIndex(1000), 2);
+    EXPECT_EQ(btree.shard(1).size(), 100);
+    auto it = btree.lower_bound(150);
+    for(int i = 150; i<300; ++i, ++it)
+    {
+        ASSERT_TRUE(it != btree.end());
+        EXPECT_EQ(it->key, i);
+    }
+    EXPECT_TRUE(it == btree.end());
+    EXPECT_TRUE(btree.insert_or_assign(300,1));
+    EXPECT_TRUE(btree.modify(300,[](int& value){ ++value; }));
+    EXPECT_EQ(btree.lookup(300), 2);
+}
+
+TEST_F(BTreeTest, ParallelReduce) 
+{
+    const size_t pagesize = 256;
+    BTree<int,long long, pagesize> btree;
+    WorkStealingPool pool(4);
+    EXPECT_EQ(btree.parallel_reduce(0LL,[](long long& acc, auto& row){ acc += row.value; },std::plus<>(),pool), 0);
+    for(int i = 0; i<5000; ++i)
+    {
+        btree.emplace((i*7919)%5000,i);
+    }
+    const auto sum = btree.parallel_reduce(0LL,[](long long& acc, auto& row){ acc += row.key; },std::plus<>(),pool);
+    EXPECT_EQ(sum, 4999LL*5000/2);
+    // results are merged in key order
+    auto keys = btree.parallel_reduce(std::vector<int>(),[](std::vector<int>& acc, auto& row)
+    {
+        acc.push_back(row.key);
+    },[](std::vector<int> lhs, std::vector<int> rhs)
+    {
+        lhs.insert(lhs.end(),rhs.begin(),rhs.end());
+        return lhs;
+    },pool);
+    ASSERT_EQ(keys.size(), 5000);
+    for(int i = 0; i<5000; ++i)
+    {
+        EXPECT_EQ(keys[i], i);
+    }
+    const auto count = btree.parallel_reduce(1000,3000,0,[](int& acc, auto&){ ++acc; },std::plus<>(),pool);
+    EXPECT_EQ(count, 2000);
+    std::atomic<int> visited = 0;
+    btree.parallel_for_each([&](auto& row){ row.value = -row.key; ++visited; },pool);
+    EXPECT_EQ(visited.load(), 5000);
+    EXPECT_EQ(btree.at(42), -42);
+}
+
+TEST_F(BTreeTest, WorkStealingPoolNested) 
+{
+    WorkStealingPool pool(2);
+    std::atomic<int> calls = 0;
+    pool.parallelFor(8,[&](size_t)
+    {
+        pool.parallelFor(8,[&](size_t){ ++calls; });
+    });
+    EXPECT_EQ(calls.load(), 64);
+    EXPECT_THROW(pool.parallelFor(4,[](size_t i){ if(i==2) throw std::runtime_error("task"); }), std::runtime_error);
+}
+
+TEST_F(BTreeTest, IndependentNodeSizes) 
+{
+    using Tree = BTree<uint32_t,uint64_t,4096,std::allocator<uint64_t>,std::less<uint32_t>,256>;
+    Tree btree;
+    for(uint32_t i = 0; i<100000; ++i)
+    {
+        btree.emplace((i*7919)%100000,i);
+    }
+    uint32_t expected = 0;
+    for(auto& row: btree)
+    {
+        ASSERT_EQ(row.key, expected++);
+    }
+    EXPECT_EQ(expected, 100000);
+    for(uint32_t i = 0; i<100000; i += 997)
+    {
+        EXPECT_EQ(btree.at((i*7919)%100000), i);
+    }
+    EXPECT_FALSE(btree.contains(100000));
+
+    const auto sizes = measureNodeSizes<uint32_t,uint64_t>(20000,[](size_t i){ return static_cast<uint32_t>(i); });
+    EXPECT_EQ(sizes.size(), 12);
+    EXPECT_GT(sizes.front().lookupNs, 0);
+    // small internal nodes limit the rows a tree of MaxDepth levels holds
+    EXPECT_LT((nodeSizeCapacity<uint32_t,uint64_t,4096,256>()), (nodeSizeCapacity<uint32_t,uint64_t,4096,4096>()));
+    EXPECT_THROW((measureNodeSizes<uint32_t,uint64_t>(SIZE_MAX,[](size_t i){ return static_cast<uint32_t>(i); })), BTreeException);
+}
+
+TEST_F(BTreeTest, MergeDisjoint) 
+{
+    const size_t pagesize = 128;
+    using Tree = BTree<int,long long, pagesize>;
+    // every combination of heights, the lower tree is merged into the upper one and the other way round
+    for(int lowerSize: {0, 5, 60, 700, 2000})
+    {
+        for(int upperSize: {0, 5, 60, 700, 2000})
+        {
+            for(bool intoLower: {true, false})
+            {
+                Tree lower;
+                Tree upper;
+                for(int i = 0; i<lowerSize; ++i)
+                {
+                    lower.emplace(i,-i);
+                }
+                for(int i = lowerSize; i<lowerSize+upperSize; ++i)
+                {
+                    upper.emplace(i,-i);
+                }
+                Tree& target = intoLower ? lower : upper;
+                Tree& source = intoLower ? upper : lower;
+                target.merge(std::move(source));
+                ASSERT_EQ(target.size(), static_cast<size_t>(lowerSize+upperSize));
+                EXPECT_EQ(source.size(), 0);
+                EXPECT_EQ(source.begin(), source.end());
+                int expected = 0;
+                for(auto& row: target)
+                {
+                    ASSERT_EQ(row.key, expected);
+                    EXPECT_EQ(row.value, -expected);
+                    ++expected;
+                }
+                ASSERT_EQ(expected, lowerSize+upperSize);
+                for(int i = 0; i<lowerSize+upperSize; ++i)
+                {
+                    ASSERT_EQ(target.at(i), -i);
+                }
+                // the spliced tree still splits along its edges
+                target.emplace(lowerSize+upperSize,0);
+                target.emplace(-1,0);
+                EXPECT_TRUE(target.contains(-1));
+                EXPECT_EQ(target.size(), static_cast<size_t>(lowerSize+upperSize+2));
+                source.emplace(1,1);
+                EXPECT_EQ(source.at(1), 1);
+            }
+        }
+    }
+}
+
+TEST_F(BTreeTest, ConcurrentLookupMerge)
+{
+    const size_t pagesize = 256;
+    using Tree = BTree<int,long long, pagesize>;
+    Tree btree;
+    for(int i = 0; i<2000; ++i)
+    {
+        btree.emplace(i,-i);
+    }
+    std::atomic<bool> done = false;
+    std::atomic<int> errors = 0;
+    std::vector<std::thread> readers;
+    for(int t = 0; t<4; ++t)
+    {
+        readers.emplace_back([&, t]()
+        {
+            for(int i = t; !done.load(); i = (i+1)%2000)
+            {
+                // the rows present before the merges are found while the edges are relinked
+                auto value = btree.lookup(i);
+                if(!value || *value!=-i)
+                {
+                    ++errors;
+                }
+            }
+        });
+    }
+    // smaller trees are spliced into the left and the right edge
+    for(int round = 1; round<=40; ++round)
+    {
+        Tree other;
+        const int base = (round%2==0) ? 2000*round : -2000*round;
+        for(int i = base; i<base+round*20; ++i)
+        {
+            other.emplace(i,-i);
+        }
+        btree.merge(std::move(other));
+    }
+    done = true;
+    for(auto& reader: readers)
+    {
+        reader.join();
+    }
+    EXPECT_EQ(errors.load(), 0);
+    EXPECT_EQ(btree.size(), 2000+20*(40*41/2));
+}
+
+TEST_F(BTreeTest, MergeOverlapping)
+{
+    const size_t pagesize = 128;
+    using Tree = BTree<int,long long, pagesize>;
+    Tree evens;
+    Tree threes;
+    for(int i = 0; i<3000; i+=2)
+    {
+        evens.emplace(i,i);
+    }
+    for(int i = 0; i<3000; i+=3)
+    {
+        threes.emplace(i,-i);
+    }
+
+    auto sum = [](long long lhs, long long rhs)
+    {
+        return lhs+rhs;
+    };
+    auto both = Tree::set_intersection(evens,threes,sum);
+    EXPECT_EQ(both.size(), 500);
+    int expected = 0;
+    for(auto& row: both)
+    {
+        ASSERT_EQ(row.key, expected);
+        EXPECT_EQ(row.value, 0);
+        expected += 6;
+    }
+    auto any = Tree::set_union(evens,threes);
+    EXPECT_EQ(any.size(), 2000);
+    expected = 0;
+    for(auto& row: any)
+    {
+        while(expected%2!=0 && expected%3!=0)
+        {
+            ++expected;
+        }
+        ASSERT_EQ(row.key, expected);
+        // the value of the left tree wins
+        EXPECT_EQ(row.value, expected%2==0 ? expected : -expected);
+        ++expected;
+    }
+    EXPECT_EQ(evens.size(), 1500);
+    EXPECT_EQ(threes.size(), 1000);
+
+    evens.merge(std::move(threes));
+    EXPECT_EQ(evens.size(), 2000);
+    EXPECT_EQ(threes.size(), 0);
+    for(auto& row: any)
+    {
+        ASSERT_EQ(evens.at(row.key), row.value);
+    }
+    evens.emplace(1,1);
+    EXPECT_EQ(evens.at(1), 1);
+
+    Tree empty;
+    auto none = Tree::set_intersection(evens,empty);
+    EXPECT_EQ(none.size(), 0);
+    EXPECT_EQ(none.begin(), none.end());
+}
+
+TEST_F(BTreeTest, BufferedInserts) 
+{
+    const size_t pagesize = 128;
+    BufferedBTree<int,long long, pagesize> btree(64);
+    const size_t pending = EpochManager::global().pending();
+    std::vector<int> keys(3000);
+    for(int i = 0; i<3000; ++i)
+    {
+        keys[i] = (i*7919)%3000;
+    }
+    for(auto key: keys)
+    {
+        EXPECT_TRUE(btree.try_emplace(key,-key));
+        // rows in the buffers and in the main BTree are found
+        ASSERT_EQ(btree.lookup(key), -key);
+        EXPECT_FALSE(btree.try_emplace(key,key));
+    }
+    EXPECT_GT(btree.merges(), 0);
+    // the full buffer is moved a few rows per insert, at most one buffer waits besides the active one
+    EXPECT_LT(btree.buffered(), 2*64);
+    EXPECT_GT(btree.tree().size(), 3000-2*64);
+    // moved buffers are freed right away, not left to the epoch manager
+    EXPECT_EQ(EpochManager::global().pending(), pending);
+
+    // reads do not move the buffered rows
+    const size_t merges = btree.merges();
+    const size_t buffered = btree.buffered();
+    EXPECT_EQ(btree.size(), 3000);
+    EXPECT_EQ(*btree.find(keys[2999]), -keys[2999]);
+    EXPECT_EQ(btree.find(3000), nullptr);
+    EXPECT_FALSE(btree.contains(3000));
+    EXPECT_EQ(btree.lookup(3000), std::nullopt);
+    EXPECT_EQ(btree.merges(), merges);
+    EXPECT_EQ(btree.buffered(), buffered);
+
+    // try_emplace does not probe the main BTree, the row of the main BTree wins and the buffered one is dropped
+    ASSERT_FALSE(btree.tree().find(keys[1])==btree.tree().end());
+    EXPECT_TRUE(btree.try_emplace(keys[1],0));
+    EXPECT_THROW(btree.emplace(keys[1],0), std::out_of_range);
+    EXPECT_EQ(btree.lookup(keys[1]), -keys[1]);
+    EXPECT_EQ(btree.size(), 3000);
+
+    // overwrites in the buffer replace the rows of the main BTree when they are moved
+    for(int key = 0; key<3000; key+=10)
+    {
+        btree.assign(key,key);
+        EXPECT_EQ(btree.at(key), key);
+    }
+    EXPECT_EQ(btree.size(), 3000);
+    int expected = 0;
+    for(auto& row: btree)
+    {
+        ASSERT_EQ(row.key, expected);
+        EXPECT_EQ(row.value, expected%10==0 ? expected : -expected);
+        ++expected;
+    }
+    EXPECT_EQ(expected, 3000);
+    EXPECT_EQ(btree.buffered(), 0);
+    EXPECT_EQ(btree.duplicates(), 1);
+}
@@ -1,7 +1,8 @@
 #include <gtest/gtest.h>
 #include <filesystem>
+#include <fstream>
 
-#include "../src/Backend/Pager.hpp"
+#include "../src/DB.hpp"
 #include "../src/Core/CommandProcessor.hpp"
 #include "../src/Core/VirtualMachine.hpp"
 #include "../src/CLI/Command.hpp"
@@ -26,7 +27,8 @@ class DBTest : public ::testing::Test {
   std::string filename = "tests.db";
   std::ofstream newFile{filename};
   MetaCommand metaCommand;
-  Table table{filename};
+  Database db{filename};
+  Table& table = db.createTable("main",default_schema());
   Statement statement;
 };
 
@@ -103,12 +105,10 @@ TEST_F(DBTest, Persistance) {
   input = ".exit";
   metaCommand.do_meta_command(input,table);
   EXPECT_EQ(metaCommand.exit, true);
-  // Table does not have explicit destructor anymore 
-  // TODO make DB class that behaves like an actual executable
-  //table.~Table();
+  db.flush();
 
-
-  Table newTable{filename};
+  Database newDb{filename};
+  auto& newTable = newDb.table("main");
   input = "select";
   prepare_statement(input, statement);
   testing::internal::CaptureStdout();
@@ -118,7 +118,518 @@ TEST_F(DBTest, Persistance) {
   EXPECT_EQ(output,"id: 1, age: 2, lastvar: 3\n");
 }
 
+TEST_F(DBTest, MultipleTables) {
+  auto& other = db.createTable("other",default_schema());
+  std::string input = "insert 1 2 3";
+  prepare_statement(input, statement);
+  execute_statement(statement, table);
+  input = "insert 4 5 6";
+  prepare_statement(input, statement);
+  execute_statement(statement, other);
+  for(uint32_t i = 10; i<1000; ++i)
+  {
+    statement.row_to_insert.id = i;
+    execute_statement(statement, other);
+  }
+  db.flush();
+
+  Database newDb{filename};
+  EXPECT_EQ(newDb.catalog().size(), 2);
+  EXPECT_EQ(newDb.catalog().at("other").rowCount, 991);
+  input = "select";
+  prepare_statement(input, statement);
+  testing::internal::CaptureStdout();
+  execute_statement(statement, newDb.table("main"));
+  std::string output = testing::internal::GetCapturedStdout();
+  EXPECT_EQ(output,"id: 1, age: 2, lastvar: 3\n");
+  EXPECT_EQ(newDb.table("other").size(), 991);
+}
+
+TEST_F(DBTest, DuplicateTable) {
+  EXPECT_THROW(db.createTable("main",default_schema()), CatalogException);
+}
+
+TEST_F(DBTest, ExecuteDuplicateKey) {
+  std::string input = "insert 1 2 3";
+  prepare_statement(input, statement);
+  execute_statement(statement, table);
+  auto res = execute_statement(statement, table);
+  EXPECT_EQ(res,ExecuteResult::DUPLICATE_KEY);
+}
+
+TEST_F(DBTest, ExecuteAggregates) {
+  std::string input = "insert 1 2 3";
+  prepare_statement(input, statement);
+  for(uint32_t i = 1; i<=5000; ++i)
+  {
+    statement.row_to_insert.id = i;
+    statement.row_to_insert.age = i%10;
+    execute_statement(statement, table);
+  }
+  input = "select count";
+  EXPECT_EQ(prepare_statement(input, statement),PrepareResult::SUCCESS);
+  testing::internal::CaptureStdout();
+  auto res = execute_statement(statement, table);
+  std::string output = testing::internal::GetCapturedStdout();
+  EXPECT_EQ(res,ExecuteResult::SUCCESS);
+  EXPECT_EQ(output,"count: 5000\n");
+
+  input = "select sum";
+  EXPECT_EQ(prepare_statement(input, statement),PrepareResult::SUCCESS);
+  testing::internal::CaptureStdout();
+  execute_statement(statement, table);
+  output = testing::internal::GetCapturedStdout();
+  EXPECT_EQ(output,"sum: 22500\n");
+}
+
+TEST_F(DBTest, HashIndex) {
+  std::string input = "insert 1 2 3";
+  prepare_statement(input, statement);
+  for(uint32_t i = 1; i<=3000; ++i)
+  {
+    statement.row_to_insert.id = i;
+    statement.row_to_insert.age = i%100;
+    execute_statement(statement, table);
+  }
+  table.createHashIndex();
+  EXPECT_TRUE(table.hasHashIndex());
+  // rows inserted after the index was built are indexed too
+  for(uint32_t i = 3001; i<=4000; ++i)
+  {
+    statement.row_to_insert.id = i;
+    statement.row_to_insert.age = i%100;
+    execute_statement(statement, table);
+  }
+  auto row = deserialize_row(*table.lookup(42));
+  row.age = 7;
+  table.assign(42,serialize_row(row));
+  for(uint32_t i = 1; i<=4000; ++i)
+  {
+    auto indexed = table.lookup(i);
+    ASSERT_TRUE(indexed.has_value());
+    EXPECT_EQ(deserialize_row(*indexed).id, i);
+  }
+  EXPECT_FALSE(table.lookup(4001).has_value());
+
+  input = "select where id = 42";
+  EXPECT_EQ(prepare_statement(input, statement),PrepareResult::SUCCESS);
+  EXPECT_EQ(statement.type,StatementType::SELECT_KEY);
+  testing::internal::CaptureStdout();
+  execute_statement(statement, table);
+  EXPECT_EQ(testing::internal::GetCapturedStdout(),"id: 42, age: 7, lastvar: 3\n");
+  input = "select where id = x";
+  EXPECT_EQ(prepare_statement(input, statement),PrepareResult::SYNTAX_ERROR);
+
+  // the index is stored with the table and loaded without rebuilding it
+  db.flush();
+  Database reopened{filename};
+  auto& other = reopened.table("main");
+  EXPECT_TRUE(other.hasHashIndex());
+  EXPECT_EQ(deserialize_row(*other.lookup(42)).age, 7);
+  EXPECT_EQ(deserialize_row(*other.lookup(4000)).id, 4000);
+  EXPECT_FALSE(other.lookup(0).has_value());
+  // clear empties the index with the BTree
+  other.clear();
+  EXPECT_EQ(other.size(), 0);
+  EXPECT_FALSE(other.lookup(42).has_value());
+  EXPECT_TRUE(other.emplace(42,serialize_row(row)));
+  EXPECT_EQ(deserialize_row(*other.lookup(42)).age, 7);
+}
+
+TEST_F(DBTest, StaticSchema) {
+  static_assert(DefaultSchema::rowSize == 40);
+  static_assert(DefaultSchema::offsets[DefaultSchema::index<"lastvar">] == 8);
+  EXPECT_TRUE(DefaultSchema::matches(table.schema()));
+
+  DefaultRow row{7, 30, {'x'}};
+  const RowData data = serialize_row(row);
+  EXPECT_EQ(DefaultSchema::get<"age">(data.data()), 30);
+  EXPECT_EQ(DefaultSchema::get<0>(data.data()), 7);
+  RowData changed = data;
+  DefaultSchema::set<"age">(changed.data(), 31);
+  EXPECT_EQ(deserialize_row(changed).age, 31);
+  EXPECT_EQ(deserialize_row(changed).lastvar, row.lastvar);
+}
+
+TEST_F(DBTest, RowViews) {
+  for(uint32_t i = 1; i<=1000; ++i)
+  {
+    table.emplace(i,serialize_row(DefaultRow{i, i%50, {static_cast<char>('a'+i%26)}}));
+  }
+  const auto row = table.view(42);
+  ASSERT_TRUE(row.has_value());
+  EXPECT_EQ(row->get<uint32_t>(0), 42);
+  EXPECT_EQ(row->get<uint32_t>(1), 42);
+  EXPECT_EQ(row->chars(2), "q");
+  EXPECT_EQ(row->format(), "id: 42, age: 42, lastvar: q");
+  EXPECT_THROW(static_cast<void>(row->get<int64_t>(1)), SchemaException);
+  EXPECT_THROW(static_cast<void>(row->chars(1)), SchemaException);
+  EXPECT_THROW(static_cast<void>(row->get<uint32_t>(3)), SchemaException);
+  // the view points into the leaf of the row
+  EXPECT_EQ(row->data(), table_find(table,42).value().data());
+  EXPECT_EQ(view_row(*table.lookup(7)).get<"age">(), 7);
+  EXPECT_FALSE(table.view(1001).has_value());
+
+  table.createHashIndex();
+  EXPECT_EQ(table.view(42)->get<uint32_t>(1), 42);
+  EXPECT_FALSE(table.view(1001).has_value());
+
+  // the column is resolved once, the filter reads it at a fixed offset of every row
+  const auto age = table.layout().column<uint32_t>(1);
+  const auto lastvar = table.layout().column<std::string_view>(2);
+  EXPECT_EQ(row->get(age), 42);
+  EXPECT_EQ(row->get(lastvar), "q");
+  EXPECT_THROW(static_cast<void>(table.layout().column<int32_t>(0)), SchemaException);
+
+  // only the rows accepted by the filter are copied into the batches
+  Executor executor;
+  std::vector<uint32_t> keys;
+  executor.blockOn([&]() -> Task<void>
+  {
+    auto scan = table.scan(executor,[&](uint32_t, const RowView& view)
+    {
+      return view.get(age)==0;
+    });
+    while(auto batch = co_await scan.next())
+    {
+      for(const auto& match: *batch)
+      {
+        keys.push_back(match.key);
+      }
+    }
+  }());
+  ASSERT_EQ(keys.size(), 20);
+  for(size_t i = 0; i<keys.size(); ++i)
+  {
+    EXPECT_EQ(keys[i], 50*(i+1));
+  }
+
+  // flush writes the rows from the leaves into the pages
+  db.flush();
+  Database reopened{filename};
+  EXPECT_EQ(reopened.table("main").view(1000)->chars(2), "m");
+}
+
+TEST_F(DBTest, CreateTable) {
+  std::string input = "create table people (id uint32, score int64, name char(8))";
+  ASSERT_EQ(prepare_statement(input, statement), PrepareResult::SUCCESS);
+  EXPECT_EQ(statement.type, StatementType::CREATE_TABLE);
+  EXPECT_EQ(execute_statement(statement, db, table), ExecuteResult::SUCCESS);
+  EXPECT_EQ(execute_statement(statement, db, table), ExecuteResult::TABLE_EXISTS);
+
+  using People = StaticSchema<Field<"id",uint32_t>, Field<"score",int64_t>, Field<"name",std::array<char,8>>>;
+  auto& people = db.table("people");
+  EXPECT_TRUE(People::matches(people.schema()));
+  EXPECT_FALSE(DefaultSchema::matches(people.schema()));
+  RowData row{};
+  People::write(row.data(), {1, -5, {'a','n','n'}});
+  EXPECT_TRUE(people.emplace(1, row));
+
+  input = "select";
+  prepare_statement(input, statement);
+  testing::internal::CaptureStdout();
+  execute_statement(statement, db, people);
+  EXPECT_EQ(testing::internal::GetCapturedStdout(), "id: 1, score: -5, name: ann\n");
+
+  for (std::string invalid : {"create table t (id int32)", "create table t (id uint32, name char(0))",
+                              "create table t (id uint32, x float)", "create table t id uint32",
+                              "create table t (id uint32, big char(300))"}) {
+    EXPECT_EQ(prepare_statement(invalid, statement), PrepareResult::SYNTAX_ERROR) << invalid;
+  }
+
+  // INSERT and SUM assume the default columns, other tables are rejected instead of written or read at the wrong offsets
+  input = "insert 2 3 x";
+  ASSERT_EQ(prepare_statement(input, statement), PrepareResult::SUCCESS);
+  EXPECT_EQ(execute_statement(statement, db, people), ExecuteResult::SCHEMA_MISMATCH);
+  EXPECT_EQ(people.size(), 1);
+  input = "select sum";
+  prepare_statement(input, statement);
+  EXPECT_EQ(execute_statement(statement, db, people), ExecuteResult::NO_SUCH_COLUMN);
+
+  // the age column is found by name at any position and of any integer type
+  input = "create table ages (id uint32, name char(8), age int64)";
+  ASSERT_EQ(prepare_statement(input, statement), PrepareResult::SUCCESS);
+  EXPECT_EQ(execute_statement(statement, db, table), ExecuteResult::SUCCESS);
+  auto& ages = db.table("ages");
+  using Ages = StaticSchema<Field<"id",uint32_t>, Field<"name",std::array<char,8>>, Field<"age",int64_t>>;
+  for (uint32_t i = 1; i<=100; ++i) {
+    Ages::write(row.data(), {i, {'b'}, -static_cast<int64_t>(i)});
+    EXPECT_TRUE(ages.emplace(i, row));
+  }
+  input = "select sum";
+  prepare_statement(input, statement);
+  testing::internal::CaptureStdout();
+  EXPECT_EQ(execute_statement(statement, db, ages), ExecuteResult::SUCCESS);
+  EXPECT_EQ(testing::internal::GetCapturedStdout(), "sum: -5050\n");
+
+  input = "create table names (id uint32, age char(4))";
+  ASSERT_EQ(prepare_statement(input, statement), PrepareResult::SUCCESS);
+  EXPECT_EQ(execute_statement(statement, db, table), ExecuteResult::SUCCESS);
+  input = "select sum";
+  prepare_statement(input, statement);
+  EXPECT_EQ(execute_statement(statement, db, db.table("names")), ExecuteResult::WRONG_COLUMN_TYPE);
+}
+
+TEST_F(DBTest, ColumnarTable) {
+  std::string input = "create table reports (id uint32, age uint32, lastvar char(32)) columnar";
+  ASSERT_EQ(prepare_statement(input, statement), PrepareResult::SUCCESS);
+  EXPECT_EQ(execute_statement(statement, db, table), ExecuteResult::SUCCESS);
+  auto& reports = db.table("reports");
+  EXPECT_TRUE(reports.columnar());
+  EXPECT_FALSE(table.columnar());
+
+  input = "insert 1 2 3";
+  prepare_statement(input, statement);
+  for(uint32_t i = 1; i<=3000; ++i)
+  {
+    statement.row_to_insert.id = i;
+    statement.row_to_insert.age = i%10;
+    execute_statement(statement, reports);
+    execute_statement(statement, table);
+  }
+  input = "select sum";
+  prepare_statement(input, statement);
+  testing::internal::CaptureStdout();
+  execute_statement(statement, reports);
+  EXPECT_EQ(testing::internal::GetCapturedStdout(),"sum: 13500\n");
+  EXPECT_EQ(reports.sumColumn(0), table.sumColumn(0));
+
+  // the mini page of a column holds the values of all rows of a page
+  uint32_t runs = 0;
+  uint32_t rows = 0;
+  uint32_t previous = 0;
+  bool ordered = true;
+  reports.scanColumn(0,[&](const char* values, uint32_t count)
+  {
+    ++runs;
+    rows += count;
+    for(uint32_t i = 0; i<count; ++i)
+    {
+      uint32_t id;
+      std::memcpy(&id,values+i*sizeof(id),sizeof(id));
+      ordered = ordered && id==previous+1;
+      previous = id;
+    }
+  });
+  EXPECT_EQ(rows, 3000);
+  EXPECT_TRUE(ordered);
+  EXPECT_LT(runs, 3000/50);
+  EXPECT_THROW(static_cast<void>(reports.sumColumn(2)), TableException);
+
+  // SUM finds the age column of a columnar table by name, not at the position of the default schema
+  input = "create table scores (id uint32, name char(8), age int32) columnar";
+  ASSERT_EQ(prepare_statement(input, statement), PrepareResult::SUCCESS);
+  EXPECT_EQ(execute_statement(statement, db, table), ExecuteResult::SUCCESS);
+  auto& scores = db.table("scores");
+  using Scores = StaticSchema<Field<"id",uint32_t>, Field<"name",std::array<char,8>>, Field<"age",int32_t>>;
+  for(uint32_t i = 1; i<=500; ++i)
+  {
+    RowData data{};
+    Scores::write(data.data(), {i, {'s'}, static_cast<int32_t>(i%7)-3});
+    EXPECT_TRUE(scores.emplace(i, data));
+  }
+  input = "select sum";
+  prepare_statement(input, statement);
+  testing::internal::CaptureStdout();
+  EXPECT_EQ(execute_statement(statement, db, scores), ExecuteResult::SUCCESS);
+  int64_t expected = 0;
+  for(uint32_t i = 1; i<=500; ++i)
+  {
+    expected += static_cast<int32_t>(i%7)-3;
+  }
+  EXPECT_EQ(testing::internal::GetCapturedStdout(), fmt::format("sum: {}\n",expected));
+  input = "create table labels (id uint32, age char(4)) columnar";
+  ASSERT_EQ(prepare_statement(input, statement), PrepareResult::SUCCESS);
+  EXPECT_EQ(execute_statement(statement, db, table), ExecuteResult::SUCCESS);
+  input = "select sum";
+  prepare_statement(input, statement);
+  EXPECT_EQ(execute_statement(statement, db, db.table("labels")), ExecuteResult::WRONG_COLUMN_TYPE);
+
+  // rows are gathered from the mini pages when the table is opened
+  auto row = deserialize_row(*reports.lookup(7));
+  row.age = 100;
+  reports.assign(7,serialize_row(row));
+  db.flush();
+  Database reopened{filename};
+  auto& other = reopened.table("reports");
+  EXPECT_TRUE(other.columnar());
+  EXPECT_EQ(other.size(), 3000);
+  EXPECT_EQ(deserialize_row(*other.lookup(7)).age, 100);
+  EXPECT_EQ(deserialize_row(*other.lookup(3000)).lastvar[0], '3');
+  EXPECT_EQ(other.sumColumn(1), 13500-7+100);
+
+  // a scan that throws while the pages are collected does not leave part of the chain behind
+  other.dropPages();
+  EXPECT_THROW(other.scanColumn(0,[](const char*, uint32_t)
+  {
+    throw TableException("stop");
+  }), TableException);
+  rows = 0;
+  other.scanColumn(0,[&](const char*, uint32_t count)
+  {
+    rows += count;
+  });
+  EXPECT_EQ(rows, 3000);
+}
+
+namespace
+{
+// point operations of a table do not suspend, the task yields to the loop between them
+Task<void> insertAndGet(Table& table, Executor& executor, uint32_t key, int& found)
+{
+  RowData row{};
+  row[0] = static_cast<char>(key);
+  const bool inserted = table.emplace(key,row);
+  co_await executor.schedule();
+  if(inserted && table.lookup(key).value()[0]==static_cast<char>(key))
+  {
+    ++found;
+  }
+}
+
+Task<void> scanTable(Table& table, Executor& executor, std::vector<uint32_t>& keys)
+{
+  auto scan = table.scan(executor);
+  while(auto batch = co_await scan.next())
+  {
+    for(const auto& row: *batch)
+    {
+      keys.push_back(row.key);
+    }
+  }
+}
+}
+
+TEST_F(DBTest, Coroutines) {
+  Executor executor;
+  int found = 0;
+  for(uint32_t key = 1000; key>0; --key)
+  {
+    executor.spawn(insertAndGet(table,executor,key,found));
+  }
+  executor.run();
+  EXPECT_EQ(found, 1000);
+  EXPECT_FALSE(table.emplace(1,RowData{}));
+  EXPECT_FALSE(table.lookup(1001).has_value());
+
+  // inserts running between the batches of the scan are returned when they are behind the scan position
+  std::vector<uint32_t> keys;
+  executor.spawn(scanTable(table,executor,keys));
+  executor.spawn(insertAndGet(table,executor,5000,found));
+  executor.run();
+  ASSERT_EQ(keys.size(), 1001);
+  EXPECT_TRUE(std::is_sorted(keys.begin(),keys.end()));
+  EXPECT_EQ(keys.back(), 5000);
+}
+
 //TODO Test Table Full
+TEST_F(DBTest, Defragment) {
+  auto& other = db.createTable("other",default_schema());
+  RowData row{};
+  for(uint32_t i = 0; i<2000; ++i)
+  {
+    other.emplace(i,row);
+  }
+  db.flush();
+  // the released pages of other are reused in descending order by the next flush of main
+  other.clear();
+  db.flush();
+  for(uint32_t i = 0; i<1500; ++i)
+  {
+    row[0] = static_cast<char>(i);
+    table.emplace(i,row);
+  }
+  db.flush();
+
+  auto chain = [&](std::string_view name)
+  {
+    std::vector<PageNum> pages;
+    for(PageNum pageNum = db.catalog().at(name).rootPage; pageNum!=INVALID_PAGE; pageNum = db.pager().get(pageNum).header.next)
+    {
+      pages.push_back(pageNum);
+    }
+    return pages;
+  };
+  const auto before = chain("main");
+  ASSERT_GT(before.size(), 4);
+  EXPECT_FALSE(std::is_sorted(before.begin(),before.end()));
+
+  db.defragmenter().setOptions(DefragmentOptions{.pagesPerStep = 4, .interval = std::chrono::milliseconds(0)});
+  size_t steps = 0;
+  while(!db.defragmented())
+  {
+    db.defragment();
+    ++steps;
+  }
+  EXPECT_GT(steps, 2);
+  const auto after = chain("main");
+  EXPECT_TRUE(std::is_sorted(after.begin(),after.end()));
+  EXPECT_TRUE(std::is_permutation(before.begin(),before.end(),after.begin(),after.end()));
+  // the flush writes the changed row to the page its position was moved to
+  row[0] = static_cast<char>(700);
+  row[1] = 'z';
+  table.assign(700,row);
+  db.flush();
+
+  Database newDb{filename};
+  auto& newTable = newDb.table("main");
+  ASSERT_EQ(newTable.size(), 1500);
+  uint32_t expected = 0;
+  for(auto cursor = table_start(newTable); !cursor.m_endOfTable; cursor.advance())
+  {
+    ASSERT_EQ(cursor.key(), expected);
+    EXPECT_EQ(cursor.value()[0], static_cast<char>(expected));
+    ++expected;
+  }
+  EXPECT_EQ(newTable.lookup(700).value()[1], 'z');
+}
+
+TEST_F(DBTest, IncrementalFlush) {
+  RowData row{};
+  for(uint32_t i = 0; i<6000; i += 2)
+  {
+    row[0] = static_cast<char>(i);
+    table.emplace(i,row);
+  }
+  table.createHashIndex();
+  db.flush();
+
+  // a changed row writes its page, the index page, the catalog and the file header
+  const auto writes = db.pager().writes();
+  row[0] = 'x';
+  table.assign(3000,row);
+  table.emplace(6001,row);
+  db.flush();
+  EXPECT_LE(db.pager().writes()-writes, 5);
+
+  // full pages within the chain are split
+  for(uint32_t i = 1; i<2000; i += 2)
+  {
+    row[0] = static_cast<char>(i);
+    table.emplace(i,row);
+  }
+  db.flush();
+
+  Database newDb{filename};
+  auto& newTable = newDb.table("main");
+  ASSERT_EQ(newTable.size(), 4001);
+  EXPECT_EQ(newDb.catalog().at("main").rowCount, 4001);
+  std::vector<uint32_t> keys;
+  for(auto cursor = table_start(newTable); !cursor.m_endOfTable; cursor.advance())
+  {
+    keys.push_back(cursor.key());
+    if(cursor.key()!=3000 && cursor.key()!=6001)
+    {
+      EXPECT_EQ(cursor.value()[0], static_cast<char>(cursor.key()));
+    }
+  }
+  EXPECT_TRUE(std::is_sorted(keys.begin(),keys.end()));
+  EXPECT_EQ(keys[1999], 1999);
+  EXPECT_EQ(newTable.lookup(3000).value()[0], 'x');
+  EXPECT_EQ(newTable.lookup(6001).value()[0], 'x');
+  EXPECT_FALSE(newTable.lookup(2001).has_value());
+}
+
 TEST_F(DBTest, TableFull) {
 
   EXPECT_EQ(1,1);
@@ -0,0 +1,503 @@
+#include <gtest/gtest.h>
+#include <deque>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Pager.hpp"
+#include "Crc32c.hpp"
+#include "Compression.hpp"
+#include "Async/Executor.hpp"
+
+
+class PagerTest : public ::testing::Test {
+ protected:
+  
+  void TearDown() override 
+  {
+    // delete db file
+    std::filesystem::remove(filename);
+  }
+
+  // overwrite bytes of the file without going through the pager
+  void corrupt(off_t offset, const std::string& bytes)
+  {
+    int fd = ::open(filename.c_str(), O_WRONLY);
+    ASSERT_EQ(::pwrite(fd, bytes.data(), bytes.size(), offset), static_cast<ssize_t>(bytes.size()));
+    ::close(fd);
+  }
+
+  std::string filename = "pagertest.db";
+};
+
+namespace
+{
+Task<void> checkPage(Executor& executor, Pager& pager, PageNum pageNum, int& matches)
+{
+    Page* page = co_await pager.getAsync(executor,pageNum);
+    if(page->payload[0]==static_cast<char>(pageNum))
+    {
+      ++matches;
+    }
+}
+}
+
+TEST_F(PagerTest, Crc32c) 
+{
+    std::string input = "123456789";
+    EXPECT_EQ(crc32c(input), 0xE3069283);
+    EXPECT_EQ(crc32c(std::string(4096,'\0')), 0x98F94189);
+}
+
+TEST_F(PagerTest, Persistance) 
+{
+    PageNum pageNum;
+    {
+      Pager pager(filename,2);
+      for(int i = 0; i<8; ++i)
+      {
+        pageNum = pager.allocate();
+        pager.get(pageNum).payload[0] = static_cast<char>(i);
+      }
+    }
+    Pager pager(filename,2);
+    EXPECT_EQ(pager.pageCount(), 9);
+    EXPECT_EQ(pager.get(pageNum).payload[0], 7);
+    EXPECT_EQ(pager.get(1).payload[0], 0);
+}
+
+TEST_F(PagerTest, TornWrite) 
+{
+    {
+      Pager pager(filename,2);
+      auto pageNum = pager.allocate();
+      pager.get(pageNum).payload.fill('a');
+    }
+    // second half of page 1 still holds old contents
+    corrupt(PAGE_SIZE+PAGE_SIZE/2, std::string(PAGE_SIZE/2,'b'));
+    Pager pager(filename,2);
+    EXPECT_THROW(auto& page = pager.get(1);, PagerException);
+}
+
+TEST_F(PagerTest, Verify) 
+{
+    {
+      Pager pager(filename,4);
+      for(int i = 0; i<64; ++i)
+      {
+        std::ignore = pager.allocate();
+      }
+    }
+    corrupt(PAGE_SIZE*17+100, "x");
+    corrupt(PAGE_SIZE*50+4000, "y");
+    Pager pager(filename,4);
+    auto result = pager.verify(4);
+    EXPECT_EQ(result.pagesChecked, 65);
+    EXPECT_EQ(result.corruptPages, (std::vector<PageNum>{17,50}));
+}
+
+TEST_F(PagerTest, Lz4RoundTrip) 
+{
+    std::string input(PAGE_SIZE,'\0');
+    for(size_t i = 0; i<input.size(); i+=97)
+    {
+        input[i] = static_cast<char>(i);
+    }
+    std::string compressed(lz4CompressBound(input.size()),'\0');
+    auto size = lz4Compress(input,compressed);
+    ASSERT_GT(size, 0);
+    EXPECT_LT(size, input.size()/4);
+    std::string output(input.size(),'\0');
+    auto decompressed = lz4Decompress(std::span<const char>(compressed.data(),size),output);
+    ASSERT_TRUE(decompressed);
+    EXPECT_EQ(*decompressed, input.size());
+    EXPECT_EQ(output, input);
+    // truncated input must not decompress
+    auto truncated = lz4Decompress(std::span<const char>(compressed.data(),size/2),output);
+    EXPECT_TRUE(!truncated || *truncated!=input.size());
+
+    // incompressible pages stay within the bound, zero pages collapse to a few bytes
+    std::string random(PAGE_SIZE,'\0');
+    uint32_t state = 12345;
+    for(auto& c: random)
+    {
+        state = state*1103515245u+12345u;
+        c = static_cast<char>(state>>24);
+    }
+    const std::string zeros(PAGE_SIZE,'\0');
+    for(const auto& page: {random, zeros})
+    {
+        size = lz4Compress(page,compressed);
+        ASSERT_GT(size, 0);
+        std::fill(output.begin(),output.end(),'x');
+        decompressed = lz4Decompress(std::span<const char>(compressed.data(),size),output);
+        ASSERT_TRUE(decompressed);
+        EXPECT_EQ(*decompressed, page.size());
+        EXPECT_EQ(output, page);
+    }
+    EXPECT_LT(lz4Compress(zeros,compressed), 64);
+}
+
+TEST_F(PagerTest, CompressedPages) 
+{
+    {
+      Pager pager(filename,PagerOptions{.poolSize = 2, .compressPages = true});
+      for(int i = 0; i<64; ++i)
+      {
+        auto pageNum = pager.allocate();
+        std::fill_n(pager.get(pageNum).payload.begin(), 16, static_cast<char>(i));
+      }
+    }
+    // pages mostly hold zeros and take far less than a page each
+    EXPECT_LT(std::filesystem::file_size(filename), 16*PAGE_SIZE);
+    Pager pager(filename,2);
+    EXPECT_TRUE(pager.compressed());
+    for(PageNum pageNum = 1; pageNum<65; ++pageNum)
+    {
+      EXPECT_EQ(pager.get(pageNum).payload[15], static_cast<char>(pageNum-1));
+    }
+    // incompressible page is stored in a full extent
+    for(size_t i = 0; i<PAGE_PAYLOAD_SIZE; ++i)
+    {
+      pager.get(3).payload[i] = static_cast<char>((i*7919)>>3);
+    }
+    pager.markDirty(3);
+    pager.flush();
+    EXPECT_TRUE(pager.verify().corruptPages.empty());
+}
+
+TEST_F(PagerTest, CompressedCrashDuringFlush) 
+{
+    const std::string crashed = "pagertest-crash.db";
+    {
+      Pager pager(filename,PagerOptions{.poolSize = 2, .compressPages = true});
+      for(int i = 0; i<16; ++i)
+      {
+        auto pageNum = pager.allocate();
+        std::fill_n(pager.get(pageNum).payload.begin(), 16, static_cast<char>(i));
+      }
+      pager.flush();
+      // evictions write the changed pages before the next flush
+      for(PageNum pageNum = 1; pageNum<17; ++pageNum)
+      {
+        std::fill_n(pager.get(pageNum).payload.begin(), 16, static_cast<char>(100+pageNum));
+        pager.markDirty(pageNum);
+      }
+      // the file as a crash before the header of the next flush is synced leaves it
+      std::filesystem::copy_file(filename,crashed,std::filesystem::copy_options::overwrite_existing);
+    }
+    {
+      Pager pager(crashed,2);
+      for(PageNum pageNum = 1; pageNum<17; ++pageNum)
+      {
+        EXPECT_EQ(pager.get(pageNum).payload[15], static_cast<char>(pageNum-1));
+      }
+      EXPECT_TRUE(pager.verify().corruptPages.empty());
+    }
+    std::filesystem::remove(crashed);
+    // replaced extents are reused once the flush completed
+    Pager pager(filename,2);
+    EXPECT_EQ(pager.get(16).payload[15], static_cast<char>(116));
+    const auto size = std::filesystem::file_size(filename);
+    for(int round = 0; round<8; ++round)
+    {
+      for(PageNum pageNum = 1; pageNum<17; ++pageNum)
+      {
+        pager.get(pageNum).payload[0] = static_cast<char>(round);
+        pager.markDirty(pageNum);
+      }
+      pager.flush();
+    }
+    EXPECT_LE(std::filesystem::file_size(filename), 2*size);
+}
+
+TEST_F(PagerTest, CrashDuringFlush) 
+{
+    const std::string crashed = "pagertest-crash.db";
+    const std::string journal = filename+"-journal";
+    {
+      Pager pager(filename,2);
+      for(int i = 0; i<16; ++i)
+      {
+        auto pageNum = pager.allocate();
+        std::fill_n(pager.get(pageNum).payload.begin(), 16, static_cast<char>(i));
+      }
+      pager.flush();
+      EXPECT_EQ(std::filesystem::file_size(journal), 0);
+      // evictions overwrite the committed pages in place before the next flush, new pages are appended
+      for(PageNum pageNum = 1; pageNum<17; ++pageNum)
+      {
+        std::fill_n(pager.get(pageNum).payload.begin(), 16, static_cast<char>(100+pageNum));
+        pager.markDirty(pageNum);
+      }
+      for(int i = 0; i<4; ++i)
+      {
+        static_cast<void>(pager.allocate());
+      }
+      // the files as a crash before the header of the next flush is synced leaves them
+      std::filesystem::copy_file(filename,crashed,std::filesystem::copy_options::overwrite_existing);
+      std::filesystem::copy_file(journal,crashed+"-journal",std::filesystem::copy_options::overwrite_existing);
+      EXPECT_GT(std::filesystem::file_size(journal), 0);
+    }
+    // a clean close removes the journal
+    EXPECT_FALSE(std::filesystem::exists(journal));
+    {
+      Pager pager(crashed,2);
+      EXPECT_FALSE(std::filesystem::exists(crashed+"-journal"));
+      EXPECT_EQ(pager.pageCount(), 17);
+      EXPECT_EQ(std::filesystem::file_size(crashed), 17*PAGE_SIZE);
+      for(PageNum pageNum = 1; pageNum<17; ++pageNum)
+      {
+        EXPECT_EQ(pager.get(pageNum).payload[15], static_cast<char>(pageNum-1));
+      }
+      EXPECT_TRUE(pager.verify().corruptPages.empty());
+    }
+    std::filesystem::remove(crashed);
+
+    // replay stops at a record torn by a crash while the journal was written, the records before it are restored
+    {
+      Pager pager(filename,2);
+      EXPECT_EQ(pager.get(16).payload[15], static_cast<char>(116));
+      pager.get(3).payload[0] = 'x';
+      pager.markDirty(3);
+      pager.get(4).payload[0] = 'y';
+      pager.markDirty(4);
+      static_cast<void>(pager.get(5));
+      static_cast<void>(pager.get(6));
+      std::filesystem::copy_file(filename,crashed,std::filesystem::copy_options::overwrite_existing);
+      std::filesystem::copy_file(journal,crashed+"-journal",std::filesystem::copy_options::overwrite_existing);
+    }
+    std::filesystem::resize_file(crashed+"-journal",std::filesystem::file_size(crashed+"-journal")-PAGE_SIZE/2);
+    {
+      Pager pager(crashed,2);
+      EXPECT_EQ(pager.pageCount(), 21);
+      EXPECT_EQ(pager.get(3).payload[15], static_cast<char>(103));
+      EXPECT_TRUE(pager.verify().corruptPages.empty());
+    }
+    std::filesystem::remove(crashed);
+}
+
+TEST_F(PagerTest, IoBackends) 
+{
+    std::vector<std::string> data(64);
+    for(size_t i=0; i<data.size(); ++i)
+    {
+      data[i] = std::string(64, static_cast<char>('a'+i%26));
+    }
+    for(auto type: {IoBackendType::THREAD_POOL, IoBackendType::AUTO})
+    {
+      auto backend = makeIoBackend(type, 8);
+      int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+      ASSERT_GE(fd, 0);
+      std::vector<IoRequest> requests;
+      for(size_t i=0; i<data.size(); ++i)
+      {
+        requests.push_back(IoRequest{.op = IoOp::WRITE, .fd = fd, .buffer = data[i].data(), .size = data[i].size(), .offset = static_cast<off_t>(i*64)});
+      }
+      for(auto result: backend->execute(requests))
+      {
+        EXPECT_EQ(result, 64);
+      }
+      std::vector<std::string> read(data.size(), std::string(64, '\0'));
+      requests.clear();
+      for(size_t i=0; i<data.size(); ++i)
+      {
+        requests.push_back(IoRequest{.op = IoOp::READ, .fd = fd, .buffer = read[i].data(), .size = read[i].size(), .offset = static_cast<off_t>(i*64)});
+      }
+      for(auto result: backend->execute(requests))
+      {
+        EXPECT_EQ(result, 64);
+      }
+      EXPECT_EQ(read, data) << backend->name();
+      ::close(fd);
+    }
+}
+
+TEST_F(PagerTest, Prefetch) 
+{
+    for(bool compress: {false, true})
+    {
+      std::vector<PageNum> pages;
+      {
+        Pager pager(filename, PagerOptions{.poolSize = 8, .compressPages = compress, .ioBackend = IoBackendType::THREAD_POOL});
+        for(int i=0; i<20; ++i)
+        {
+          pages.push_back(pager.allocate());
+          auto& page = pager.get(pages.back());
+          page.header.count = static_cast<uint32_t>(i);
+          page.payload.fill(static_cast<char>(i));
+        }
+      }
+      Pager pager(filename, PagerOptions{.poolSize = 8});
+      pager.prefetch(pages);
+      pager.prefetch(std::span(pages).subspan(4));
+      for(size_t i=0; i<pages.size(); ++i)
+      {
+        auto& page = pager.get(pages[i]);
+        EXPECT_EQ(page.header.count, i);
+        EXPECT_EQ(page.payload[100], static_cast<char>(i));
+      }
+      pager.get(pages[0]).header.count = 100;
+      pager.markDirty(pages[0]);
+      pager.prefetch(pages);
+      EXPECT_EQ(pager.get(pages[0]).header.count, 100u);
+      std::filesystem::remove(filename);
+    }
+}
+
+TEST_F(PagerTest, Swizzling) 
+{
+    Pager pager(filename, PagerOptions{.poolSize = 8, .readAhead = 0});
+    std::deque<Swip> swips;
+    for(int i=0; i<4; ++i)
+    {
+      const PageNum pageNum = pager.allocate();
+      pager.get(pageNum).payload[0] = static_cast<char>(i);
+      pager.markDirty(pageNum);
+      swips.emplace_back(pageNum);
+    }
+    for(auto& swip: swips)
+    {
+      EXPECT_FALSE(swip.swizzled());
+      static_cast<void>(pager.resolve(swip));
+      EXPECT_TRUE(swip.swizzled());
+    }
+    EXPECT_EQ(&pager.resolve(swips[2]), &pager.get(pager.pageNum(swips[2])));
+
+    // pages evicted from the pool are unswizzled and read again when resolved
+    for(int i=0; i<16; ++i)
+    {
+      static_cast<void>(pager.get(pager.allocate()));
+    }
+    for(int i=0; i<4; ++i)
+    {
+      EXPECT_FALSE(swips[i].swizzled());
+      EXPECT_EQ(pager.resolve(swips[i]).payload[0], static_cast<char>(i));
+      EXPECT_TRUE(swips[i].swizzled());
+    }
+
+    // a second reference to a page takes over
+    Swip other(pager.pageNum(swips[0]));
+    static_cast<void>(pager.resolve(other));
+    EXPECT_TRUE(other.swizzled());
+    EXPECT_FALSE(swips[0].swizzled());
+    pager.unswizzle(other);
+    EXPECT_FALSE(other.swizzled());
+    for(auto& swip: swips)
+    {
+      pager.unswizzle(swip);
+    }
+}
+
+TEST_F(PagerTest, Swap) 
+{
+    for(bool compress: {false, true})
+    {
+      {
+        Pager pager(filename, PagerOptions{.poolSize = 2, .compressPages = compress, .readAhead = 0});
+        for(int i=0; i<6; ++i)
+        {
+          const PageNum pageNum = pager.allocate();
+          pager.get(pageNum).payload[0] = static_cast<char>(pageNum);
+          pager.markDirty(pageNum);
+        }
+        pager.flush();
+        Swip swip(1);
+        static_cast<void>(pager.resolve(swip));
+        // resident pages are copied, a swizzled reference is unswizzled
+        pager.swap(1,2);
+        EXPECT_FALSE(swip.swizzled());
+        // pages that are not resident swap their extents in compressed files
+        pager.swap(5,6);
+        EXPECT_THROW(pager.swap(0,3), PagerException);
+      }
+      Pager pager(filename, PagerOptions{.poolSize = 2, .readAhead = 0});
+      const std::array<char,6> expected = {2,1,3,4,6,5};
+      for(PageNum pageNum = 1; pageNum<7; ++pageNum)
+      {
+        EXPECT_EQ(pager.get(pageNum).payload[0], expected[pageNum-1]);
+      }
+      EXPECT_TRUE(pager.verify().corruptPages.empty());
+      std::filesystem::remove(filename);
+    }
+}
+
+TEST_F(PagerTest, DirectIo) 
+{
+    EXPECT_THROW(Pager(filename, PagerOptions{.compressPages = true, .directIo = true}), PagerException);
+    PageNum pageNum;
+    try
+    {
+      Pager pager(filename, PagerOptions{.poolSize = 4, .directIo = true});
+      pageNum = pager.allocate();
+      pager.get(pageNum).header.count = 7;
+    }
+    catch(const PagerException& e)
+    {
+      GTEST_SKIP() << "O_DIRECT not supported: " << e.what();
+    }
+    Pager pager(filename, PagerOptions{.poolSize = 4, .directIo = true});
+    EXPECT_EQ(pager.get(pageNum).header.count, 7u);
+}
+
+TEST_F(PagerTest, ScanResistance) 
+{
+    {
+      Pager pager(filename, 8);
+      for(int i=0; i<100; ++i)
+      {
+        auto pageNum = pager.allocate();
+        pager.get(pageNum).header.count = pageNum;
+      }
+    }
+    for(size_t readAhead: {size_t{0}, size_t{4}})
+    {
+      Pager pager(filename, PagerOptions{.poolSize = 8, .readAhead = readAhead});
+      const std::array<PageNum,4> hot = {90, 95, 92, 97};
+      for(auto pageNum: hot)
+      {
+        EXPECT_EQ(pager.get(pageNum).header.count, pageNum);
+      }
+      for(PageNum pageNum = 1; pageNum<80; ++pageNum)
+      {
+        EXPECT_EQ(pager.get(pageNum).header.count, pageNum);
+      }
+      for(auto pageNum: hot)
+      {
+        // only the ring buffer keeps the hot pages in the pool
+        EXPECT_EQ(pager.resident(pageNum), readAhead!=0);
+      }
+      // page read by the scan is moved to the buffer pool when it is used again
+      pager.get(78).header.count = 500;
+      pager.markDirty(78);
+      for(PageNum pageNum = 1; pageNum<80; ++pageNum)
+      {
+        EXPECT_EQ(pager.get(pageNum).header.count, pageNum==78 ? 500 : pageNum);
+      }
+      pager.get(78).header.count = 78;
+      pager.markDirty(78);
+    }
+}
+
+TEST_F(PagerTest, AsyncGet) 
+{
+    {
+      Pager pager(filename,4);
+      for(int i = 0; i<32; ++i)
+      {
+        auto pageNum = pager.allocate();
+        pager.get(pageNum).payload[0] = static_cast<char>(pageNum);
+      }
+    }
+    Pager pager(filename,PagerOptions{.poolSize = 8,.readAhead = 0});
+    Executor executor(2);
+    int matches = 0;
+    // more pages in flight than frames in the buffer pool, every page is read on an I/O thread
+    for(PageNum pageNum = 1; pageNum<=32; ++pageNum)
+    {
+      executor.spawn(checkPage(executor,pager,pageNum,matches));
+    }
+    executor.run();
+    EXPECT_EQ(matches, 32);
+    EXPECT_THROW(executor.blockOn(pager.getAsync(executor,100)), PagerException);
+}
@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../src/DB.hpp"
+#include "../src/Core/VirtualMachine.hpp"
+#include "Server.hpp"
+#include "Client.hpp"
+
+
+class ServerTest : public ::testing::Test {
+ protected:
+
+  void TearDown() override 
+  {
+    // delete db file
+    std::filesystem::remove(filename);
+  }
+
+  static std::array<char,sizeof(DefaultRow)> row(uint32_t id, uint32_t age)
+  {
+    DefaultRow source{id,age,{}};
+    std::array<char,sizeof(DefaultRow)> ret;
+    std::memcpy(ret.data(),&source,sizeof(source));
+    return ret;
+  }
+
+  std::string filename = "servertest.db";
+  std::string socketPath = "servertest.sock";
+};
+
+TEST_F(ServerTest, Pipeline) 
+{
+  const uint32_t rows = 2000;
+  {
+    Database db(filename);
+    db.createTable("main",default_schema());
+    Server server(db,socketPath);
+    std::thread thread([&](){ server.run(); });
+
+    Client client(socketPath);
+    EXPECT_THROW(client.openTable("missing"), ServerException);
+    const auto table = client.openTable("main");
+    // one round trip for all inserts, descending keys are sorted by the server
+    for(uint32_t key = rows; key>0; --key)
+    {
+      client.insert(table,key,row(key,key%7));
+    }
+    client.insert(table,1,row(1,0));
+    client.count(table);
+    client.get(table,42);
+    client.get(table,rows+1);
+    client.upsert(table,42,row(42,100));
+    client.get(table,42);
+    const auto responses = client.execute();
+    ASSERT_EQ(responses.size(), rows+6);
+    for(uint32_t i = 0; i<rows; ++i)
+    {
+      EXPECT_EQ(responses[i].status, Status::OK);
+    }
+    EXPECT_EQ(responses[rows].status, Status::DUPLICATE_KEY);
+    uint64_t count = 0;
+    ASSERT_EQ(responses[rows+1].payload.size(), sizeof(count));
+    std::memcpy(&count,responses[rows+1].payload.data(),sizeof(count));
+    EXPECT_EQ(count, rows);
+    EXPECT_EQ(responses[rows+2].status, Status::OK);
+    EXPECT_EQ(deserialize_row(*reinterpret_cast<const RowData*>(responses[rows+2].payload.data())).age, 0);
+    EXPECT_EQ(responses[rows+3].status, Status::NOT_FOUND);
+    EXPECT_EQ(responses[rows+4].status, Status::OK);
+    DefaultRow result;
+    std::memcpy(&result,responses[rows+5].payload.data(),sizeof(result));
+    EXPECT_EQ(result.age, 100);
+
+    client.get(table+1,1);
+    client.insert(table,5000,std::span<const char>("short",5));
+    const auto errors = client.execute();
+    EXPECT_EQ(errors[0].status, Status::NO_SUCH_TABLE);
+    EXPECT_EQ(errors[1].status, Status::BAD_REQUEST);
+
+    server.stop();
+    thread.join();
+    // group commit flushes once per batch, not once per insert
+    EXPECT_GE(server.commits(), 1);
+    EXPECT_LT(server.commits(), 50);
+  }
+  Database db(filename);
+  EXPECT_EQ(db.table("main").size(), rows);
+  EXPECT_FALSE(std::filesystem::exists(socketPath));
+}
+
+TEST_F(ServerTest, Backpressure) 
+{
+  Database db(filename);
+  db.createTable("main",default_schema());
+  Server server(db,socketPath);
+  std::thread thread([&](){ server.run(); });
+  {
+    Client client(socketPath);
+    const auto table = client.openTable("main");
+    client.insert(table,7,row(7,3));
+    // the client receives the responses while it sends, the server holds back the rest of the requests meanwhile
+    const uint32_t gets = 50000;
+    for(uint32_t i = 0; i<gets; ++i)
+    {
+      client.get(table,7);
+    }
+    const auto responses = client.execute();
+    ASSERT_EQ(responses.size(), gets+1);
+    EXPECT_TRUE(std::all_of(responses.begin(),responses.end(),[](const Client::Response& response)
+    {
+      return response.status==Status::OK;
+    }));
+    EXPECT_EQ(responses.back().payload.size(), sizeof(DefaultRow));
+  }
+
+  // a client that does not receive its responses is not read anymore
+  const int fd = ::socket(AF_UNIX,SOCK_STREAM,0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path,socketPath.data(),socketPath.size());
+  ASSERT_EQ(::connect(fd,reinterpret_cast<const sockaddr*>(&address),sizeof(address)), 0);
+  std::vector<char> requests;
+  const RequestHeader header{.op = Opcode::COUNT};
+  for(int i = 0; i<200000; ++i)
+  {
+    const auto* bytes = reinterpret_cast<const char*>(&header);
+    requests.insert(requests.end(),bytes,bytes+sizeof(header));
+  }
+  size_t sent = 0;
+  while(server.throttled()==0)
+  {
+    const ssize_t ret = ::send(fd,requests.data()+sent,std::min<size_t>(requests.size()-sent,4096),MSG_DONTWAIT | MSG_NOSIGNAL);
+    sent += static_cast<size_t>(std::max<ssize_t>(ret,0));
+    ASSERT_LT(sent, requests.size());
+  }
+  ::close(fd);
+  server.stop();
+  thread.join();
+  EXPECT_GT(server.throttled(), 0);
+}
+
+TEST_F(ServerTest, ConcurrentClients) 
+{
+  Database db(filename);
+  db.createTable("main",default_schema());
+  Server server(db,socketPath,ServerOptions{.groupCommit = false});
+  std::thread thread([&](){ server.run(); });
+
+  const uint32_t clients = 4;
+  const uint32_t rows = 500;
+  std::vector<std::thread> threads;
+  std::atomic<uint32_t> inserted = 0;
+  for(uint32_t c = 0; c<clients; ++c)
+  {
+    threads.emplace_back([&, c]()
+    {
+      Client client(socketPath);
+      const auto table = client.openTable("main");
+      for(uint32_t i = 0; i<rows; ++i)
+      {
+        client.insert(table,i*clients+c,row(i,c));
+      }
+      for(const auto& response: client.execute())
+      {
+        inserted += response.status==Status::OK;
+      }
+    });
+  }
+  for(auto& client: threads)
+  {
+    client.join();
+  }
+  server.stop();
+  thread.join();
+  EXPECT_EQ(inserted.load(), clients*rows);
+  EXPECT_EQ(db.table("main").size(), clients*rows);
+  EXPECT_EQ(server.commits(), 0);
+}